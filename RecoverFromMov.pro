@@ -36,10 +36,45 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
         main.cpp \
-        recovermainwindow.cpp
+        aviparser.cpp \
+        jpegparser.cpp \
+        jpegscan.cpp \
+        movparser.cpp \
+        recoverbatch.cpp \
+        recoverextractor.cpp \
+        recoverindex.cpp \
+        recoverinput.cpp \
+        recovermetrics.cpp \
+        recovermainwindow.cpp \
+        recovermuxer.cpp \
+        recoverparallel.cpp \
+        recoverpredictor.cpp \
+        recoversequence.cpp \
+        recoversurvey.cpp \
+        recovervalidator.cpp \
+        recoverworker.cpp \
+        recoverwriter.cpp
 
 HEADERS += \
-        recovermainwindow.h
+        aviparser.h \
+        jpegparser.h \
+        jpegscan.h \
+        movparser.h \
+        recoverbatch.h \
+        recoverextractor.h \
+        recoverindex.h \
+        recoverinput.h \
+        recovermetrics.h \
+        recovermainwindow.h \
+        recovermuxer.h \
+        recoverparallel.h \
+        recoverpredictor.h \
+        recoverqueue.h \
+        recoversequence.h \
+        recoversurvey.h \
+        recovervalidator.h \
+        recoverworker.h \
+        recoverwriter.h
 
 FORMS += \
         recovermainwindow.ui
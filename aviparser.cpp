@@ -0,0 +1,406 @@
+/*! \file aviparser.cpp
+ * \brief AVI RIFF chunk parser
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "aviparser.h"
+#include "recoverextractor.h"
+
+#include <QByteArray>
+
+/*! \brief Header of a chunk, or of a list */
+typedef struct {
+	uint32_t id;		///< Chunk id, or 'LIST' / 'RIFF'
+	uint32_t type;		///< Type of list, 0 for chunks
+	qint64 pos;			///< Position of the header in file
+	qint64 size;		///< Size of data, from header
+	qint64 end;			///< End of data, reduced to the parent end if truncated
+	bool truncated;		///< Size was larger than the parent
+} t_avi_chunk;
+
+/*! \brief movi list */
+typedef struct {
+	qint64 base;		///< Position of the 'movi' type, where idx1 offsets start
+	qint64 end;			///< End of list
+	bool indexed;		///< Frames are in idx1
+} t_avi_movi;
+
+/*! \brief Structure read in the RIFF headers */
+typedef struct {
+	int video_stream;			///< Number of the video stream, -1 if unknown
+	QVector<qint64> ix_chunks;	///< OpenDML standard indexes of the video stream
+	QVector<t_avi_movi> movi;	///< movi lists of the RIFF AVI and AVIX
+	t_avi_chunk idx1;			///< idx1 chunk, id 0 if not found
+} t_avi_file;
+
+static uint16_t avi_le16(const uint8_t * p) {
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t avi_le32(const uint8_t * p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+			| ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t avi_le64(const uint8_t * p) {
+	return (uint64_t)avi_le32(p) | ((uint64_t)avi_le32(p + 4) << 32);
+}
+
+static bool avi_is_digit(uint8_t c) {
+	return c >= '0' && c <= '9';
+}
+
+/// \brief Chunk ids are printable characters, else it's garbage
+static bool avi_is_fourcc(uint32_t id) {
+	for(int i = 0; i < 4; i++) {
+		uint8_t c = (uint8_t)(id >> (8 * i));
+		if(c < 0x20 || c > 0x7E) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*! \brief Return true for '##dc' (compressed) and '##db' (uncompressed) chunks
+ * \param stream number of the video stream, -1 to accept any stream
+ */
+static bool avi_is_video_id(uint32_t id, int stream) {
+	uint8_t c0 = (uint8_t)id, c1 = (uint8_t)(id >> 8);
+	uint8_t c2 = (uint8_t)(id >> 16), c3 = (uint8_t)(id >> 24);
+	if(!avi_is_digit(c0) || !avi_is_digit(c1) || c2 != 'd' || (c3 != 'c' && c3 != 'b')) {
+		return false;
+	}
+	return stream < 0 || (c0 - '0') * 10 + (c1 - '0') == stream;
+}
+
+/// \brief Ids of the chunks which may be found in a movi list
+static bool avi_is_movi_id(uint32_t id) {
+	uint8_t c0 = (uint8_t)id, c1 = (uint8_t)(id >> 8);
+	uint8_t c2 = (uint8_t)(id >> 16), c3 = (uint8_t)(id >> 24);
+	if(id == AVI_FOURCC('J','U','N','K') || id == AVI_FOURCC('L','I','S','T')) {
+		return true;
+	}
+	// '##xx' stream data, 'ix##' OpenDML index
+	if(avi_is_digit(c0) && avi_is_digit(c1)) {
+		return c2 >= 'a' && c2 <= 'z' && c3 >= 'a' && c3 <= 'z';
+	}
+	return c0 == 'i' && c1 == 'x' && avi_is_digit(c2) && avi_is_digit(c3);
+}
+
+/*! \brief Read the header of the chunk at pos
+ * \param end end of the parent list
+ * \return false if the header can't be read
+ */
+static bool avi_read_chunk(QFile & file, qint64 pos, qint64 end, t_avi_chunk * chunk) {
+	uint8_t header[12];
+	if(end - pos < 8 || !file.seek(pos) || file.read((char *)header, 8) != 8) {
+		return false;
+	}
+	chunk->pos = pos;
+	chunk->id = avi_le32(header);
+	chunk->size = avi_le32(header + 4);
+	chunk->type = 0;
+	if(chunk->id == AVI_FOURCC('R','I','F','F') || chunk->id == AVI_FOURCC('L','I','S','T')) {
+		if(end - pos < 12 || file.read((char *)header + 8, 4) != 4) {
+			return false;
+		}
+		chunk->type = avi_le32(header + 8);
+	}
+	chunk->truncated = (pos + 8 + chunk->size > end);
+	chunk->end = chunk->truncated ? end : pos + 8 + chunk->size;
+	return true;
+}
+
+/// \brief Position of the next chunk, data are padded to 16bit
+static qint64 avi_next_chunk(const t_avi_chunk & chunk) {
+	return chunk.pos + 8 + chunk.size + (chunk.size & 1);
+}
+
+/// \brief Read the data of an index chunk, what remains if it is truncated
+static QByteArray avi_read_data(QFile & file, const t_avi_chunk & chunk) {
+	qint64 len = qMin(chunk.end - chunk.pos - 8, (qint64)AVI_MAX_INDEX_LEN);
+	if(len <= 0 || !file.seek(chunk.pos + 8)) {
+		return QByteArray();
+	}
+	return file.read(len);
+}
+
+/// \brief Read the stream headers and the OpenDML super index of the video stream
+static void avi_parse_hdrl(QFile & file, const t_avi_chunk & hdrl, t_avi_file * avi) {
+	int stream = 0;
+	t_avi_chunk strl;
+	qint64 pos = hdrl.pos + 12;
+	while(avi_read_chunk(file, pos, hdrl.end, &strl)) {
+		if(strl.id == AVI_FOURCC('L','I','S','T') && strl.type == AVI_FOURCC('s','t','r','l')) {
+			bool video = false;
+			t_avi_chunk chunk;
+			qint64 child = strl.pos + 12;
+			while(avi_read_chunk(file, child, strl.end, &chunk)) {
+				if(chunk.id == AVI_FOURCC('s','t','r','h')) {
+					QByteArray data = avi_read_data(file, chunk);
+					video = (data.size() >= 4
+							 && avi_le32((const uint8_t *)data.constData()) == AVI_FOURCC('v','i','d','s'));
+					if(video && avi->video_stream < 0) {
+						avi->video_stream = stream;
+					}
+				} else if(chunk.id == AVI_FOURCC('i','n','d','x') && video
+						  && stream == avi->video_stream) {
+					// Super index: header of 24 bytes, then 16 bytes per ix## chunk
+					QByteArray data = avi_read_data(file, chunk);
+					const uint8_t * p = (const uint8_t *)data.constData();
+					if(data.size() >= 24 && p[3] == 0 /* AVI_INDEX_OF_INDEXES */) {
+						qint64 count = qMin((qint64)avi_le32(p + 4), (qint64)(data.size() - 24) / 16);
+						for(qint64 i = 0; i < count; i++) {
+							avi->ix_chunks.append((qint64)avi_le64(p + 24 + 16 * i));
+						}
+					}
+				}
+				if(chunk.truncated) {
+					break;
+				}
+				child = avi_next_chunk(chunk);
+			}
+			stream++;
+		}
+		if(strl.truncated) {
+			break;
+		}
+		pos = avi_next_chunk(strl);
+	}
+}
+
+/*! \brief Read the frames of the OpenDML standard indexes
+ * \return false if the first one is invalid, then the other methods are used
+ */
+static bool avi_parse_odml(QFile & file, const t_avi_file & avi, qint64 fileSize,
+						   QVector<t_jpeg_extent> * frames) {
+	for(int i = 0; i < avi.ix_chunks.size(); i++) {
+		t_avi_chunk ix;
+		if(!avi_read_chunk(file, avi.ix_chunks[i], fileSize, &ix)) {
+			// lost with the end of the file, the rest will be scanned
+			return !frames->isEmpty();
+		}
+		// wLongsPerEntry, bIndexSubType, bIndexType, nEntriesInUse, dwChunkId,
+		// qwBaseOffset, dwReserved, then offset and size of each chunk
+		QByteArray data = avi_read_data(file, ix);
+		const uint8_t * p = (const uint8_t *)data.constData();
+		if(data.size() < 24 || avi_le16(p) != 2 || p[3] != 1 /* AVI_INDEX_OF_CHUNKS */
+				|| !avi_is_video_id(avi_le32(p + 8), -1)) {
+			MSG_PRINT(LOG_WARNING, "Invalid OpenDML index at %lld", ix.pos);
+			return !frames->isEmpty();
+		}
+		qint64 base = (qint64)avi_le64(p + 12);
+		qint64 count = qMin((qint64)avi_le32(p + 4), (qint64)(data.size() - 24) / 8);
+		for(qint64 e = 0; e < count; e++) {
+			t_jpeg_extent frame;
+			frame.pos = base + avi_le32(p + 24 + 8 * e);
+			// bit 31 is set for the frames which are not key frames
+			frame.length = avi_le32(p + 24 + 8 * e + 4) & 0x7FFFFFFF;
+			if(frame.length > 0 && frame.pos + frame.length <= fileSize) {
+				frames->append(frame);
+			}
+		}
+	}
+	return true;
+}
+
+/*! \brief Read the frames of idx1
+ * \return false if the offsets point to nothing, then the movi list is walked
+ */
+static bool avi_parse_idx1(QFile & file, const t_avi_file & avi, qint64 fileSize,
+						   QVector<t_jpeg_extent> * frames) {
+	QByteArray data = avi_read_data(file, avi.idx1);
+	const uint8_t * p = (const uint8_t *)data.constData();
+	qint64 count = data.size() / 16;
+
+	// Offsets are usually relative to the 'movi' type, but absolute in some files
+	qint64 base = -1;
+	for(qint64 e = 0; e < count && base < 0; e++) {
+		uint32_t id = avi_le32(p + 16 * e);
+		if(!avi_is_video_id(id, avi.video_stream)) {
+			continue;
+		}
+		qint64 offset = avi_le32(p + 16 * e + 8);
+		qint64 bases[2] = { avi.movi[0].base, 0 };
+		for(int b = 0; b < 2 && base < 0; b++) {
+			t_avi_chunk chunk;
+			if(avi_read_chunk(file, bases[b] + offset, fileSize, &chunk) && chunk.id == id) {
+				base = bases[b];
+			}
+		}
+		if(base < 0) {
+			MSG_PRINT(LOG_WARNING, "idx1 offset %lld does not point to its chunk", offset);
+			return false;
+		}
+	}
+	if(base < 0) {
+		return false;
+	}
+
+	for(qint64 e = 0; e < count; e++) {
+		if(!avi_is_video_id(avi_le32(p + 16 * e), avi.video_stream)) {
+			continue;
+		}
+		t_jpeg_extent frame;
+		frame.pos = base + avi_le32(p + 16 * e + 8) + 8;
+		frame.length = avi_le32(p + 16 * e + 12);
+		if(frame.length > 0 && frame.pos + frame.length <= fileSize) {
+			frames->append(frame);
+		}
+	}
+	return true;
+}
+
+/*! \brief Find the next valid video chunk header after damaged data
+ * \return position of the header, -1 if none until end
+ */
+static qint64 avi_resync(QFile & file, qint64 pos, qint64 end, int stream) {
+	QByteArray block;
+	while(pos + 10 <= end) {
+		qint64 len = qMin((qint64)AVI_RESYNC_LEN + 10, end - pos);
+		if(!file.seek(pos)) {
+			return -1;
+		}
+		block = file.read(len);
+		const uint8_t * p = (const uint8_t *)block.constData();
+		len = block.size();
+		if(len < 10) {
+			return -1;
+		}
+		// Id, size, then the SOI of the frame
+		for(qint64 i = 0; i + 10 <= len; i++) {
+			if(p[i + 8] == 0xFF && p[i + 9] == JPEG_MARKER_SOI
+					&& avi_is_video_id(avi_le32(p + i), stream)
+					&& pos + i + 8 + avi_le32(p + i + 4) <= end) {
+				return pos + i;
+			}
+		}
+		pos += len - 9;
+	}
+	return -1;
+}
+
+/// \brief Walk the chunks of a movi list, from header to header
+static void avi_walk_movi(QFile & file, const t_avi_movi & movi, int stream,
+						  QVector<t_jpeg_extent> * frames) {
+	qint64 pos = movi.base + 4;
+	t_avi_chunk chunk;
+	while(pos + 8 <= movi.end) {
+		if(avi_read_chunk(file, pos, movi.end, &chunk) && avi_is_movi_id(chunk.id)
+				&& !chunk.truncated) {
+			if(chunk.id == AVI_FOURCC('L','I','S','T')) {
+				// 'rec ' lists group the chunks of the streams, go inside
+				pos += 12;
+				continue;
+			}
+			if(avi_is_video_id(chunk.id, stream) && chunk.size > 0) {
+				t_jpeg_extent frame;
+				frame.pos = pos + 8;
+				frame.length = chunk.size;
+				frames->append(frame);
+			}
+			pos = avi_next_chunk(chunk);
+			continue;
+		}
+
+		qint64 next = avi_resync(file, pos + 1, movi.end, stream);
+		MSG_PRINT(LOG_WARNING, "Invalid chunk at %lld in movi, resync at %lld", pos, next);
+		if(next < 0) {
+			break;
+		}
+		pos = next;
+	}
+}
+
+int avi_parse_frames(QFile & file, QVector<t_jpeg_extent> * frames) {
+	frames->clear();
+	if(!file.isOpen()) {
+		return -1;
+	}
+	qint64 fileSize = file.size();
+
+	t_avi_file avi;
+	avi.video_stream = -1;
+	avi.idx1.id = 0;
+
+	// RIFF AVI, then RIFF AVIX for OpenDML files larger than 1 GB
+	qint64 pos = 0;
+	t_avi_chunk riff;
+	while(avi_read_chunk(file, pos, fileSize, &riff)
+		  && riff.id == AVI_FOURCC('R','I','F','F')
+		  && (riff.type == AVI_FOURCC('A','V','I',' ') || riff.type == AVI_FOURCC('A','V','I','X'))) {
+		// Interrupted recordings may keep a null size
+		qint64 end = (riff.size == 0 ? fileSize : riff.end);
+
+		qint64 child = pos + 12;
+		t_avi_chunk chunk;
+		while(avi_read_chunk(file, child, end, &chunk)) {
+			if(chunk.id == AVI_FOURCC('L','I','S','T') && chunk.type == AVI_FOURCC('h','d','r','l')) {
+				avi_parse_hdrl(file, chunk, &avi);
+			} else if(chunk.id == AVI_FOURCC('L','I','S','T') && chunk.type == AVI_FOURCC('m','o','v','i')) {
+				t_avi_movi movi;
+				movi.base = chunk.pos + 8;
+				movi.end = (chunk.size == 0 ? end : chunk.end);
+				movi.indexed = false;
+				avi.movi.append(movi);
+				if(chunk.size == 0) {
+					break;
+				}
+			} else if(chunk.id == AVI_FOURCC('i','d','x','1') && avi.idx1.id == 0) {
+				avi.idx1 = chunk;
+			} else if(!avi_is_fourcc(chunk.id)) {
+				// not a chunk id, the rest of the RIFF is damaged
+				break;
+			}
+			if(chunk.truncated) {
+				break;
+			}
+			child = avi_next_chunk(chunk);
+		}
+
+		if(riff.size == 0 || riff.truncated) {
+			break;
+		}
+		pos = avi_next_chunk(riff);
+	}
+
+	if(avi.movi.isEmpty()) {
+		return 0;
+	}
+	MSG_PRINT(LOG_INFO, "AVI: video stream %d, %d movi lists, %d OpenDML indexes, %s idx1",
+			  avi.video_stream, avi.movi.size(), avi.ix_chunks.size(),
+			  avi.idx1.id ? "with" : "without");
+
+	if(!avi.ix_chunks.isEmpty()) {
+		if(avi_parse_odml(file, avi, fileSize, frames)) {
+			return frames->size();
+		}
+		frames->clear();
+	}
+
+	// idx1 only indexes the first movi list
+	if(avi.idx1.id != 0 && avi_parse_idx1(file, avi, fileSize, frames)) {
+		avi.movi[0].indexed = true;
+	} else {
+		frames->clear();
+	}
+	for(int m = 0; m < avi.movi.size(); m++) {
+		if(!avi.movi[m].indexed) {
+			avi_walk_movi(file, avi.movi[m], avi.video_stream, frames);
+		}
+	}
+	return frames->size();
+}
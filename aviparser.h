@@ -0,0 +1,54 @@
+/*! \file aviparser.h
+ * \brief AVI RIFF chunk parser
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Locate the MJPEG frames of an AVI file with its idx1 or OpenDML indexes,
+ * or by walking the chunks of the movi lists when the indexes are lost.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVIPARSER_H
+#define AVIPARSER_H
+
+#include <QFile>
+#include <QVector>
+#include <stdint.h>
+
+#include "jpegparser.h"
+
+/// \brief Build a 32bit chunk id from its 4 characters, as read in little endian
+#define AVI_FOURCC(_a, _b, _c, _d)	((uint32_t)(_a) | ((uint32_t)(_b) << 8) \
+									| ((uint32_t)(_c) << 16) | ((uint32_t)(_d) << 24))
+
+/// Max size of an index read in memory, larger ones are damaged
+#define AVI_MAX_INDEX_LEN	(256*1024*1024)
+
+/// Bytes read at once when searching the next chunk header in damaged data
+#define AVI_RESYNC_LEN		(1024*1024)
+
+/*! \brief Read the video frames of an AVI file
+
+	Use the OpenDML indexes (indx then ix##) of the video stream if present,
+	else idx1, else walk the chunks of the movi lists from header to header.
+	When a chunk header is invalid, the walk continues at the next valid
+	'##dc' or '##db' chunk starting with a SOI marker.
+ * \param file open file
+ * \param frames returned frames inside the file, in the order of the index
+ * \return number of frames, 0 if not an AVI file, -1 if the file is not open
+ */
+int avi_parse_frames(QFile & file, QVector<t_jpeg_extent> * frames);
+
+#endif // AVIPARSER_H
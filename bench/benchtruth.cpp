@@ -0,0 +1,73 @@
+/*! \file benchtruth.cpp
+ * \brief Ground truth of the generated MJPEG files
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "benchtruth.h"
+
+#include <QFile>
+#include <QStringList>
+
+uint64_t bench_hash(const uint8_t * data, qint64 len) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(qint64 i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+bool bench_write_truth(const QString & file, const QVector<t_truth_frame> & frames) {
+	QFile truth(file + BENCH_TRUTH_EXT);
+	if(!truth.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	// One frame per line: number position length hash status
+	QString text("# number position length hash status\n");
+	for(int i = 0; i < frames.size(); i++) {
+		const t_truth_frame & frame = frames[i];
+		text += QString::number(frame.number) + " "
+				+ QString::number(frame.pos) + " "
+				+ QString::number(frame.length) + " "
+				+ QString::number((qulonglong)frame.hash, 16) + " "
+				+ (frame.intact ? "intact" : "damaged") + "\n";
+	}
+	QByteArray data = text.toUtf8();
+	return truth.write(data) == data.size();
+}
+
+bool bench_read_truth(const QString & file, QVector<t_truth_frame> * frames) {
+	frames->clear();
+	QFile truth(file + BENCH_TRUTH_EXT);
+	if(!truth.open(QFile::ReadOnly)) {
+		return false;
+	}
+	while(!truth.atEnd()) {
+		QString line = QString::fromUtf8(truth.readLine()).trimmed();
+		QStringList fields = line.split(" ");
+		if(line.startsWith("#") || fields.size() < 5) {
+			continue;
+		}
+		t_truth_frame frame;
+		frame.number = fields[0].toInt();
+		frame.pos = fields[1].toLongLong();
+		frame.length = fields[2].toLongLong();
+		frame.hash = (uint64_t)fields[3].toULongLong(NULL, 16);
+		frame.intact = (fields[4] == "intact");
+		frames->append(frame);
+	}
+	return true;
+}
@@ -0,0 +1,52 @@
+/*! \file benchtruth.h
+ * \brief Ground truth of the generated MJPEG files
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * mjpeggen writes next to each file a .truth file listing its frames, and
+ * whether the damage left them intact, so recoverbench can compare the
+ * recovered images with them.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHTRUTH_H
+#define BENCHTRUTH_H
+
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+/// Extension of the ground truth file, appended to the name of the generated file
+#define BENCH_TRUTH_EXT	".truth"
+
+/*! \brief Frame of the generated file */
+typedef struct {
+	int number;			///< Number of the frame, from 1
+	qint64 pos;			///< Position of SOI in the damaged file
+	qint64 length;		///< Length of the frame, EOI included
+	uint64_t hash;		///< Hash of the frame before damage
+	bool intact;		///< No damage overlaps the frame
+} t_truth_frame;
+
+/// \brief FNV-1a 64bit hash of a frame
+uint64_t bench_hash(const uint8_t * data, qint64 len);
+
+/// \brief Write the ground truth of file, false on error
+bool bench_write_truth(const QString & file, const QVector<t_truth_frame> & frames);
+
+/// \brief Read the ground truth of file, false if there is none
+bool bench_read_truth(const QString & file, QVector<t_truth_frame> * frames);
+
+#endif // BENCHTRUTH_H
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Regression checks of the extraction, on files built by mjpeggen
+#
+# Usage: bench/check.sh [directory of mjpeggen and recoverbench]
+# Without directory, the tools are taken from the PATH. Exits non-zero
+# when a mode doesn't recover exactly the intact frames, or when the
+# parallel mode doesn't save the same images as the sequential one.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+set -e
+
+MJPEGGEN=${1:+$1/}mjpeggen
+RECOVERBENCH=${1:+$1/}recoverbench
+WORK=${TMPDIR:-/tmp}/recovercheck
+
+rm -rf "$WORK"
+mkdir -p "$WORK"
+
+# Past 4 GB, in a sparse file: every mode recovers all the frames
+"$MJPEGGEN" -f raw -n 200 --hole 4200 "$WORK/large.mjpeg"
+"$RECOVERBENCH" --expect-exact -o "$WORK/out" "$WORK/large.mjpeg"
+
+# With -j, the images and their numbers are the ones of the sequential scan
+"$MJPEGGEN" -f raw -n 2000 --zero-sectors 50 --garbage 50 --cuts 20 "$WORK/damaged.mjpeg"
+"$RECOVERBENCH" --keep -m noindex,parallel -o "$WORK/out" "$WORK/damaged.mjpeg"
+diff -r "$WORK/out/damaged.mjpeg.noindex" "$WORK/out/damaged.mjpeg.parallel"
+
+rm -rf "$WORK"
+echo "All checks passed"
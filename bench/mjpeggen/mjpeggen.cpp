@@ -0,0 +1,436 @@
+/*! \file mjpeggen.cpp
+ * \brief Generator of damaged MJPEG files with their ground truth
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Build a MOV, AVI or raw MJPEG file from test pictures or from JPEG files,
+ * then damage it like a broken recording: index cut at the end of file,
+ * zeroed sectors, random garbage, frames cut in their middle. The frames
+ * and whether they are still intact are written in a .truth file.
+ * A raw file may also have a sparse hole in its middle, so its last frames
+ * are past 4 GB without writing gigabytes.
+ *
+ * Usage: mjpeggen [options] output
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "benchtruth.h"
+#include "jpegparser.h"
+#include "recoverextractor.h"
+#include "recovermuxer.h"
+
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! \brief Container of the generated file */
+typedef enum {
+	GEN_RAW,	///< frames one after the other, like a raw MJPEG stream
+	GEN_AVI,	///< AVI written by RecoverAviMuxer
+	GEN_MOV,	///< MOV written by RecoverMovMuxer
+	GEN_MAX
+} te_gen_container;
+
+const char * c_gen_container_names[GEN_MAX] = {
+	"raw",
+	"avi",
+	"mov"
+};
+
+/// Size of the sectors zeroed by --zero-sectors
+#define GEN_SECTOR_LEN	4096
+
+/// Max length of each garbage run
+#define GEN_GARBAGE_LEN	65536
+
+/*! \brief Bytes removed or overwritten */
+typedef struct {
+	qint64 pos;
+	qint64 length;
+} t_gen_damage;
+
+/// \brief State of the pseudo random generator, so a seed gives the same file
+static uint32_t s_gen_state = 1;
+
+/// \brief xorshift32
+static uint32_t gen_random() {
+	s_gen_state ^= s_gen_state << 13;
+	s_gen_state ^= s_gen_state >> 17;
+	s_gen_state ^= s_gen_state << 5;
+	return s_gen_state;
+}
+
+/// \brief Random value in [0, max[
+static qint64 gen_random_range(qint64 max) {
+	if(max <= 0) {
+		return 0;
+	}
+	uint64_t value = ((uint64_t)gen_random() << 32) | gen_random();
+	return (qint64)(value % (uint64_t)max);
+}
+
+/// \brief Encode a test picture: gradients, a moving block and some noise
+static QByteArray gen_picture(int index, int width, int height, int quality) {
+	QImage image(width, height, QImage::Format_RGB32);
+	int blockX = (index * width / 32) % qMax(1, width - width / 8);
+	for(int y = 0; y < height; y++) {
+		QRgb * line = (QRgb *)image.scanLine(y);
+		for(int x = 0; x < width; x++) {
+			int noise = (int)(gen_random() & 0x1F);
+			if(x >= blockX && x < blockX + width / 8 && y >= height / 3 && y < height / 3 + height / 8) {
+				line[x] = qRgb(255 - noise, 255 - noise, 255 - noise);
+				continue;
+			}
+			line[x] = qRgb((x * 255 / width + index * 8 + noise) & 0xFF,
+						   (y * 255 / height + noise) & 0xFF,
+						   ((x + y) * 128 / (width + height) + noise) & 0xFF);
+		}
+	}
+	QByteArray jpeg;
+	QBuffer buffer(&jpeg);
+	buffer.open(QIODevice::WriteOnly);
+	if(!image.save(&buffer, "JPG", quality)) {
+		return QByteArray();
+	}
+	return jpeg;
+}
+
+/// \brief Read the JPEG files of a directory, in name order
+static QVector<QByteArray> gen_load_pictures(const QString & path) {
+	QVector<QByteArray> pictures;
+	QDir dir(path);
+	QStringList names = dir.entryList(QStringList() << "*.jpg" << "*.JPG" << "*.jpeg",
+									  QDir::Files, QDir::Name);
+	for(int i = 0; i < names.size(); i++) {
+		QFile file(dir.absoluteFilePath(names[i]));
+		if(file.open(QFile::ReadOnly)) {
+			pictures.append(file.readAll());
+		}
+	}
+	return pictures;
+}
+
+/// \brief Insert a COM segment with the frame number after SOI, so each frame is unique
+static QByteArray gen_number_frame(const QByteArray & jpeg, int number) {
+	QByteArray comment = QString("mjpeggen frame %1").arg(number).toUtf8();
+	QByteArray segment;
+	segment.append((char)0xFF);
+	segment.append((char)0xFE);
+	segment.append((char)((comment.size() + 2) >> 8));
+	segment.append((char)((comment.size() + 2) & 0xFF));
+	segment.append(comment);
+	return jpeg.left(2) + segment + jpeg.mid(2);
+}
+
+/// \brief Remove the DHT segments, like the Motion JPEG encoders which rely on the standard tables
+static QByteArray gen_strip_dht(const QByteArray & jpeg) {
+	QByteArray stripped = jpeg.left(2);
+	int pos = 2;
+	while(pos + 4 <= jpeg.size() && (uint8_t)jpeg[pos] == 0xFF
+		  && (uint8_t)jpeg[pos + 1] != JPEG_MARKER_SOS) {
+		int seglen = ((uint8_t)jpeg[pos + 2] << 8) | (uint8_t)jpeg[pos + 3];
+		if((uint8_t)jpeg[pos + 1] != JPEG_MARKER_DHT) {
+			stripped += jpeg.mid(pos, 2 + seglen);
+		}
+		pos += 2 + seglen;
+	}
+	return stripped + jpeg.mid(pos);
+}
+
+/// \brief Copy src in dst without the removed ranges, sorted by position
+static bool gen_copy_without(const QString & src, const QString & dst,
+							 const QVector<t_gen_damage> & removed) {
+	QFile in(src);
+	QFile out(dst);
+	if(!in.open(QFile::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	qint64 pos = 0;
+	for(int i = 0; i <= removed.size(); i++) {
+		qint64 end = (i < removed.size() ? removed[i].pos : in.size());
+		while(pos < end) {
+			QByteArray block = in.read(qMin(end - pos, (qint64)(1024*1024)));
+			if(block.isEmpty() || out.write(block) != block.size()) {
+				return false;
+			}
+			pos += block.size();
+		}
+		if(i < removed.size()) {
+			pos += removed[i].length;
+			if(!in.seek(pos)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/// \brief Overwrite bytes of file at pos, false on error
+static bool gen_overwrite(QFile & file, qint64 pos, const QByteArray & data) {
+	return file.seek(pos) && file.write(data) == data.size();
+}
+
+static bool gen_compare_damage(const t_gen_damage & a, const t_gen_damage & b) {
+	return a.pos < b.pos;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("mjpeggen");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Generate a damaged MJPEG file and its ground truth");
+	parser.addHelpOption();
+	parser.addPositionalArgument("output", "Generated file, the ground truth is written in output" BENCH_TRUTH_EXT);
+	QCommandLineOption formatOption(QStringList() << "f" << "format", "Container: raw, avi or mov", "format", "mov");
+	parser.addOption(formatOption);
+	QCommandLineOption sizeOption(QStringList() << "s" << "size", "Size of the test pictures", "WxH", "640x480");
+	parser.addOption(sizeOption);
+	QCommandLineOption framesOption(QStringList() << "n" << "frames", "Number of frames", "N", "250");
+	parser.addOption(framesOption);
+	QCommandLineOption qualityOption(QStringList() << "q" << "quality", "JPEG quality of the test pictures", "quality", "85");
+	parser.addOption(qualityOption);
+	QCommandLineOption picturesOption(QStringList() << "pictures", "Number of different test pictures, used in turn", "N", "16");
+	parser.addOption(picturesOption);
+	QCommandLineOption fromOption(QStringList() << "from", "Use the JPEG files of a directory instead of test pictures", "directory");
+	parser.addOption(fromOption);
+	QCommandLineOption fpsOption(QStringList() << "fps", "Frame rate of the movie", "fps", QString::number(MUXER_DEFAULT_FPS));
+	parser.addOption(fpsOption);
+	QCommandLineOption seedOption(QStringList() << "seed", "Seed of the pictures and of the damage", "N", "1");
+	parser.addOption(seedOption);
+	QCommandLineOption truncateOption(QStringList() << "truncate-index", "Cut the file in the middle of the moov or idx1 index at its end");
+	parser.addOption(truncateOption);
+	QCommandLineOption zeroOption(QStringList() << "zero-sectors", "Zero N random sectors of 4 kB", "N", "0");
+	parser.addOption(zeroOption);
+	QCommandLineOption garbageOption(QStringList() << "garbage", "Overwrite N random places with random bytes", "N", "0");
+	parser.addOption(garbageOption);
+	QCommandLineOption cutsOption(QStringList() << "cuts", "Remove the second half of N random frames", "N", "0");
+	parser.addOption(cutsOption);
+	QCommandLineOption holeOption(QStringList() << "hole", "Raw only: sparse hole of N MB of zeros after half of the frames, 4096 to test offsets past 4 GB", "MB", "0");
+	parser.addOption(holeOption);
+	QCommandLineOption noDhtOption(QStringList() << "no-dht", "Remove the Huffman tables of the frames, which then need the standard ones");
+	parser.addOption(noDhtOption);
+	parser.process(app);
+
+	QStringList args = parser.positionalArguments();
+	int container = 0;
+	while(container < GEN_MAX && parser.value(formatOption) != c_gen_container_names[container]) {
+		container++;
+	}
+	QStringList size = parser.value(sizeOption).split("x");
+	int width = size[0].toInt();
+	int height = (size.size() > 1 ? size[1].toInt() : 0);
+	int count = parser.value(framesOption).toInt();
+	if(args.size() != 1 || container >= GEN_MAX || width <= 0 || height <= 0 || count <= 0) {
+		fprintf(stderr, "%s", qPrintable(parser.helpText()));
+		return EXIT_FAILURE;
+	}
+	QString output = args[0];
+	qint64 hole = (qint64)parser.value(holeOption).toLongLong() * 1024 * 1024;
+	if(hole > 0 && container != GEN_RAW) {
+		fprintf(stderr, "The hole is only in raw files, the muxers write their frames in a row\n");
+		return EXIT_FAILURE;
+	}
+	s_gen_state = qMax(1u, (uint32_t)parser.value(seedOption).toUInt());
+	g_log_level = LOG_WARNING;
+
+	QVector<QByteArray> pictures;
+	if(parser.isSet(fromOption)) {
+		pictures = gen_load_pictures(parser.value(fromOption));
+	} else {
+		for(int i = 0; i < qMax(1, parser.value(picturesOption).toInt()); i++) {
+			QByteArray jpeg = gen_picture(i, width, height, parser.value(qualityOption).toInt());
+			if(!jpeg.isEmpty()) {
+				pictures.append(jpeg);
+			}
+		}
+	}
+	if(pictures.isEmpty()) {
+		fprintf(stderr, "No picture to write, is the JPEG plugin of Qt installed?\n");
+		return EXIT_FAILURE;
+	}
+	if(parser.isSet(noDhtOption)) {
+		for(int i = 0; i < pictures.size(); i++) {
+			pictures[i] = gen_strip_dht(pictures[i]);
+		}
+	}
+
+	// The frames are cut in a copy, so the clean file is written aside
+	int cuts = parser.value(cutsOption).toInt();
+	QString clean = (cuts > 0 ? output + ".clean" : output);
+	RecoverMuxer * muxer = RecoverMuxer::create(container == GEN_AVI ? OUTPUT_AVI
+												: container == GEN_MOV ? OUTPUT_MOV : OUTPUT_IMAGES);
+	QFile raw(clean);
+	if(muxer) {
+		muxer->setFrameRate(parser.value(fpsOption).toInt());
+		if(!muxer->open(clean)) {
+			fprintf(stderr, "%s\n", qPrintable(muxer->getStatus()));
+			return EXIT_FAILURE;
+		}
+	} else if(!raw.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		fprintf(stderr, "Cannot create '%s'\n", qPrintable(clean));
+		return EXIT_FAILURE;
+	}
+
+	QVector<t_truth_frame> frames;
+	qint64 framesEnd = 0;
+	for(int number = 1; number <= count; number++) {
+		QByteArray jpeg = gen_number_frame(pictures[(number - 1) % pictures.size()], number);
+		const uint8_t * data = (const uint8_t *)jpeg.constData();
+		t_jpeg_frame info;
+		jpeg_parse_frame(data, jpeg.size(), &info);
+
+		t_truth_frame frame;
+		frame.number = number;
+		frame.length = jpeg.size();
+		frame.hash = bench_hash(data, jpeg.size());
+		frame.intact = true;
+		if(muxer) {
+			if(!muxer->write(RecoverExtractor::recoveredImageName(number), data, jpeg.size(),
+							 info.width, info.height)) {
+				fprintf(stderr, "%s\n", qPrintable(muxer->getStatus()));
+				return EXIT_FAILURE;
+			}
+			frame.pos = muxer->getLastFramePos();
+		} else {
+			if(hole > 0 && number == count / 2 + 1) {
+				// Extended without writing, so the zeros take no space on disk
+				qint64 end = raw.pos() + hole;
+				if(!raw.resize(end) || !raw.seek(end)) {
+					fprintf(stderr, "Cannot extend '%s'\n", qPrintable(clean));
+					return EXIT_FAILURE;
+				}
+			}
+			frame.pos = raw.pos();
+			if(raw.write(jpeg) != jpeg.size()) {
+				fprintf(stderr, "Cannot write '%s'\n", qPrintable(clean));
+				return EXIT_FAILURE;
+			}
+		}
+		framesEnd = frame.pos + frame.length;
+		frames.append(frame);
+	}
+	bool ok = (muxer ? muxer->close() : true);
+	delete muxer;
+	raw.close();
+	if(!ok) {
+		fprintf(stderr, "Cannot write '%s'\n", qPrintable(clean));
+		return EXIT_FAILURE;
+	}
+
+	// Cut the second half of random frames, the next bytes move back
+	if(cuts > 0) {
+		QVector<t_gen_damage> removed;
+		QVector<bool> cut(frames.size(), false);
+		for(int i = 0; i < qMin(cuts, frames.size()); i++) {
+			int index = (int)gen_random_range(frames.size());
+			while(cut[index]) {
+				index = (index + 1) % frames.size();
+			}
+			cut[index] = true;
+			t_gen_damage damage;
+			damage.length = frames[index].length - frames[index].length / 2;
+			damage.pos = frames[index].pos + frames[index].length / 2;
+			removed.append(damage);
+		}
+		std::sort(removed.begin(), removed.end(), gen_compare_damage);
+		if(!gen_copy_without(clean, output, removed)) {
+			fprintf(stderr, "Cannot write '%s'\n", qPrintable(output));
+			return EXIT_FAILURE;
+		}
+		QFile::remove(clean);
+
+		qint64 shift = 0;
+		int next = 0;
+		for(int i = 0; i < frames.size(); i++) {
+			while(next < removed.size() && removed[next].pos < frames[i].pos) {
+				shift += removed[next++].length;
+			}
+			frames[i].pos -= shift;
+			frames[i].intact = !cut[i];
+		}
+		while(next < removed.size() && removed[next].pos < framesEnd) {
+			shift += removed[next++].length;
+		}
+		framesEnd -= shift;
+	}
+
+	QFile file(output);
+	if(!file.open(QIODevice::ReadWrite)) {
+		fprintf(stderr, "Cannot open '%s'\n", qPrintable(output));
+		return EXIT_FAILURE;
+	}
+	if(parser.isSet(truncateOption) && container != GEN_RAW) {
+		// The index of the muxers is after the last frame
+		file.resize(framesEnd + (file.size() - framesEnd) / 2);
+	}
+
+	QVector<t_gen_damage> overwritten;
+	int sectors = parser.value(zeroOption).toInt();
+	for(int i = 0; i < sectors && file.size() > 0; i++) {
+		t_gen_damage damage;
+		damage.pos = gen_random_range((file.size() + GEN_SECTOR_LEN - 1) / GEN_SECTOR_LEN) * GEN_SECTOR_LEN;
+		damage.length = qMin((qint64)GEN_SECTOR_LEN, file.size() - damage.pos);
+		ok = ok && gen_overwrite(file, damage.pos, QByteArray((int)damage.length, '\0'));
+		overwritten.append(damage);
+	}
+	int garbage = parser.value(garbageOption).toInt();
+	for(int i = 0; i < garbage && file.size() > 0; i++) {
+		t_gen_damage damage;
+		damage.length = qMin(1 + gen_random_range(GEN_GARBAGE_LEN), file.size());
+		damage.pos = gen_random_range(file.size() - damage.length + 1);
+		QByteArray bytes((int)damage.length, '\0');
+		for(int b = 0; b < bytes.size(); b++) {
+			bytes.data()[b] = (char)gen_random();
+		}
+		ok = ok && gen_overwrite(file, damage.pos, bytes);
+		overwritten.append(damage);
+	}
+	file.close();
+	if(!ok) {
+		fprintf(stderr, "Cannot damage '%s'\n", qPrintable(output));
+		return EXIT_FAILURE;
+	}
+
+	int intact = 0;
+	for(int i = 0; i < frames.size(); i++) {
+		t_truth_frame & frame = frames[i];
+		for(int d = 0; d < overwritten.size() && frame.intact; d++) {
+			if(overwritten[d].pos < frame.pos + frame.length
+					&& frame.pos < overwritten[d].pos + overwritten[d].length) {
+				frame.intact = false;
+			}
+		}
+		intact += (frame.intact ? 1 : 0);
+	}
+	if(!bench_write_truth(output, frames)) {
+		fprintf(stderr, "Cannot write '%s" BENCH_TRUTH_EXT "'\n", qPrintable(output));
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "Wrote '%s': %s, %d frames, %d intact, %.1f MB\n",
+			qPrintable(output), c_gen_container_names[container],
+			frames.size(), intact, (double)QFile(output).size() / (1024. * 1024.));
+	return EXIT_SUCCESS;
+}
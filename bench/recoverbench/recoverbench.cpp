@@ -0,0 +1,265 @@
+/*! \file recoverbench.cpp
+ * \brief Throughput and accuracy of the extraction modes
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Extract the frames of each file with each mode of the extractor, then
+ * compare the recovered images with the ground truth written by mjpeggen:
+ * exact frames, missed intact frames and extra images, which are damaged
+ * frames or false frames.
+ *
+ * Usage: recoverbench [options] file...
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "benchtruth.h"
+#include "recoverextractor.h"
+#include "recoverparallel.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*! \brief Extraction mode */
+typedef enum {
+	BENCH_READ,		///< sequential, INPUT_READ
+	BENCH_MMAP,		///< sequential, INPUT_MMAP
+	BENCH_PIPELINE,	///< sequential, read ahead and written on other threads
+	BENCH_NO_INDEX,	///< sequential, INPUT_READ, whole file scanned
+	BENCH_PARALLEL,	///< RecoverParallelExtractor
+	BENCH_MAX
+} te_bench_mode;
+
+const char * c_bench_mode_names[BENCH_MAX] = {
+	"read",
+	"mmap",
+	"pipeline",
+	"noindex",
+	"parallel"
+};
+
+/*! \brief Result of one extraction */
+typedef struct {
+	bool ok;			///< Extraction finished
+	qint64 nsecs;		///< Duration
+	qint64 size;		///< Size of input file
+	int frames;			///< Images saved
+	qint64 parsed;		///< JPEG candidates parsed, -1 if unknown
+	int decoded;		///< Frames decoded by the validation
+} t_bench_run;
+
+/*! \brief Recovered images compared with the ground truth */
+typedef struct {
+	int recovered;		///< Images in output directory
+	int exact;			///< Images equal to an intact frame
+	int missed;			///< Intact frames not recovered
+	int extra;			///< Images which are not an intact frame
+} t_bench_accuracy;
+
+/// \brief Extract all the frames of file in dir
+static t_bench_run bench_run(te_bench_mode mode, const QString & file, const QString & dir,
+							 te_validation_level level, int threads) {
+	t_bench_run run;
+	run.ok = false;
+	run.size = QFileInfo(file).size();
+	run.frames = 0;
+	run.parsed = -1;
+	run.decoded = 0;
+
+	QElapsedTimer timer;
+	timer.start();
+	if(mode == BENCH_PARALLEL) {
+		RecoverParallelExtractor extractor;
+		extractor.setFilename(file, dir);
+		extractor.setThreadCount(threads);
+		extractor.setValidationLevel(level);
+		run.ok = extractor.run(0);
+		run.frames = extractor.getImageCount();
+		run.decoded = extractor.getDecodeCount();
+	} else {
+		RecoverExtractor extractor;
+		extractor.setPreviewEnabled(false);
+		extractor.setInputMode(mode == BENCH_MMAP ? INPUT_MMAP : INPUT_READ);
+		extractor.setPipelineEnabled(mode == BENCH_PIPELINE);
+		extractor.setIndexEnabled(mode != BENCH_NO_INDEX);
+		extractor.setValidationLevel(level);
+		extractor.setResumeEnabled(false);
+		extractor.setJournalPeriod(0);
+		extractor.setFilename(file);
+		run.ok = extractor.setOutputDirectory(dir);
+		while(run.ok && !extractor.atEnd()) {
+			run.ok = extractor.extract();
+		}
+		run.frames = extractor.getImageCount();
+		run.parsed = extractor.getParseCount();
+		run.decoded = extractor.getDecodeCount();
+	}
+	run.nsecs = timer.nsecsElapsed();
+	return run;
+}
+
+/// \brief Compare the images of dir with the intact frames of the truth
+static t_bench_accuracy bench_compare(const QString & dir, const QVector<t_truth_frame> & truth) {
+	QSet<uint64_t> intact;
+	for(int i = 0; i < truth.size(); i++) {
+		if(truth[i].intact) {
+			intact.insert(truth[i].hash);
+		}
+	}
+
+	t_bench_accuracy accuracy;
+	accuracy.exact = 0;
+	QDir output(dir);
+	QStringList images = output.entryList(QStringList() << "REC_*.jpg", QDir::Files, QDir::Name);
+	accuracy.recovered = images.size();
+	QSet<uint64_t> found;
+	for(int i = 0; i < images.size(); i++) {
+		QFile image(output.absoluteFilePath(images[i]));
+		if(!image.open(QFile::ReadOnly)) {
+			continue;
+		}
+		QByteArray data = image.readAll();
+		uint64_t hash = bench_hash((const uint8_t *)data.constData(), data.size());
+		// Each frame is unique, thanks to its number in a COM segment
+		if(intact.contains(hash) && !found.contains(hash)) {
+			found.insert(hash);
+			accuracy.exact++;
+		}
+	}
+	accuracy.missed = intact.size() - accuracy.exact;
+	accuracy.extra = accuracy.recovered - accuracy.exact;
+	return accuracy;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("recoverbench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Measure the throughput and accuracy of each extraction mode");
+	parser.addHelpOption();
+	parser.addPositionalArgument("files", "MJPEG files, with their ground truth from mjpeggen if any");
+	QCommandLineOption modesOption(QStringList() << "m" << "modes",
+								   "Extraction modes, separated by commas: read, mmap, pipeline, noindex, parallel",
+								   "modes", "read,mmap,pipeline,noindex,parallel");
+	parser.addOption(modesOption);
+	QCommandLineOption checkOption(QStringList() << "c" << "check",
+								   "Verification of the frames: structure, scaled or full decoding",
+								   "level", validation_level_name(VALIDATE_STRUCTURE));
+	parser.addOption(checkOption);
+	QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+									 "Threads of the parallel mode, 0 for the number of cores", "N", "0");
+	parser.addOption(threadsOption);
+	QCommandLineOption outputOption(QStringList() << "o" << "output",
+									"Directory of the recovered images",
+									"directory", QDir::temp().absoluteFilePath("recoverbench"));
+	parser.addOption(outputOption);
+	QCommandLineOption keepOption(QStringList() << "k" << "keep",
+								  "Keep the recovered images of each mode");
+	parser.addOption(keepOption);
+	QCommandLineOption exactOption(QStringList() << "e" << "expect-exact",
+								   "Fail when the images of a file with ground truth are not exactly its intact frames");
+	parser.addOption(exactOption);
+	parser.process(app);
+
+	QStringList files = parser.positionalArguments();
+	int level = 0;
+	while(level < VALIDATE_MAX && parser.value(checkOption) != validation_level_name(level)) {
+		level++;
+	}
+	QVector<te_bench_mode> modes;
+	QStringList names = parser.value(modesOption).split(",");
+	for(int i = 0; i < names.size(); i++) {
+		int mode = 0;
+		while(mode < BENCH_MAX && names[i] != c_bench_mode_names[mode]) {
+			mode++;
+		}
+		if(mode >= BENCH_MAX) {
+			fprintf(stderr, "Invalid mode '%s'\n", qPrintable(names[i]));
+			return EXIT_FAILURE;
+		}
+		modes.append((te_bench_mode)mode);
+	}
+	if(files.isEmpty() || level >= VALIDATE_MAX) {
+		fprintf(stderr, "%s", qPrintable(parser.helpText()));
+		return EXIT_FAILURE;
+	}
+	g_log_level = LOG_ERROR;
+
+	QDir work(parser.value(outputOption));
+	int failures = 0;
+	for(int f = 0; f < files.size(); f++) {
+		QVector<t_truth_frame> truth;
+		bool hasTruth = bench_read_truth(files[f], &truth);
+		int intact = 0;
+		for(int i = 0; i < truth.size(); i++) {
+			intact += (truth[i].intact ? 1 : 0);
+		}
+		fprintf(stdout, "%s: %.1f MB", qPrintable(files[f]),
+				(double)QFileInfo(files[f]).size() / (1024. * 1024.));
+		if(hasTruth) {
+			fprintf(stdout, ", %d frames, %d intact", truth.size(), intact);
+		}
+		fprintf(stdout, "\n%-9s %9s %10s %9s %8s %9s %7s %7s %7s %7s\n",
+				"mode", "MB/s", "frames/s", "parsed", "decoded",
+				"images", "exact", "missed", "extra", "recall");
+
+		for(int m = 0; m < modes.size(); m++) {
+			QString dir = work.absoluteFilePath(QFileInfo(files[f]).fileName() + "." + c_bench_mode_names[modes[m]]);
+			QDir(dir).removeRecursively();
+
+			t_bench_run run = bench_run(modes[m], files[f], dir, (te_validation_level)level,
+										parser.value(threadsOption).toInt());
+			double seconds = (double)run.nsecs * 1e-9;
+			fprintf(stdout, "%-9s %9.1f %10.1f %9s %8d %9d",
+					c_bench_mode_names[modes[m]],
+					seconds > 0. ? (double)run.size / (1024. * 1024.) / seconds : 0.,
+					seconds > 0. ? (double)run.frames / seconds : 0.,
+					run.parsed >= 0 ? qPrintable(QString::number(run.parsed)) : "-",
+					run.decoded, run.frames);
+			if(!run.ok) {
+				failures++;
+				fprintf(stdout, "  FAILED\n");
+			} else if(hasTruth) {
+				t_bench_accuracy accuracy = bench_compare(dir, truth);
+				fprintf(stdout, " %7d %7d %7d %6.1f%%",
+						accuracy.exact, accuracy.missed, accuracy.extra,
+						intact > 0 ? 100. * accuracy.exact / intact : 100.);
+				if(parser.isSet(exactOption) && (accuracy.missed > 0 || accuracy.extra > 0)) {
+					failures++;
+					fprintf(stdout, "  INEXACT");
+				}
+				fprintf(stdout, "\n");
+			} else {
+				fprintf(stdout, " %7s %7s %7s %7s\n", "-", "-", "-", "-");
+			}
+			fflush(stdout);
+
+			if(!parser.isSet(keepOption)) {
+				QDir(dir).removeRecursively();
+			}
+		}
+		fprintf(stdout, "\n");
+	}
+	return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
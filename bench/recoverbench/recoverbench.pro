@@ -0,0 +1,62 @@
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Throughput and accuracy benchmark of the extraction modes
+
+QT       += core gui
+
+TARGET = recoverbench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += .. ../..
+
+SOURCES += \
+        recoverbench.cpp \
+        ../benchtruth.cpp \
+        ../../aviparser.cpp \
+        ../../jpegparser.cpp \
+        ../../jpegscan.cpp \
+        ../../movparser.cpp \
+        ../../recoverextractor.cpp \
+        ../../recoverindex.cpp \
+        ../../recoverinput.cpp \
+        ../../recovermetrics.cpp \
+        ../../recovermuxer.cpp \
+        ../../recoverparallel.cpp \
+        ../../recoverpredictor.cpp \
+        ../../recoversequence.cpp \
+        ../../recovervalidator.cpp \
+        ../../recoverwriter.cpp
+
+HEADERS += \
+        ../benchtruth.h \
+        ../../aviparser.h \
+        ../../jpegparser.h \
+        ../../jpegscan.h \
+        ../../movparser.h \
+        ../../recoverextractor.h \
+        ../../recoverindex.h \
+        ../../recoverinput.h \
+        ../../recovermetrics.h \
+        ../../recovermuxer.h \
+        ../../recoverparallel.h \
+        ../../recoverpredictor.h \
+        ../../recoverqueue.h \
+        ../../recoversequence.h \
+        ../../recovervalidator.h \
+        ../../recoverwriter.h
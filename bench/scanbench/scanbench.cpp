@@ -0,0 +1,178 @@
+/*! \file scanbench.cpp
+ * \brief Micro-benchmark of the scanning kernels
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Compare the SOI and tag search kernels with the byte by byte 32bit
+ * comparison loop of the first versions of the extractor.
+ *
+ * Usage: scanbench [file] [size in MB] [loops]
+ * Without file, a random buffer with a JPEG header every megabyte is used.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "jpegscan.h"
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QString>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// \brief Header of the frames inserted in the random buffer
+static const uint8_t c_bench_tag[4] = { 0xFF, 0xD8, 0xFF, 0xE0 };
+
+/// \brief Fill buffer with pseudo random data and a JPEG header every MB
+static void fill_random(uint8_t * buffer, qint64 len) {
+	uint32_t state = 0x12345678;
+	for(qint64 i = 0; i < len; i++) {
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		buffer[i] = (uint8_t)state;
+		// No false SOI, like in entropy coded data where 0xFF is stuffed
+		if(i > 0 && buffer[i-1] == 0xFF && buffer[i] == 0xD8) {
+			buffer[i] = 0x00;
+		}
+	}
+	for(qint64 i = 0; i + 4 <= len; i += 1024*1024) {
+		memcpy(buffer + i, c_bench_tag, 4);
+	}
+}
+
+/// \brief Loop of the first versions: 32bit compare at every byte
+static qint64 scan_reference(const uint8_t * buffer, qint64 len, qint64 from,
+							 uint32_t tag32) {
+	for(qint64 offset = from; offset + 4 <= len; offset++) {
+		uint32_t buffer32;
+		memcpy(&buffer32, buffer + offset, 4);
+		if(buffer32 == tag32) {
+			return offset;
+		}
+	}
+	return -1;
+}
+
+/// \brief Number of hits and duration of a benchmark run
+typedef struct {
+	qint64 hits;
+	qint64 nsecs;
+} t_bench_result;
+
+/// \brief Run the search of all the occurences in buffer, loops times
+static t_bench_result bench_kernel(int kernel, bool tag,
+								   const uint8_t * buffer, qint64 len, int loops) {
+	t_bench_result result;
+	result.hits = 0;
+	uint32_t tag32;
+	memcpy(&tag32, c_bench_tag, 4);
+
+	QElapsedTimer timer;
+	timer.start();
+	for(int loop = 0; loop < loops; loop++) {
+		qint64 offset = 0;
+		for(;;) {
+			if(kernel < 0) {
+				offset = scan_reference(buffer, len, offset, tag32);
+			} else if(tag) {
+				offset = jpeg_scan_tag_kernel((te_jpeg_scan_kernel)kernel, buffer, len, offset, c_bench_tag);
+			} else {
+				offset = jpeg_scan_soi_kernel((te_jpeg_scan_kernel)kernel, buffer, len, offset);
+			}
+			if(offset < 0) { break; }
+			result.hits++;
+			offset++;
+		}
+	}
+	result.nsecs = timer.nsecsElapsed();
+	result.hits /= loops;
+	return result;
+}
+
+static double bench_mbps(qint64 len, int loops, qint64 nsecs) {
+	if(nsecs <= 0) { return 0.; }
+	return (double)len * loops / (1024. * 1024.) / ((double)nsecs * 1e-9);
+}
+
+int main(int argc, char *argv[])
+{
+	QString filename;
+	qint64 len = 256 * 1024 * 1024;
+	int loops = 4;
+
+	if(argc > 1 && strcmp(argv[1], "-") != 0) {
+		filename = QString::fromLocal8Bit(argv[1]);
+	}
+	if(argc > 2) {
+		len = (qint64)atoi(argv[2]) * 1024 * 1024;
+	}
+	if(argc > 3) {
+		loops = atoi(argv[3]);
+	}
+	if(len <= 0 || loops <= 0) {
+		fprintf(stderr, "Usage: %s [file|-] [size in MB] [loops]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	uint8_t * buffer = new uint8_t [ len ];
+	if(!filename.isEmpty()) {
+		QFile file(filename);
+		if(!file.open(QFile::ReadOnly)) {
+			fprintf(stderr, "Cannot open '%s'\n", qPrintable(filename));
+			delete [] buffer;
+			return EXIT_FAILURE;
+		}
+		len = file.read((char *)buffer, len);
+		if(len <= 0) {
+			fprintf(stderr, "Cannot read '%s'\n", qPrintable(filename));
+			delete [] buffer;
+			return EXIT_FAILURE;
+		}
+	} else {
+		fill_random(buffer, len);
+	}
+
+	fprintf(stdout, "Buffer %.1f MB, %d loops, best kernel=%s\n",
+			(double)len / (1024. * 1024.), loops,
+			jpeg_scan_kernel_name(jpeg_scan_best_kernel()));
+	fprintf(stdout, "%-10s %12s %10s %12s %10s\n",
+			"kernel", "SOI MB/s", "SOI hits", "tag MB/s", "tag hits");
+
+	// Reference loop only searches the tag
+	t_bench_result ref = bench_kernel(-1, true, buffer, len, loops);
+	fprintf(stdout, "%-10s %12s %10s %12.1f %10lld\n",
+			"reference", "-", "-",
+			bench_mbps(len, loops, ref.nsecs), ref.hits);
+
+	for(int kernel = 0; kernel < JPEG_SCAN_MAX; kernel++) {
+		if(!jpeg_scan_kernel_supported((te_jpeg_scan_kernel)kernel)) {
+			fprintf(stdout, "%-10s not supported\n", jpeg_scan_kernel_name(kernel));
+			continue;
+		}
+		t_bench_result soi = bench_kernel(kernel, false, buffer, len, loops);
+		t_bench_result tag = bench_kernel(kernel, true, buffer, len, loops);
+		fprintf(stdout, "%-10s %12.1f %10lld %12.1f %10lld%s\n",
+				jpeg_scan_kernel_name(kernel),
+				bench_mbps(len, loops, soi.nsecs), soi.hits,
+				bench_mbps(len, loops, tag.nsecs), tag.hits,
+				tag.hits != ref.hits ? "  MISMATCH" : "");
+	}
+
+	delete [] buffer;
+	return EXIT_SUCCESS;
+}
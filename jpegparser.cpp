@@ -0,0 +1,211 @@
+/*! \file jpegparser.cpp
+ * \brief JPEG marker segment parser
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "jpegparser.h"
+
+#include <string.h>
+
+/*! \brief DHT segment of the example tables of ITU T.81 K.3, for luminance
+ * and chrominance, DC then AC, in the order of the Motion JPEG encoders
+ */
+static const uint8_t c_jpeg_standard_dht[JPEG_STANDARD_DHT_LEN] = {
+	0xFF, JPEG_MARKER_DHT, 0x01, 0xA2,
+	// DC luminance, class 0 id 0
+	0x00,
+	0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+	// AC luminance, class 1 id 0
+	0x10,
+	0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7D,
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+	0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+	0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+	0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+	0xF9, 0xFA,
+	// DC chrominance, class 0 id 1
+	0x01,
+	0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+	// AC chrominance, class 1 id 1
+	0x11,
+	0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77,
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+	0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+	0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+	0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+	0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+	0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+	0xF9, 0xFA
+};
+
+/// \brief Return true if the marker is one of the Start Of Frame markers
+static bool jpeg_is_sof(uint8_t marker) {
+	// C4 is DHT, C8 is reserved (JPG) and CC is DAC, others are SOFn
+	return (marker >= 0xC0 && marker <= 0xCF
+			&& marker != JPEG_MARKER_DHT && marker != 0xC8 && marker != 0xCC);
+}
+
+/// \brief Store the status in frame info and return it
+static te_jpeg_frame_status jpeg_return(t_jpeg_frame * frame, t_jpeg_frame * info,
+										te_jpeg_frame_status status, qint64 pos) {
+	info->status = status;
+	info->length = pos;
+	if(frame) { *frame = *info; }
+	return status;
+}
+
+te_jpeg_frame_status jpeg_parse_frame(const uint8_t * buffer, qint64 len,
+									  t_jpeg_frame * frame) {
+	t_jpeg_frame info;
+	memset(&info, 0, sizeof(t_jpeg_frame));
+
+	if(!buffer || len < 2) {
+		return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, 0);
+	}
+	if(buffer[0] != 0xFF || buffer[1] != JPEG_MARKER_SOI) {
+		return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, 0);
+	}
+
+	qint64 pos = 2;
+	for(;;) {
+		/*
+		 * Marker segments: 0xFF marker [length 16bit BE] [length-2 bytes]
+		 */
+		if(pos >= len) {
+			return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, pos);
+		}
+		if(buffer[pos] != 0xFF) {
+			return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, pos);
+		}
+		// skip fill bytes
+		while(pos + 1 < len && buffer[pos + 1] == 0xFF) {
+			pos++;
+		}
+		if(pos + 1 >= len) {
+			return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, pos);
+		}
+
+		uint8_t marker = buffer[pos + 1];
+		// Standalone markers: TEM and RSTn, without length
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			pos += 2;
+			continue;
+		}
+		// Nested SOI means that the frame was cut, and EOI before any scan is not an image.
+		// 0x02-0xBF are reserved
+		if(marker == JPEG_MARKER_SOI || marker == JPEG_MARKER_EOI
+				|| marker < 0xC0 || marker == 0xC8) {
+			return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, pos);
+		}
+
+		if(pos + 4 > len) {
+			return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, pos);
+		}
+		qint64 seglen = ((qint64)buffer[pos + 2] << 8) | (qint64)buffer[pos + 3];
+		if(seglen < 2) {
+			return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, pos);
+		}
+		if(pos + 2 + seglen > len) {
+			return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, pos);
+		}
+		const uint8_t * segment = buffer + pos + 4;
+
+		if(jpeg_is_sof(marker)) {
+			// P(8) Y(16) X(16) Nf(8) then 3 bytes per component
+			if(seglen < 8) {
+				return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, pos);
+			}
+			info.height = (segment[1] << 8) | segment[2];
+			info.width = (segment[3] << 8) | segment[4];
+			info.components = segment[5];
+			if(info.width == 0 || info.components == 0
+					|| seglen < 8 + 3 * info.components) {
+				return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, pos);
+			}
+			info.sof_marker = marker;
+		} else if(marker == JPEG_MARKER_DHT) {
+			info.has_dht = true;
+		}
+
+		pos += 2 + seglen;
+
+		if(marker != JPEG_MARKER_SOS) {
+			continue;
+		}
+
+		/*
+		 * Entropy coded data: 0xFF is followed by 0x00 (stuffing), RSTn or
+		 * fill bytes. Any other marker ends the scan.
+		 */
+		if(info.sof_marker == 0) {
+			// scan without frame header
+			return jpeg_return(frame, &info, JPEG_FRAME_BROKEN, pos);
+		}
+		if(info.scans == 0) {
+			info.sos_pos = pos - 2 - seglen;
+		}
+		info.scans++;
+
+		for(;;) {
+			const uint8_t * ff = (const uint8_t *)memchr(buffer + pos, 0xFF,
+														 (size_t)(len - pos));
+			if(!ff) {
+				return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, len);
+			}
+			pos = ff - buffer;
+			if(pos + 1 >= len) {
+				return jpeg_return(frame, &info, JPEG_FRAME_NEED_MORE, pos);
+			}
+			uint8_t next = buffer[pos + 1];
+			if(next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+				pos += 2;
+			} else if(next == 0xFF) {
+				pos++;
+			} else if(next == JPEG_MARKER_EOI) {
+				return jpeg_return(frame, &info, JPEG_FRAME_OK, pos + 2);
+			} else {
+				// Next segment: tables or scan of a progressive/multi-scan frame
+				break;
+			}
+		}
+	}
+}
+
+bool jpeg_needs_dht(const t_jpeg_frame * frame) {
+	// The standard tables are only defined for the sequential Huffman modes
+	return (frame->status == JPEG_FRAME_OK && !frame->has_dht && frame->sos_pos > 0
+			&& (frame->sof_marker == 0xC0 || frame->sof_marker == 0xC1));
+}
+
+qint64 jpeg_insert_dht(const uint8_t * buffer, const t_jpeg_frame * frame, uint8_t * output) {
+	memcpy(output, buffer, (size_t)frame->sos_pos);
+	memcpy(output + frame->sos_pos, c_jpeg_standard_dht, JPEG_STANDARD_DHT_LEN);
+	memcpy(output + frame->sos_pos + JPEG_STANDARD_DHT_LEN, buffer + frame->sos_pos,
+		   (size_t)(frame->length - frame->sos_pos));
+	return frame->length + JPEG_STANDARD_DHT_LEN;
+}
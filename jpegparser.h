@@ -0,0 +1,100 @@
+/*! \file jpegparser.h
+ * \brief JPEG marker segment parser
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Locate JPEG frames in a raw buffer by walking the marker segments,
+ * without decoding the pixels.
+ *
+ * Many Motion JPEG encoders omit the DHT segments, the decoders being
+ * expected to use the example tables of the JPEG standard (ITU T.81, K.3).
+ * Those tables can be inserted in the frames, for the decoders which
+ * reject them otherwise.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JPEGPARSER_H
+#define JPEGPARSER_H
+
+#include <QtGlobal>
+#include <stdint.h>
+
+/// \brief JPEG markers used by the parser (second byte, after 0xFF)
+#define JPEG_MARKER_SOI		0xD8
+#define JPEG_MARKER_EOI		0xD9
+#define JPEG_MARKER_SOS		0xDA
+#define JPEG_MARKER_DHT		0xC4
+#define JPEG_MARKER_DQT		0xDB
+
+/*! \brief Result of the parsing of a frame */
+typedef enum {
+	JPEG_FRAME_OK,			///< Complete frame, from SOI to EOI
+	JPEG_FRAME_NEED_MORE,	///< Valid so far, but the buffer ends before EOI
+	JPEG_FRAME_BROKEN		///< Invalid marker or segment: not a JPEG, or cut
+} te_jpeg_frame_status;
+
+/*! \brief Extent and header information of a frame */
+typedef struct {
+	te_jpeg_frame_status status;	///< Parsing result
+
+	/*! \brief Length of the frame in bytes, EOI included, when status is OK.
+		Otherwise, number of bytes examined before giving up. */
+	qint64 length;
+
+	int width;			///< Width from SOF
+	int height;			///< Height from SOF
+	int components;		///< Number of components from SOF
+	int sof_marker;		///< SOF marker (0xC0 baseline, 0xC2 progressive...), 0 if not found
+	bool has_dht;		///< true if at least one DHT segment was found
+	int scans;			///< Number of SOS segments
+	qint64 sos_pos;		///< Position of the first SOS marker, 0 if not found
+} t_jpeg_frame;
+
+/*! \brief Position of a frame in a file, given by the index of a container */
+typedef struct {
+	qint64 pos;			///< Position of the frame in file
+	qint64 length;		///< Length from the index, may include padding
+} t_jpeg_extent;
+
+/*! \brief Parse the JPEG frame starting at buffer[0]
+
+	Walk the marker segments (APPn, DQT, DHT, SOF, SOS...) then the entropy
+	coded data until EOI. Pixels are not decoded, so it's only a structural
+	check of the frame.
+ * \param buffer buffer starting at the SOI marker
+ * \param len available bytes in buffer
+ * \param frame output information, may be NULL
+ * \return parsing status, also stored in frame
+ */
+te_jpeg_frame_status jpeg_parse_frame(const uint8_t * buffer, qint64 len,
+									  t_jpeg_frame * frame);
+
+/// Length of the DHT segment of the 4 standard tables, marker included
+#define JPEG_STANDARD_DHT_LEN	420
+
+/*! \brief Return true if the frame needs the standard Huffman tables to be decoded
+ * Only for the complete frames without DHT in baseline or extended sequential mode.
+ */
+bool jpeg_needs_dht(const t_jpeg_frame * frame);
+
+/*! \brief Copy the frame with the standard Huffman tables before its first scan
+ * \param buffer frame parsed by jpeg_parse_frame
+ * \param frame its information, jpeg_needs_dht() must be true
+ * \param output buffer of frame->length + JPEG_STANDARD_DHT_LEN bytes
+ * \return length of the frame in output
+ */
+qint64 jpeg_insert_dht(const uint8_t * buffer, const t_jpeg_frame * frame, uint8_t * output);
+
+#endif // JPEGPARSER_H
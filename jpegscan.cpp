@@ -0,0 +1,256 @@
+/*! \file jpegscan.cpp
+ * \brief Fast search of JPEG candidates in raw buffers
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "jpegscan.h"
+
+#include <QAtomicInt>
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JPEG_SCAN_X86
+#define JPEG_SCAN_TARGET_SSE2	__attribute__((target("sse2")))
+#define JPEG_SCAN_TARGET_AVX2	__attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define JPEG_SCAN_X86
+#define JPEG_SCAN_TARGET_SSE2
+#define JPEG_SCAN_TARGET_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+/// \brief SOI pattern, the 4th byte is not used
+static const uint8_t c_soi_pattern[4] = { 0xFF, 0xD8, 0xFF, 0x00 };
+
+/*! \brief Kernel used by jpeg_scan_soi() and jpeg_scan_tag(), JPEG_SCAN_MAX until selected
+ * Atomic, the extractors of a batch scan in several threads at once.
+ */
+static QAtomicInt s_scan_kernel(JPEG_SCAN_MAX);
+
+const char * c_scan_kernel_name[JPEG_SCAN_MAX] = {
+	"scalar",
+	"SSE2",
+	"AVX2"
+};
+
+const char * jpeg_scan_kernel_name(int kernel) {
+	if(kernel < 0 || kernel >= JPEG_SCAN_MAX) { return "unknown"; }
+	return c_scan_kernel_name[kernel];
+}
+
+/******************************************************************************
+ *
+ * SCALAR KERNEL
+ *
+ ******************************************************************************/
+/*! \brief Search pattern of pattern_len bytes (3 or 4) in buffer from offset */
+static qint64 scan_scalar(const uint8_t * buffer, qint64 len, qint64 from,
+						  const uint8_t * pattern, int pattern_len) {
+	qint64 offset = from;
+	while(offset + pattern_len <= len) {
+		const uint8_t * first = (const uint8_t *)memchr(buffer + offset, pattern[0],
+														(size_t)(len - pattern_len + 1 - offset));
+		if(!first) { return -1; }
+
+		offset = first - buffer;
+		if(memcmp(buffer + offset + 1, pattern + 1, pattern_len - 1) == 0) {
+			return offset;
+		}
+		offset++;
+	}
+	return -1;
+}
+
+/******************************************************************************
+ *
+ * X86 SIMD KERNELS
+ *
+ ******************************************************************************/
+#ifdef JPEG_SCAN_X86
+
+/// \brief Index of the lowest set bit of a non zero mask
+static inline int scan_ctz(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/*! \brief SSE2 search: each pattern byte is compared with a shifted load,
+	and the lane where all comparisons match is the candidate */
+JPEG_SCAN_TARGET_SSE2
+static qint64 scan_sse2(const uint8_t * buffer, qint64 len, qint64 from,
+						const uint8_t * pattern, int pattern_len) {
+	qint64 offset = from;
+	const __m128i p0 = _mm_set1_epi8((char)pattern[0]);
+	const __m128i p1 = _mm_set1_epi8((char)pattern[1]);
+	const __m128i p2 = _mm_set1_epi8((char)pattern[2]);
+	const __m128i p3 = _mm_set1_epi8((char)pattern[3]);
+
+	while(offset + 16 + pattern_len - 1 <= len) {
+		const uint8_t * p = buffer + offset;
+		__m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), p0);
+		m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), p1));
+		m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), p2));
+		if(pattern_len > 3) {
+			m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 3)), p3));
+		}
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+		if(mask) {
+			return offset + scan_ctz(mask);
+		}
+		offset += 16;
+	}
+
+	return scan_scalar(buffer, len, offset, pattern, pattern_len);
+}
+
+/*! \brief AVX2 search, same as SSE2 with 32 lanes */
+JPEG_SCAN_TARGET_AVX2
+static qint64 scan_avx2(const uint8_t * buffer, qint64 len, qint64 from,
+						const uint8_t * pattern, int pattern_len) {
+	qint64 offset = from;
+	const __m256i p0 = _mm256_set1_epi8((char)pattern[0]);
+	const __m256i p1 = _mm256_set1_epi8((char)pattern[1]);
+	const __m256i p2 = _mm256_set1_epi8((char)pattern[2]);
+	const __m256i p3 = _mm256_set1_epi8((char)pattern[3]);
+
+	while(offset + 32 + pattern_len - 1 <= len) {
+		const uint8_t * p = buffer + offset;
+		__m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), p0);
+		m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 1)), p1));
+		m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), p2));
+		if(pattern_len > 3) {
+			m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 3)), p3));
+		}
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+		if(mask) {
+			return offset + scan_ctz(mask);
+		}
+		offset += 32;
+	}
+
+	return scan_scalar(buffer, len, offset, pattern, pattern_len);
+}
+
+#ifdef _MSC_VER
+/// \brief AVX2 detection with cpuid, including the OS support of YMM registers
+static bool scan_msvc_has_avx2() {
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if(!osxsave || !avx) { return false; }
+	if((_xgetbv(0) & 6) != 6) { return false; }
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+}
+#endif
+
+#endif // JPEG_SCAN_X86
+
+/******************************************************************************
+ *
+ * DISPATCH
+ *
+ ******************************************************************************/
+bool jpeg_scan_kernel_supported(te_jpeg_scan_kernel kernel) {
+	switch(kernel) {
+	case JPEG_SCAN_SCALAR:
+		return true;
+#ifdef JPEG_SCAN_X86
+#ifdef _MSC_VER
+	case JPEG_SCAN_SSE2:
+		return true;
+	case JPEG_SCAN_AVX2:
+		return scan_msvc_has_avx2();
+#else
+	case JPEG_SCAN_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case JPEG_SCAN_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+#endif
+	default:
+		return false;
+	}
+}
+
+te_jpeg_scan_kernel jpeg_scan_best_kernel() {
+	if(jpeg_scan_kernel_supported(JPEG_SCAN_AVX2)) { return JPEG_SCAN_AVX2; }
+	if(jpeg_scan_kernel_supported(JPEG_SCAN_SSE2)) { return JPEG_SCAN_SSE2; }
+	return JPEG_SCAN_SCALAR;
+}
+
+bool jpeg_scan_set_kernel(te_jpeg_scan_kernel kernel) {
+	if(!jpeg_scan_kernel_supported(kernel)) { return false; }
+	s_scan_kernel.storeRelease(kernel);
+	return true;
+}
+
+te_jpeg_scan_kernel jpeg_scan_get_kernel() {
+	int kernel = s_scan_kernel.loadAcquire();
+	if(kernel == JPEG_SCAN_MAX) {
+		// Keep a kernel set meanwhile by another thread
+		s_scan_kernel.testAndSetOrdered(JPEG_SCAN_MAX, jpeg_scan_best_kernel());
+		kernel = s_scan_kernel.loadAcquire();
+	}
+	return (te_jpeg_scan_kernel)kernel;
+}
+
+/*! \brief Run the pattern search with the kernel */
+static qint64 scan_pattern(te_jpeg_scan_kernel kernel,
+						   const uint8_t * buffer, qint64 len, qint64 from,
+						   const uint8_t * pattern, int pattern_len) {
+	if(!buffer || from < 0) { return -1; }
+
+	switch(kernel) {
+#ifdef JPEG_SCAN_X86
+	case JPEG_SCAN_SSE2:
+		return scan_sse2(buffer, len, from, pattern, pattern_len);
+	case JPEG_SCAN_AVX2:
+		return scan_avx2(buffer, len, from, pattern, pattern_len);
+#endif
+	default:
+		return scan_scalar(buffer, len, from, pattern, pattern_len);
+	}
+}
+
+qint64 jpeg_scan_soi_kernel(te_jpeg_scan_kernel kernel,
+							const uint8_t * buffer, qint64 len, qint64 from) {
+	return scan_pattern(kernel, buffer, len, from, c_soi_pattern, 3);
+}
+
+qint64 jpeg_scan_tag_kernel(te_jpeg_scan_kernel kernel,
+							const uint8_t * buffer, qint64 len, qint64 from,
+							const uint8_t * tag) {
+	return scan_pattern(kernel, buffer, len, from, tag, 4);
+}
+
+qint64 jpeg_scan_soi(const uint8_t * buffer, qint64 len, qint64 from) {
+	return jpeg_scan_soi_kernel(jpeg_scan_get_kernel(), buffer, len, from);
+}
+
+qint64 jpeg_scan_tag(const uint8_t * buffer, qint64 len, qint64 from,
+					 const uint8_t * tag) {
+	return jpeg_scan_tag_kernel(jpeg_scan_get_kernel(), buffer, len, from, tag);
+}
@@ -0,0 +1,75 @@
+/*! \file jpegscan.h
+ * \brief Fast search of JPEG candidates in raw buffers
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Scanning kernels to locate SOI markers (0xFF 0xD8 0xFF) or a known 4 bytes
+ * header tag. SSE2 and AVX2 versions are selected at runtime, with a scalar
+ * fallback for other CPUs.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JPEGSCAN_H
+#define JPEGSCAN_H
+
+#include <QtGlobal>
+#include <stdint.h>
+
+/*! \brief Scanning kernel implementations */
+typedef enum {
+	JPEG_SCAN_SCALAR,
+	JPEG_SCAN_SSE2,
+	JPEG_SCAN_AVX2,
+	JPEG_SCAN_MAX
+} te_jpeg_scan_kernel;
+
+/// \brief Name of the kernel, for logs
+const char * jpeg_scan_kernel_name(int kernel);
+
+/// \brief Return true if the kernel can run on this CPU
+bool jpeg_scan_kernel_supported(te_jpeg_scan_kernel kernel);
+
+/// \brief Return the fastest kernel supported by this CPU
+te_jpeg_scan_kernel jpeg_scan_best_kernel();
+
+/*! \brief Force the kernel used by jpeg_scan_soi() and jpeg_scan_tag()
+ * \return false if the kernel is not supported on this CPU
+ */
+bool jpeg_scan_set_kernel(te_jpeg_scan_kernel kernel);
+
+/// \brief Return the kernel used by jpeg_scan_soi() and jpeg_scan_tag()
+te_jpeg_scan_kernel jpeg_scan_get_kernel();
+
+/*! \brief Find the next SOI candidate (0xFF 0xD8 0xFF) in buffer
+ * \return offset of the candidate from buffer start, or -1 if not found
+ */
+qint64 jpeg_scan_soi(const uint8_t * buffer, qint64 len, qint64 from);
+
+/*! \brief Find the next occurence of the 4 bytes tag in buffer
+ * \return offset of the tag from buffer start, or -1 if not found
+ */
+qint64 jpeg_scan_tag(const uint8_t * buffer, qint64 len, qint64 from,
+					 const uint8_t * tag);
+
+/// \brief SOI search with a given kernel, for benchmarks
+qint64 jpeg_scan_soi_kernel(te_jpeg_scan_kernel kernel,
+							const uint8_t * buffer, qint64 len, qint64 from);
+
+/// \brief Tag search with a given kernel, for benchmarks
+qint64 jpeg_scan_tag_kernel(te_jpeg_scan_kernel kernel,
+							const uint8_t * buffer, qint64 len, qint64 from,
+							const uint8_t * tag);
+
+#endif // JPEGSCAN_H
@@ -14,10 +14,541 @@
 */
 
 #include "recovermainwindow.h"
+#include "recoverbatch.h"
+#include "recoverextractor.h"
+#include "recoverparallel.h"
+#include "recoversurvey.h"
+
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#endif
+
+/// \brief Output of the progress and of the summaries, stderr when stdout carries the frames
+static FILE * s_report = stdout;
+
+/*! \brief Print the progress line of the headless mode
+ * \param pipeline also print the depth of the queues: a full read queue means
+ *        the scan is the slowest stage, a full write queue means the disk is
+ */
+static void printProgress(RecoverExtractor & extractor, qint64 elapsed_ms, bool pipeline) {
+	double seconds = (double)elapsed_ms / 1000.;
+	double mbytes = (double)extractor.getPosition() / (1024. * 1024.);
+	if(extractor.getFileSize() < 0) {
+		// stream, the size is unknown
+		fprintf(s_report, "[stream] %d frames, %.1f MB, %.1f MB/s",
+				extractor.getImageCount(),
+				mbytes,
+				seconds > 0. ? mbytes / seconds : 0.);
+	} else {
+		fprintf(s_report, "[%3d%%] %d frames, %.1f / %.1f MB, %.1f MB/s",
+				extractor.getProgress(),
+				extractor.getImageCount(),
+				mbytes,
+				(double)extractor.getFileSize() / (1024. * 1024.),
+				seconds > 0. ? mbytes / seconds : 0.);
+	}
+	if(pipeline) {
+		fprintf(s_report, ", read queue %d/%d, write queue %d/%d",
+				extractor.getReadQueueDepth(), INPUT_PREFETCH_BLOCKS,
+				extractor.getWriteQueueDepth(), WRITER_QUEUE_LEN);
+	}
+	fprintf(s_report, "\n");
+	fflush(s_report);
+}
+
+/*! \brief Print the summary of the headless mode */
+static void printSummary(const QString & input, const QString & output,
+						 int frames, qint64 written, qint64 size, qint64 elapsed_ms) {
+	double seconds = (double)elapsed_ms / 1000.;
+	double mbytes = (double)size / (1024. * 1024.);
+	fprintf(s_report, "Recovered %d frames (%.1f MB) from '%s' in '%s'\n",
+			frames,
+			(double)written / (1024. * 1024.),
+			qPrintable(input),
+			qPrintable(output));
+	fprintf(s_report, "Scanned %.1f MB in %.2f s: %.1f MB/s, %.1f frames/s\n",
+			mbytes, seconds,
+			seconds > 0. ? mbytes / seconds : 0.,
+			seconds > 0. ? (double)frames / seconds : 0.);
+}
+
+/*! \brief Print the frames which could not be decoded */
+static void printInvalid(te_validation_level level, const QVector<int> & invalid, int digits) {
+	if(level == VALIDATE_STRUCTURE) {
+		return;
+	}
+	fprintf(s_report, "%d frames failed the %s decoding check\n",
+			invalid.size(), validation_level_name(level));
+	for(int i = 0; i < invalid.size(); i++) {
+		fprintf(s_report, "    %s\n", qPrintable(RecoverExtractor::recoveredImageName(invalid[i], digits)));
+	}
+}
+
+/*! \brief Parallel headless mode, with RecoverParallelExtractor
+ * \return process exit code
+ */
+static int mainParallel(const QString & input, const QString & output,
+						int threads, te_input_mode mode, te_validation_level level,
+						int progress_ms, int metrics_ms, int digits, qint64 max_frame,
+						bool insert_dht) {
+	RecoverParallelExtractor extractor;
+	extractor.setFilename(input, output);
+	extractor.setThreadCount(threads);
+	extractor.setInputMode(mode);
+	extractor.setMaxFrameLength(max_frame);
+	extractor.setInsertDhtEnabled(insert_dht);
+	extractor.setValidationLevel(level);
+	extractor.setNameDigits(digits);
+
+	QElapsedTimer timer;
+	timer.start();
+	QObject::connect(&extractor, &RecoverParallelExtractor::progress,
+					 [&timer, progress_ms](qint64 scanned, qint64 total, int frames) {
+		g_metrics.update();
+		if(progress_ms <= 0) {
+			return;
+		}
+		double seconds = (double)timer.elapsed() / 1000.;
+		double mbytes = (double)scanned / (1024. * 1024.);
+		fprintf(stdout, "[%3d%%] scanned %.1f / %.1f MB, %.1f MB/s, %d frames saved\n",
+				total > 0 ? (int)(100 * scanned / total) : 0,
+				mbytes, (double)total / (1024. * 1024.),
+				seconds > 0. ? mbytes / seconds : 0.,
+				frames);
+		fflush(stdout);
+	});
+
+	// Woken up for the dumps of the metrics even without progress
+	if(!extractor.run(progress_ms > 0 ? progress_ms : metrics_ms)) {
+		fprintf(stderr, "Extraction failed: %s\n", qPrintable(extractor.getStatus()));
+		return EXIT_FAILURE;
+	}
+
+	printSummary(input, extractor.getOutputDirectory(),
+				 extractor.getImageCount(), extractor.getWrittenBytes(),
+				 extractor.getFileSize(), timer.elapsed());
+	printInvalid(level, extractor.getInvalidFrames(), extractor.getNameDigits());
+	return EXIT_SUCCESS;
+}
+
+/*! \brief Batch headless mode, with RecoverBatch
+ * \param output directory of the outputs of all the files, empty for the
+ *        subdirectory next to each file
+ * \return process exit code
+ */
+static int mainBatch(const QStringList & inputs, const QString & output,
+					 int threads, int streams, int progress_ms,
+					 std::function<void(RecoverExtractor &)> setup) {
+	RecoverBatch batch;
+	for(int i = 0; i < inputs.size(); i++) {
+		if(!batch.addFile(inputs[i], output)) {
+			MSG_PRINT(LOG_WARNING, "%s, skipped", qPrintable(batch.getStatus()));
+		}
+	}
+	batch.setThreadCount(threads);
+	batch.setStreamCount(streams);
+	batch.setSetup(setup);
+
+	QElapsedTimer timer;
+	timer.start();
+	QObject::connect(&batch, &RecoverBatch::progress, [&batch, &timer]() {
+		g_metrics.update();
+		const QVector<t_batch_file *> & files = batch.files();
+		int done = 0;
+		for(int i = 0; i < files.size(); i++) {
+			const t_batch_file * file = files[i];
+			int state = file->state.load();
+			if(state != BATCH_RUNNING) {
+				done += (state != BATCH_PENDING);
+				continue;
+			}
+			double mbytes = (double)file->position.load() / (1024. * 1024.);
+			fprintf(stdout, "    [%3d%%] %s: %d frames, %.1f / %.1f MB\n",
+					file->size > 0 ? (int)(100 * file->position.load() / file->size) : 0,
+					qPrintable(QFileInfo(file->input).fileName()),
+					file->frames.load(),
+					mbytes, (double)file->size / (1024. * 1024.));
+		}
+		double seconds = (double)timer.elapsed() / 1000.;
+		double mbytes = (double)batch.getScannedBytes() / (1024. * 1024.);
+		fprintf(stdout, "[%d/%d files] %.1f / %.1f MB, %.1f MB/s\n",
+				done, files.size(),
+				mbytes, (double)batch.getTotalSize() / (1024. * 1024.),
+				seconds > 0. ? mbytes / seconds : 0.);
+		fflush(stdout);
+	});
+	QObject::connect(&batch, &RecoverBatch::fileFinished, [](const t_batch_file * file) {
+		if(file->state.load() == BATCH_FAILED) {
+			fprintf(stderr, "Extraction of '%s' failed: %s\n",
+					qPrintable(file->input), qPrintable(file->status));
+			return;
+		}
+		printSummary(file->input, file->output, file->frames.load(), file->written.load(),
+					 file->size, file->elapsed_ms);
+	});
+
+	bool ok = batch.run(progress_ms);
+	double seconds = (double)timer.elapsed() / 1000.;
+	double mbytes = (double)batch.getScannedBytes() / (1024. * 1024.);
+	int frames = 0;
+	for(int i = 0; i < batch.files().size(); i++) {
+		frames += batch.files()[i]->frames.load();
+	}
+	fprintf(stdout, "Batch of %d files: %d frames, %.1f MB in %.2f s, %.1f MB/s\n",
+			batch.files().size(), frames, mbytes, seconds,
+			seconds > 0. ? mbytes / seconds : 0.);
+	if(!ok) {
+		fprintf(stderr, "Batch failed: %s\n", qPrintable(batch.getStatus()));
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*! \brief Headless mode: extract all the frames without GUI nor timer
+ * \return process exit code
+ */
+static int mainHeadless(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("RecoverFromMJPEG");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QCoreApplication::translate("main",
+										"Recover JPEG pictures from broken MJPEG file"));
+	parser.addHelpOption();
+	parser.addPositionalArgument("input", QCoreApplication::translate("main", "Broken MJPEG file, pipe, or - for stdin; several files or directories for a batch"));
+
+	QCommandLineOption outputOption(QStringList() << "o" << "output",
+									QCoreApplication::translate("main", "Output directory, default is a subdirectory next to input file; with -f pipe, named pipe, default is stdout"),
+									"directory");
+	parser.addOption(outputOption);
+	QCommandLineOption progressOption(QStringList() << "p" << "progress",
+									  QCoreApplication::translate("main", "Progress print period in seconds, 0 to disable"),
+									  "seconds", "1");
+	parser.addOption(progressOption);
+	QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+									 QCoreApplication::translate("main", "Scan the file in parallel with N threads, 0 for the number of cores; with several files, number of files extracted at once"),
+									 "N");
+	parser.addOption(threadsOption);
+	QCommandLineOption streamsOption(QStringList() << "streams",
+									 QCoreApplication::translate("main", "With several files, number of files read at once from the same disk"),
+									 "N", QString::number(BATCH_DEFAULT_STREAMS));
+	parser.addOption(streamsOption);
+	QCommandLineOption mmapOption(QStringList() << "m" << "mmap",
+								  QCoreApplication::translate("main", "Map the input file in memory instead of reading it"));
+	parser.addOption(mmapOption);
+	QCommandLineOption carveOption(QStringList() << "carve",
+								   QCoreApplication::translate("main", "Carve a whole disk or disk image: read it without the page cache and group the frames in recordings"));
+	parser.addOption(carveOption);
+	QCommandLineOption clusterOption(QStringList() << "cluster",
+									 QCoreApplication::translate("main", "With --carve, cluster size of the file system of the disk in KB"),
+									 "KB", QString::number(SEQUENCE_DEFAULT_CLUSTER / 1024));
+	parser.addOption(clusterOption);
+	QCommandLineOption noIndexOption(QStringList() << "no-index",
+									 QCoreApplication::translate("main", "Ignore the index of the container and scan the whole file"));
+	parser.addOption(noIndexOption);
+	QCommandLineOption noPipelineOption(QStringList() << "no-pipeline",
+										QCoreApplication::translate("main", "Read, scan and write in the same thread, without reading ahead"));
+	parser.addOption(noPipelineOption);
+	QCommandLineOption maxFrameOption(QStringList() << "max-frame",
+									  QCoreApplication::translate("main", "Length of the longest frame in MB, the read windows grow up to it"),
+									  "MB", QString::number(MAX_JPEG_LEN / (1024 * 1024)));
+	parser.addOption(maxFrameOption);
+	QCommandLineOption checkOption(QStringList() << "c" << "check",
+								   QCoreApplication::translate("main", "Verification of the frames: structure (default), scaled or full decoding"),
+								   "level", validation_level_name(VALIDATE_STRUCTURE));
+	parser.addOption(checkOption);
+	QCommandLineOption insertDhtOption(QStringList() << "insert-dht",
+									   QCoreApplication::translate("main", "Write the frames without Huffman tables with the standard ones, so every decoder reads them"));
+	parser.addOption(insertDhtOption);
+	QCommandLineOption journalOption(QStringList() << "journal",
+									 QCoreApplication::translate("main", "Update the journal of the output directory every N frames, 0 to disable"),
+									 "N", QString::number(JOURNAL_PERIOD));
+	parser.addOption(journalOption);
+	QCommandLineOption formatOption(QStringList() << "f" << "format",
+									QCoreApplication::translate("main", "Save the frames as images (default), copy them in a new avi or mov movie, pack them in a tar or zip archive, write only their index, or stream them in a pipe"),
+									"format", output_format_name(OUTPUT_IMAGES));
+	parser.addOption(formatOption);
+	QCommandLineOption fpsOption(QStringList() << "fps",
+								 QCoreApplication::translate("main", "Frame rate of the movie"),
+								 "fps", QString::number(MUXER_DEFAULT_FPS));
+	parser.addOption(fpsOption);
+	QCommandLineOption csvOption(QStringList() << "csv",
+								 QCoreApplication::translate("main", "With -f index, also write the index in CSV"));
+	parser.addOption(csvOption);
+	QCommandLineOption digitsOption(QStringList() << "digits",
+									QCoreApplication::translate("main", "Number of digits of the frame numbers in the image names, default is sized to the expected number of frames"),
+									"N", "0");
+	parser.addOption(digitsOption);
+	QCommandLineOption fromIndexOption(QStringList() << "from-index",
+									   QCoreApplication::translate("main", "Extract the frames listed in an index written with -f index, without scanning"),
+									   "index");
+	parser.addOption(fromIndexOption);
+	QCommandLineOption framesOption(QStringList() << "frames",
+									QCoreApplication::translate("main", "With --from-index, numbers of the frames to extract: first-last, first- or one number"),
+									"range");
+	parser.addOption(framesOption);
+	QCommandLineOption restartOption(QStringList() << "restart",
+									 QCoreApplication::translate("main", "Ignore the journal and extract again from the beginning"));
+	parser.addOption(restartOption);
+	QCommandLineOption metricsOption(QStringList() << "metrics",
+									 QCoreApplication::translate("main", "Write the counters and timers of the stages in file, periodically and at exit"),
+									 "file");
+	parser.addOption(metricsOption);
+	QCommandLineOption metricsFormatOption(QStringList() << "metrics-format",
+										   QCoreApplication::translate("main", "Format of the metrics: json (default) or prometheus"),
+										   "format", metrics_format_name(METRICS_JSON));
+	parser.addOption(metricsFormatOption);
+	QCommandLineOption metricsPeriodOption(QStringList() << "metrics-period",
+										   QCoreApplication::translate("main", "Period of the metrics dumps in seconds, 0 to write them only at exit"),
+										   "seconds", QString::number(METRICS_DEFAULT_PERIOD));
+	parser.addOption(metricsPeriodOption);
+	QCommandLineOption surveyOption(QStringList() << "survey",
+									QCoreApplication::translate("main", "Only read N regions of the file and print what the extraction should find, how long and how large it should be"),
+									"N");
+	parser.addOption(surveyOption);
+	QCommandLineOption verboseOption(QStringList() << "v" << "verbose",
+									 QCoreApplication::translate("main", "Print debug messages"));
+	parser.addOption(verboseOption);
+	QCommandLineOption quietOption(QStringList() << "q" << "quiet",
+								   QCoreApplication::translate("main", "Print only errors"));
+	parser.addOption(quietOption);
+
+	parser.process(app);
+
+	QStringList inputs = RecoverBatch::listInputs(parser.positionalArguments());
+	if(inputs.isEmpty()) {
+		fprintf(stderr, "%s", qPrintable(parser.helpText()));
+		return EXIT_FAILURE;
+	}
+	if(parser.isSet(verboseOption)) {
+		g_log_level = LOG_DEBUG;
+	} else if(parser.isSet(quietOption)) {
+		g_log_level = LOG_ERROR;
+	}
+	qint64 progress_ms = (qint64)(parser.value(progressOption).toDouble() * 1000.);
+	te_input_mode mode = parser.isSet(mmapOption) ? INPUT_MMAP : INPUT_READ;
+	if(parser.isSet(carveOption)) {
+		mode = INPUT_DIRECT;
+	}
+	int level = 0;
+	while(level < VALIDATE_MAX && parser.value(checkOption) != validation_level_name(level)) {
+		level++;
+	}
+	if(level >= VALIDATE_MAX) {
+		fprintf(stderr, "Invalid check level '%s'\n", qPrintable(parser.value(checkOption)));
+		return EXIT_FAILURE;
+	}
+	int format = 0;
+	while(format < OUTPUT_MAX && parser.value(formatOption) != output_format_name(format)) {
+		format++;
+	}
+	if(format >= OUTPUT_MAX) {
+		fprintf(stderr, "Invalid output format '%s'\n", qPrintable(parser.value(formatOption)));
+		return EXIT_FAILURE;
+	}
+	if(format == OUTPUT_PIPE
+			&& (!parser.isSet(outputOption) || parser.value(outputOption) == OUTPUT_STDOUT)) {
+		// Nothing else on stdout, it carries the frames
+		s_report = stderr;
+		g_log_stderr = true;
+	}
+	int metrics_format = 0;
+	while(metrics_format < METRICS_FORMAT_MAX
+		  && parser.value(metricsFormatOption) != metrics_format_name(metrics_format)) {
+		metrics_format++;
+	}
+	if(metrics_format >= METRICS_FORMAT_MAX) {
+		fprintf(stderr, "Invalid metrics format '%s'\n", qPrintable(parser.value(metricsFormatOption)));
+		return EXIT_FAILURE;
+	}
+	qint64 max_frame = (qint64)(parser.value(maxFrameOption).toDouble() * 1024. * 1024.);
+	if(max_frame <= 0) {
+		fprintf(stderr, "Invalid max frame length '%s'\n", qPrintable(parser.value(maxFrameOption)));
+		return EXIT_FAILURE;
+	}
+	qint64 metrics_ms = 0;
+	if(parser.isSet(metricsOption)) {
+		metrics_ms = (qint64)(parser.value(metricsPeriodOption).toDouble() * 1000.);
+		// Written again by main() at exit, whatever the result
+		g_metrics.setOutput(parser.value(metricsOption), (te_metrics_format)metrics_format, metrics_ms);
+	}
+
+	if(parser.isSet(surveyOption)) {
+		for(int i = 0; i < inputs.size(); i++) {
+			RecoverSurvey survey;
+			survey.setSampleCount(parser.value(surveyOption).toInt());
+			if(!survey.run(inputs[i])) {
+				fprintf(stderr, "Survey failed: %s\n", qPrintable(survey.getStatus()));
+				return EXIT_FAILURE;
+			}
+			if(inputs.size() > 1) {
+				fprintf(stdout, "%s:\n", qPrintable(inputs[i]));
+			}
+			fprintf(stdout, "%s", qPrintable(survey.report()));
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Same settings for the sequential extraction and for every file of a batch
+	bool index = !parser.isSet(noIndexOption) && !parser.isSet(carveOption);
+	bool carve = parser.isSet(carveOption);
+	qint64 cluster = parser.value(clusterOption).toLongLong() * 1024;
+	bool insert_dht = parser.isSet(insertDhtOption);
+	int journal = parser.value(journalOption).toInt();
+	bool resume = !parser.isSet(restartOption);
+	int fps = parser.value(fpsOption).toInt();
+	bool csv = parser.isSet(csvOption);
+	int digits = parser.value(digitsOption).toInt();
+	bool pipeline = !parser.isSet(noPipelineOption);
+	auto setup = [=](RecoverExtractor & extractor) {
+		extractor.setInputMode(mode);
+		extractor.setMaxFrameLength(max_frame);
+		extractor.setInsertDhtEnabled(insert_dht);
+		// The index of a file at the start of the disk doesn't list the others
+		extractor.setIndexEnabled(index);
+		extractor.setSequencesEnabled(carve);
+		extractor.setClusterSize(cluster);
+		extractor.setValidationLevel((te_validation_level)level);
+		extractor.setJournalPeriod(journal);
+		extractor.setResumeEnabled(resume);
+		extractor.setOutputFormat((te_output_format)format);
+		extractor.setFrameRate(fps);
+		extractor.setCsvEnabled(csv);
+		extractor.setNameDigits(digits);
+		extractor.setPipelineEnabled(pipeline);
+	};
+
+	if(inputs.size() > 1 || QFileInfo(parser.positionalArguments()[0]).isDir()) {
+		if(parser.isSet(fromIndexOption)) {
+			fprintf(stderr, "--from-index extracts only one file\n");
+			return EXIT_FAILURE;
+		}
+		if(format == OUTPUT_PIPE) {
+			fprintf(stderr, "The %s output takes only one file\n", output_format_name(format));
+			return EXIT_FAILURE;
+		}
+		return mainBatch(inputs, parser.value(outputOption),
+						 parser.value(threadsOption).toInt(),
+						 parser.value(streamsOption).toInt(),
+						 (int)progress_ms, setup);
+	}
+
+	if(parser.isSet(threadsOption) && input_is_stream(inputs[0])) {
+		MSG_PRINT(LOG_WARNING, "'%s' can't be read in parallel, revert to sequential",
+				  qPrintable(inputs[0]));
+	} else if(parser.isSet(threadsOption) && parser.isSet(carveOption)) {
+		MSG_PRINT(LOG_WARNING, "The recordings are found in the order of the disk, revert to sequential");
+	} else if(parser.isSet(threadsOption) && (format != OUTPUT_IMAGES || parser.isSet(fromIndexOption))) {
+		MSG_PRINT(LOG_WARNING, "The %s output is written in one pass, revert to sequential",
+				  output_format_name(format));
+	} else if(parser.isSet(threadsOption) && index && RecoverExtractor::hasContainerIndex(inputs[0])) {
+		MSG_PRINT(LOG_WARNING, "The frames are listed in the index of '%s', revert to sequential",
+				  qPrintable(inputs[0]));
+	} else if(parser.isSet(threadsOption)) {
+		return mainParallel(inputs[0],
+							parser.isSet(outputOption) ? parser.value(outputOption)
+													   : RecoverExtractor::defaultOutputDirectory(inputs[0]),
+							parser.value(threadsOption).toInt(),
+							mode, (te_validation_level)level, (int)progress_ms, (int)metrics_ms,
+							parser.value(digitsOption).toInt(), max_frame,
+							parser.isSet(insertDhtOption));
+	}
+
+	RecoverExtractor extractor;
+	extractor.setPreviewEnabled(false);
+	setup(extractor);
+	extractor.setFilename(inputs[0]);
+	if(format == OUTPUT_PIPE) {
+		// -o is the named pipe, or stdout by default
+		QString pipe = parser.isSet(outputOption) ? parser.value(outputOption) : OUTPUT_STDOUT;
+		extractor.setPipePath(pipe);
+#ifdef Q_OS_UNIX
+		// A consumer which quits makes the write fail instead of killing the process
+		signal(SIGPIPE, SIG_IGN);
+#endif
+	} else if(parser.isSet(outputOption)
+			  && !extractor.setOutputDirectory(parser.value(outputOption))) {
+		return EXIT_FAILURE;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	qint64 last_progress = 0;
+
+	QString output = extractor.getOutputDirectory();
+	if(format == OUTPUT_PIPE) {
+		output = parser.isSet(outputOption) ? parser.value(outputOption) : QString("stdout");
+	} else if(format != OUTPUT_IMAGES && format != OUTPUT_INDEX) {
+		output = QDir(output).absoluteFilePath(
+					RecoverExtractor::recoveredMovieName((te_output_format)format));
+	} else if(format == OUTPUT_INDEX) {
+		output = QDir(output).absoluteFilePath(RecoverExtractor::recoveredIndexName(false));
+	}
+
+	if(parser.isSet(fromIndexOption)) {
+		// first-last, first- until the end, or a single frame
+		QStringList range = parser.value(framesOption).split("-");
+		int first = range[0].isEmpty() ? 1 : range[0].toInt();
+		int last = (range.size() > 1 ? range[1].toInt() : first);
+		if(!parser.isSet(framesOption)) {
+			first = 1;
+			last = 0;
+		}
+		int frames = extractor.extractRange(parser.value(fromIndexOption), first, last);
+		if(frames < 0) {
+			fprintf(stderr, "Extraction failed: %s\n", qPrintable(extractor.getStatus()));
+			return EXIT_FAILURE;
+		}
+		// Only the part of the input between the frames is read
+		printSummary(inputs[0], output, frames, extractor.getWrittenBytes(),
+					 extractor.getIndexedSpan(), timer.elapsed());
+		return EXIT_SUCCESS;
+	}
+
+	while(!extractor.atEnd()) {
+		if(!extractor.extract()) {
+			fprintf(stderr, "Extraction failed: %s\n", qPrintable(extractor.getStatus()));
+			return EXIT_FAILURE;
+		}
+		g_metrics.update();
+		qint64 elapsed = timer.elapsed();
+		if(progress_ms > 0 && elapsed - last_progress >= progress_ms) {
+			last_progress = elapsed;
+			printProgress(extractor, elapsed, !parser.isSet(noPipelineOption));
+		}
+	}
+
+	printSummary(inputs[0], output,
+				 extractor.getImageCount(), extractor.getWrittenBytes(),
+				 extractor.getFileSize(), timer.elapsed());
+	printInvalid((te_validation_level)level, extractor.getInvalidFrames(), extractor.getNameDigits());
+	if(parser.isSet(carveOption)) {
+		fprintf(s_report, "%d recordings listed in '%s'\n", extractor.getSequences().size(),
+				qPrintable(QDir(extractor.getOutputDirectory())
+						   .absoluteFilePath(RecoverExtractor::recoveredSequencesName())));
+	}
+
+	return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[])
 {
+	// Any argument means a headless recovery, from command line
+	if(argc > 1) {
+		int ret = mainHeadless(argc, argv);
+		// Last values of the metrics, also after a failure
+		if(!g_metrics.write() && ret == EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+		}
+		return ret;
+	}
+
 	QApplication a(argc, argv);
 	RecoverMainWindow w;
 	w.show();
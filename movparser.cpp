@@ -0,0 +1,332 @@
+/*! \file movparser.cpp
+ * \brief QuickTime/MOV atom parser
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "movparser.h"
+#include "recoverextractor.h"
+
+#include <QByteArray>
+
+/*! \brief Header of an atom */
+typedef struct {
+	uint32_t type;		///< Type, 4 characters
+	qint64 pos;			///< Position of the header in file
+	qint64 header;		///< Length of the header, 8 or 16 with 64bit size
+	qint64 size;		///< Size with header, reduced to the parent end if truncated
+	bool truncated;		///< Size was larger than the parent
+} t_mov_atom;
+
+/*! \brief Entry of the sample-to-chunk table */
+typedef struct {
+	qint64 first_chunk;			///< First chunk using this entry, from 1
+	qint64 samples_per_chunk;	///< Number of samples in each chunk
+} t_mov_stsc;
+
+/*! \brief Tables read in a track */
+typedef struct {
+	bool video;					///< hdlr is 'vide'
+	uint32_t format;			///< Format of the first sample description, 0 if not found
+	QVector<qint64> chunks;		///< Chunk offsets from stco or co64
+	qint64 sample_size;			///< Constant sample size, 0 if sizes are in table
+	qint64 sample_count;		///< Number of samples from stsz
+	QVector<qint64> sizes;		///< Sample sizes from stsz
+	QVector<t_mov_stsc> stsc;	///< Sample-to-chunk table
+} t_mov_track;
+
+static uint32_t mov_be32(const uint8_t * p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+			| ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t mov_be64(const uint8_t * p) {
+	return ((uint64_t)mov_be32(p) << 32) | (uint64_t)mov_be32(p + 4);
+}
+
+/// \brief Atom types are printable characters, else it's garbage
+static bool mov_is_type(uint32_t type) {
+	for(int i = 0; i < 4; i++) {
+		uint8_t c = (uint8_t)(type >> (8 * i));
+		if(c < 0x20 || c > 0x7E) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// \brief Formats of MJPEG sample descriptions, where each sample starts with SOI
+static bool mov_is_jpeg_format(uint32_t format) {
+	switch(format) {
+	case MOV_FOURCC('j','p','e','g'):
+	case MOV_FOURCC('m','j','p','a'):
+	case MOV_FOURCC('A','V','D','J'):
+	case MOV_FOURCC('d','m','b','1'):
+	case MOV_FOURCC('M','J','P','G'):
+	case MOV_FOURCC('m','j','p','g'):
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*! \brief Read the header of the atom at pos
+ * \param end end of the parent atom
+ * \return false if the header can't be read
+ */
+static bool mov_read_atom(QFile & file, qint64 pos, qint64 end, t_mov_atom * atom) {
+	uint8_t header[16];
+	if(end - pos < 8 || !file.seek(pos) || file.read((char *)header, 8) != 8) {
+		return false;
+	}
+	atom->pos = pos;
+	atom->type = mov_be32(header + 4);
+	atom->header = 8;
+
+	qint64 size = mov_be32(header);
+	if(size == 1) {
+		// 64bit size after the type
+		if(end - pos < 16 || file.read((char *)header + 8, 8) != 8) {
+			return false;
+		}
+		size = (qint64)mov_be64(header + 8);
+		atom->header = 16;
+	} else if(size == 0) {
+		// until the end of the parent, usually mdat at end of file
+		size = end - pos;
+	}
+	if(size < atom->header) {
+		return false;
+	}
+	atom->truncated = (size > end - pos);
+	atom->size = atom->truncated ? end - pos : size;
+	return true;
+}
+
+/// \brief Read the payload of a table atom, what remains if it is truncated
+static QByteArray mov_read_payload(QFile & file, const t_mov_atom & atom) {
+	qint64 len = qMin(atom.size - atom.header, (qint64)MOV_MAX_TABLE_LEN);
+	if(len <= 0 || !file.seek(atom.pos + atom.header)) {
+		return QByteArray();
+	}
+	return file.read(len);
+}
+
+/*! \brief Number of entries of a table which are really in the payload
+ * \param len length of payload
+ * \param start offset of the first entry
+ * \param count number of entries in table header
+ * \param entry size of each entry
+ */
+static qint64 mov_table_count(qint64 len, qint64 start, qint64 count, qint64 entry) {
+	if(len < start) {
+		return 0;
+	}
+	qint64 available = (len - start) / entry;
+	if(available < count) {
+		MSG_PRINT(LOG_WARNING, "Truncated table: %lld entries of %lld", available, count);
+		return available;
+	}
+	return count;
+}
+
+/// \brief Read the leaf atoms of a track, then the containers recursively
+static void mov_parse_track(QFile & file, qint64 pos, qint64 end, qint64 fileSize,
+							t_mov_track * track, int depth) {
+	if(depth > 8) {
+		return;
+	}
+
+	t_mov_atom atom;
+	while(mov_read_atom(file, pos, end, &atom) && mov_is_type(atom.type)) {
+		switch(atom.type) {
+		case MOV_FOURCC('m','d','i','a'):
+		case MOV_FOURCC('m','i','n','f'):
+		case MOV_FOURCC('s','t','b','l'):
+			mov_parse_track(file, atom.pos + atom.header, atom.pos + atom.size,
+							fileSize, track, depth + 1);
+			break;
+
+		case MOV_FOURCC('h','d','l','r'): {
+			QByteArray payload = mov_read_payload(file, atom);
+			const uint8_t * p = (const uint8_t *)payload.constData();
+			// version/flags, component type, then subtype. The data handler of
+			// minf has another subtype, so only the media handler is kept
+			if(payload.size() >= 12
+					&& mov_be32(p + 8) == MOV_FOURCC('v','i','d','e')) {
+				track->video = true;
+			}
+			} break;
+
+		case MOV_FOURCC('s','t','s','d'): {
+			QByteArray payload = mov_read_payload(file, atom);
+			const uint8_t * p = (const uint8_t *)payload.constData();
+			// version/flags, count, then size and format of the 1st description
+			if(payload.size() >= 16 && mov_be32(p + 4) > 0) {
+				track->format = mov_be32(p + 12);
+			}
+			} break;
+
+		case MOV_FOURCC('s','t','c','o'):
+		case MOV_FOURCC('c','o','6','4'): {
+			QByteArray payload = mov_read_payload(file, atom);
+			const uint8_t * p = (const uint8_t *)payload.constData();
+			qint64 entry = (atom.type == MOV_FOURCC('c','o','6','4') ? 8 : 4);
+			qint64 count = (payload.size() >= 8 ? mov_be32(p + 4) : 0);
+			count = mov_table_count(payload.size(), 8, count, entry);
+			track->chunks.clear();
+			for(qint64 i = 0; i < count; i++) {
+				qint64 offset = (entry == 8 ? (qint64)mov_be64(p + 8 + 8 * i)
+											: (qint64)mov_be32(p + 8 + 4 * i));
+				if(offset < 0 || offset >= fileSize) {
+					MSG_PRINT(LOG_WARNING, "Chunk %lld at %lld is out of file, table is cut there",
+							  i, offset);
+					break;
+				}
+				track->chunks.append(offset);
+			}
+			} break;
+
+		case MOV_FOURCC('s','t','s','z'): {
+			QByteArray payload = mov_read_payload(file, atom);
+			const uint8_t * p = (const uint8_t *)payload.constData();
+			if(payload.size() < 12) {
+				break;
+			}
+			track->sample_size = mov_be32(p + 4);
+			track->sample_count = mov_be32(p + 8);
+			track->sizes.clear();
+			if(track->sample_size == 0) {
+				qint64 count = mov_table_count(payload.size(), 12, track->sample_count, 4);
+				for(qint64 i = 0; i < count; i++) {
+					track->sizes.append(mov_be32(p + 12 + 4 * i));
+				}
+				track->sample_count = count;
+			}
+			} break;
+
+		case MOV_FOURCC('s','t','s','c'): {
+			QByteArray payload = mov_read_payload(file, atom);
+			const uint8_t * p = (const uint8_t *)payload.constData();
+			qint64 count = (payload.size() >= 8 ? mov_be32(p + 4) : 0);
+			count = mov_table_count(payload.size(), 8, count, 12);
+			track->stsc.clear();
+			for(qint64 i = 0; i < count; i++) {
+				t_mov_stsc entry;
+				entry.first_chunk = mov_be32(p + 8 + 12 * i);
+				entry.samples_per_chunk = mov_be32(p + 8 + 12 * i + 4);
+				// first chunks must increase, the rest of the table is damaged
+				if(entry.first_chunk < 1
+						|| (!track->stsc.isEmpty() && entry.first_chunk <= track->stsc.last().first_chunk)) {
+					break;
+				}
+				track->stsc.append(entry);
+			}
+			} break;
+
+		default:
+			break;
+		}
+
+		if(atom.truncated) {
+			break;
+		}
+		pos += atom.size;
+	}
+}
+
+/// \brief Compute the position and size of the samples from the tables
+static void mov_track_samples(const t_mov_track & track, qint64 fileSize,
+							  QVector<t_jpeg_extent> * samples) {
+	qint64 sample = 0;
+	int stsc = 0;
+	for(int chunk = 0; chunk < track.chunks.size() && sample < track.sample_count; chunk++) {
+		// stsc first chunks are numbered from 1
+		while(stsc + 1 < track.stsc.size() && track.stsc[stsc + 1].first_chunk <= chunk + 1) {
+			stsc++;
+		}
+		qint64 per_chunk = (track.stsc.isEmpty() ? 1 : track.stsc[stsc].samples_per_chunk);
+
+		qint64 pos = track.chunks[chunk];
+		for(qint64 s = 0; s < per_chunk && sample < track.sample_count; s++, sample++) {
+			qint64 len = (track.sample_size > 0 ? track.sample_size : track.sizes[sample]);
+			// frames after the end of a truncated file are lost
+			if(len > 0 && pos + len <= fileSize) {
+				t_jpeg_extent item;
+				item.pos = pos;
+				item.length = len;
+				samples->append(item);
+			}
+			pos += len;
+		}
+	}
+}
+
+int mov_parse_samples(QFile & file, QVector<t_jpeg_extent> * samples) {
+	samples->clear();
+	if(!file.isOpen()) {
+		return -1;
+	}
+	qint64 fileSize = file.size();
+
+	int tracks = 0;
+	qint64 pos = 0;
+	t_mov_atom atom;
+	while(mov_read_atom(file, pos, fileSize, &atom) && mov_is_type(atom.type)) {
+		if(atom.type == MOV_FOURCC('m','o','o','v')) {
+			if(atom.truncated) {
+				MSG_PRINT(LOG_WARNING, "moov at %lld is truncated, read what remains", atom.pos);
+			}
+			qint64 child = atom.pos + atom.header;
+			qint64 end = atom.pos + atom.size;
+			t_mov_atom trak;
+			while(mov_read_atom(file, child, end, &trak) && mov_is_type(trak.type)) {
+				if(trak.type == MOV_FOURCC('t','r','a','k')) {
+					t_mov_track track;
+					track.video = false;
+					track.format = 0;
+					track.sample_size = 0;
+					track.sample_count = 0;
+					mov_parse_track(file, trak.pos + trak.header, trak.pos + trak.size,
+									fileSize, &track, 0);
+
+					// stsd may be lost, then the frames will be checked anyway
+					if(track.video && (track.format == 0 || mov_is_jpeg_format(track.format))) {
+						int before = samples->size();
+						mov_track_samples(track, fileSize, samples);
+						MSG_PRINT(LOG_INFO, "MOV video track: %lld chunks, %lld samples, %d in file",
+								  (qint64)track.chunks.size(), track.sample_count,
+								  samples->size() - before);
+						tracks++;
+					} else if(track.video) {
+						MSG_PRINT(LOG_INFO, "MOV video track is not MJPEG: '%c%c%c%c'",
+								  (char)(track.format >> 24), (char)(track.format >> 16),
+								  (char)(track.format >> 8), (char)track.format);
+					}
+				}
+				if(trak.truncated) {
+					break;
+				}
+				child += trak.size;
+			}
+		}
+		if(atom.truncated) {
+			break;
+		}
+		pos += atom.size;
+	}
+
+	return tracks;
+}
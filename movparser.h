@@ -0,0 +1,52 @@
+/*! \file movparser.h
+ * \brief QuickTime/MOV atom parser
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Read the sample tables (stco/co64, stsz, stsc) of the MJPEG video tracks
+ * which survived in the moov atom, so the frames can be extracted without
+ * scanning the whole file.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOVPARSER_H
+#define MOVPARSER_H
+
+#include <QFile>
+#include <QVector>
+#include <stdint.h>
+
+#include "jpegparser.h"
+
+/// \brief Build a 32bit atom type from its 4 characters
+#define MOV_FOURCC(_a, _b, _c, _d)	(((uint32_t)(_a) << 24) | ((uint32_t)(_b) << 16) \
+									| ((uint32_t)(_c) << 8) | (uint32_t)(_d))
+
+/// Max size of a sample table read in memory, larger ones are damaged
+#define MOV_MAX_TABLE_LEN	(256*1024*1024)
+
+/*! \brief Read the samples of the MJPEG video tracks of a MOV/MP4 file
+
+	Walk the top level atoms until moov, then read the tables of each video
+	track. Truncated or damaged tables are used until the first invalid
+	entry, so the frames indexed by the surviving part are still known.
+ * \param file open file
+ * \param samples returned samples inside the file, in the order of the tables
+ * \return number of MJPEG video tracks read, 0 if not a MOV file or
+ * 		without moov, -1 if the file is not open
+ */
+int mov_parse_samples(QFile & file, QVector<t_jpeg_extent> * samples);
+
+#endif // MOVPARSER_H
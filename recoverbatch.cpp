@@ -0,0 +1,269 @@
+/*! \file recoverbatch.cpp
+ * \brief Extraction of many files at once
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverbatch.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QRunnable>
+#include <QThread>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+const char * c_batch_state_names[BATCH_STATE_MAX] = {
+	"pending",
+	"running",
+	"done",
+	"failed"
+};
+
+const char * batch_state_name(int state) {
+	if(state < 0 || state >= BATCH_STATE_MAX) {
+		return "invalid";
+	}
+	return c_batch_state_names[state];
+}
+
+/*! \brief Job extracting one file */
+class RecoverBatchJob : public QRunnable {
+public:
+	RecoverBatchJob(RecoverBatch * batch, t_batch_file * file)
+		: mBatch(batch), mFile(file) {}
+	void run() { mBatch->extractFile(mFile); }
+private:
+	RecoverBatch * mBatch;
+	t_batch_file * mFile;
+};
+
+RecoverBatch::RecoverBatch()
+	: QObject() {
+	mThreadCount = 0;
+	mStreamCount = BATCH_DEFAULT_STREAMS;
+}
+
+RecoverBatch::~RecoverBatch() {
+	mPool.waitForDone();
+	for(int i = 0; i < mFiles.size(); i++) {
+		CPP_DELETE(mFiles[i]);
+	}
+}
+
+QStringList RecoverBatch::listInputs(const QStringList & inputs) {
+	QStringList files;
+	for(int i = 0; i < inputs.size(); i++) {
+		QFileInfo fi(inputs[i]);
+		if(!fi.isDir()) {
+			files.append(inputs[i]);
+			continue;
+		}
+		QDir dir(inputs[i]);
+		QStringList names = dir.entryList(QDir::Files, QDir::Name);
+		for(int n = 0; n < names.size(); n++) {
+			files.append(dir.filePath(names[n]));
+		}
+	}
+	return files;
+}
+
+bool RecoverBatch::addFile(const QString & input, const QString & outputDir) {
+	QFile file(input);
+	// Whole disks are read too, their file size is 0
+	qint64 size = file.open(QFile::ReadOnly) ? input_file_size(file) : -1;
+	file.close();
+	if(size < 0 || input_is_stream(input)) {
+		mStatus = tr("Cannot read file ") + input;
+		return false;
+	}
+
+	QString output = RecoverExtractor::defaultOutputDirectory(input);
+	if(!outputDir.isEmpty()) {
+		output = QDir(outputDir).absoluteFilePath(QFileInfo(output).fileName());
+	}
+	// clip.avi and clip.mov would share the same directory
+	for(int i = 0; i < mFiles.size(); i++) {
+		if(mFiles[i]->output == output) {
+			output += "_" + QFileInfo(input).suffix();
+			break;
+		}
+	}
+
+	t_batch_file * item;
+	CPP_ALLOC(item, t_batch_file());
+	item->input = input;
+	item->output = output;
+	item->size = size;
+	item->device = 0;
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if(stat(QFile::encodeName(input).constData(), &st) == 0) {
+		// A whole disk is its own device
+		item->device = (S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev);
+	}
+#endif
+	item->state.store(BATCH_PENDING);
+	item->elapsed_ms = 0;
+	mFiles.append(item);
+	return true;
+}
+
+qint64 RecoverBatch::getScannedBytes() {
+	qint64 scanned = 0;
+	for(int i = 0; i < mFiles.size(); i++) {
+		scanned += mFiles[i]->position.load();
+	}
+	return scanned;
+}
+
+qint64 RecoverBatch::getTotalSize() {
+	qint64 total = 0;
+	for(int i = 0; i < mFiles.size(); i++) {
+		total += mFiles[i]->size;
+	}
+	return total;
+}
+
+/*******************************************************************************
+
+							JOBS
+
+ ******************************************************************************/
+
+void RecoverBatch::extractFile(t_batch_file * file) {
+	QElapsedTimer timer;
+	timer.start();
+	bool ok = true;
+	{
+		// Allocated by the job, so only the running files hold buffers
+		RecoverExtractor extractor;
+		extractor.setPreviewEnabled(false);
+		if(mSetup) {
+			mSetup(extractor);
+		}
+		// The cores are shared by the files extracted at once
+		extractor.setDecodeThreadCount(qMax(1, QThread::idealThreadCount() / mPool.maxThreadCount()));
+		extractor.setFilename(file->input);
+		ok = extractor.setOutputDirectory(file->output);
+		while(ok && !extractor.atEnd()) {
+			ok = extractor.extract();
+			file->position.store(extractor.getPosition());
+			file->frames.store(extractor.getImageCount());
+			file->written.store(extractor.getWrittenBytes());
+		}
+		// Whole file, even when the index skipped a part of it
+		if(ok) {
+			file->position.store(file->size);
+		}
+		file->status = extractor.getStatus();
+	}
+	file->elapsed_ms = timer.elapsed();
+	file->state.store(ok ? BATCH_DONE : BATCH_FAILED);
+	mFinished.release();
+}
+
+/*******************************************************************************
+
+							SCHEDULING
+
+ ******************************************************************************/
+
+void RecoverBatch::startFiles() {
+	int running = 0;
+	QMap<quint64, int> streams;
+	for(int i = 0; i < mFiles.size(); i++) {
+		if(mFiles[i]->state.load() == BATCH_RUNNING) {
+			running++;
+			streams[mFiles[i]->device]++;
+		}
+	}
+
+	// Smallest first, a file blocked by its disk lets the next ones start
+	for(int i = 0; i < mFiles.size() && running < mPool.maxThreadCount(); i++) {
+		t_batch_file * file = mFiles[i];
+		if(file->state.load() != BATCH_PENDING
+				|| streams.value(file->device, 0) >= mStreamCount) {
+			continue;
+		}
+		MSG_PRINT(LOG_INFO, "Starting '%s', %lld bytes, in '%s'",
+				  qPrintable(file->input), file->size, qPrintable(file->output));
+		file->state.store(BATCH_RUNNING);
+		running++;
+		streams[file->device]++;
+		mPool.start(new RecoverBatchJob(this, file));
+	}
+}
+
+bool RecoverBatch::run(int progress_ms) {
+	if(mFiles.isEmpty()) {
+		mStatus = tr("No file to extract");
+		return false;
+	}
+	std::stable_sort(mFiles.begin(), mFiles.end(),
+					 [](const t_batch_file * a, const t_batch_file * b) {
+		return a->size < b->size;
+	});
+	mPool.setMaxThreadCount(mThreadCount > 0 ? mThreadCount : QThread::idealThreadCount());
+	MSG_PRINT(LOG_INFO, "Extracting %d files, %d at once, %d per disk",
+			  mFiles.size(), mPool.maxThreadCount(), mStreamCount);
+
+	int failed = 0;
+	int finished = 0;
+	QVector<bool> reported(mFiles.size(), false);
+	QElapsedTimer timer;
+	timer.start();
+	startFiles();
+	while(finished < mFiles.size()) {
+		// Woken up by the end of a job, or for the progress
+		int wait_ms = (progress_ms > 0 ? qMax(0, progress_ms - (int)timer.elapsed()) : -1);
+		bool ended = mFinished.tryAcquire(1, wait_ms);
+		if(progress_ms > 0 && timer.elapsed() >= progress_ms) {
+			timer.restart();
+			emit progress();
+		}
+		if(!ended) {
+			continue;
+		}
+		for(int i = 0; i < mFiles.size(); i++) {
+			int state = mFiles[i]->state.load();
+			if(reported[i] || (state != BATCH_DONE && state != BATCH_FAILED)) {
+				continue;
+			}
+			reported[i] = true;
+			finished++;
+			if(state == BATCH_FAILED) {
+				failed++;
+			}
+			emit fileFinished(mFiles[i]);
+		}
+		startFiles();
+	}
+	mPool.waitForDone();
+
+	if(failed > 0) {
+		mStatus = tr("%1 files failed").arg(failed);
+		return false;
+	}
+	mStatus = tr("All files extracted");
+	return true;
+}
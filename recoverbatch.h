@@ -0,0 +1,144 @@
+/*! \file recoverbatch.h
+ * \brief Extraction of many files at once
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * A batch extracts every file with its own RecoverExtractor, several at
+ * once on a pool of threads. The smallest files start first, so a short
+ * clip doesn't wait behind a huge one. The number of files extracted at
+ * once is limited by the threads, and the number of files read at once
+ * from the same disk by the streams: more streams on a hard disk only
+ * make its head seek between the files.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERBATCH_H
+#define RECOVERBATCH_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QAtomicInteger>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include <functional>
+
+#include "recoverextractor.h"
+
+/// Default number of files read at once from the same disk
+#define BATCH_DEFAULT_STREAMS	2
+
+/*! \brief State of a file of the batch */
+typedef enum {
+	BATCH_PENDING,	///< waiting for a thread and a stream
+	BATCH_RUNNING,	///< being extracted
+	BATCH_DONE,		///< extracted until the end
+	BATCH_FAILED,	///< read or write error, see status
+	BATCH_STATE_MAX
+} te_batch_state;
+
+/// \brief Name of the state, for the reports
+const char * batch_state_name(int state);
+
+/*! \brief File of the batch, shared between its job and the scheduler */
+typedef struct {
+	QString input;		///< Input file
+	QString output;		///< Output directory
+	qint64 size;		///< Size of the input
+	quint64 device;		///< Disk of the input, for the streams limit
+	QAtomicInteger<int> state;		///< te_batch_state
+	QAtomicInteger<qint64> position;	///< Bytes scanned
+	QAtomicInteger<int> frames;		///< Frames recovered
+	QAtomicInteger<qint64> written;	///< Bytes written
+	QString status;		///< Status of the extractor, set when finished
+	qint64 elapsed_ms;	///< Time of the extraction, set when finished
+} t_batch_file;
+
+/*! \brief Extract many files at once, under a threads and a streams limit */
+class RecoverBatch : public QObject {
+	Q_OBJECT
+public:
+	RecoverBatch();
+	~RecoverBatch();
+
+	/*! \brief List the files of the inputs
+	 * A directory is replaced by its files, sorted by name, without the
+	 * subdirectories.
+	 */
+	static QStringList listInputs(const QStringList & inputs);
+
+	/*! \brief Add a file
+	 * \param outputDir directory of the outputs of all the files, empty for
+	 *        the subdirectory next to each file
+	 * \return false if the file can't be read, with getStatus()
+	 */
+	bool addFile(const QString & input, const QString & outputDir);
+
+	/// \brief Set the number of files extracted at once, 0 for the number of cores
+	void setThreadCount(int threads) { mThreadCount = threads; }
+
+	/// \brief Set the number of files read at once from the same disk, BATCH_DEFAULT_STREAMS by default
+	void setStreamCount(int streams) { mStreamCount = qMax(streams, 1); }
+
+	/*! \brief Set the settings of the extractors
+	 * Called in the thread of the job, before RecoverExtractor::setFilename()
+	 */
+	void setSetup(std::function<void(RecoverExtractor &)> setup) { mSetup = setup; }
+
+	/*! \brief Extract all the files
+	 * \param progress_ms period of progress() signal, 0 to disable
+	 * \return false if a file failed, the others are extracted anyway
+	 */
+	bool run(int progress_ms);
+
+	/// \brief Get the files, sorted like they were started
+	const QVector<t_batch_file *> & files() { return mFiles; }
+
+	/// \brief Get the bytes scanned in all the files
+	qint64 getScannedBytes();
+
+	/// \brief Get the size of all the files
+	qint64 getTotalSize();
+
+	/// \brief Get status string
+	QString getStatus() { return mStatus; }
+
+	/// \brief Extract one file, called by the jobs
+	void extractFile(t_batch_file * file);
+
+signals:
+	/// \brief Progress of the running files, then of the whole batch
+	void progress();
+
+	/// \brief A file is finished, done or failed
+	void fileFinished(const t_batch_file * file);
+
+private:
+	/// \brief Start the pending files allowed by the limits
+	void startFiles();
+
+	QString mStatus;			///< Error
+	int mThreadCount;			///< Files extracted at once
+	int mStreamCount;			///< Files read at once from a disk
+	std::function<void(RecoverExtractor &)> mSetup;	///< Settings of the extractors
+
+	QVector<t_batch_file *> mFiles;	///< Files, owned
+	QThreadPool mPool;				///< Threads of the jobs
+	QSemaphore mFinished;			///< Released by each finished job
+};
+
+#endif // RECOVERBATCH_H
@@ -0,0 +1,1003 @@
+/*! \file recoverextractor.cpp
+ * \brief Extractor code
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverextractor.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QByteArray>
+#include <QBuffer>
+#include <QImageReader>
+#include <QSaveFile>
+
+#include <assert.h>
+#include <stdarg.h>
+#include <algorithm>
+
+/// \brief Global log level for this file
+te_log_level g_log_level = LOG_INFO;
+bool g_log_stderr = false;
+
+
+
+const char * c_log_descr[] = {
+	"CRITICAL",
+	"ERROR",
+	"WARNING",
+	"INFO",
+	"DEBUG",
+	"TRACE"
+};
+
+const char * log_descr(int lvl) {
+	assert(lvl < 6);
+	return c_log_descr[lvl];
+}
+
+void log_print(int lvl, const char * func, int line, const char * format, ...) {
+	// One write per line, so the lines of the threads are not mixed
+	char message[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	FILE * out = (g_log_stderr ? stderr : stdout);
+	fprintf(out, "[%s] %s:%d: %s\n", log_descr(lvl), func, line, message);
+	if(lvl <= LOG_WARNING) {
+		fflush(out);
+	}
+}
+
+/******************************************************************************
+ *
+ * EXTRACTOR CODE
+ *
+ ******************************************************************************/
+RecoverExtractor::RecoverExtractor()
+	: QObject() {
+	mInput = NULL;
+	mInputMode = INPUT_READ;
+	mMaxFrameLength = MAX_JPEG_LEN;
+	mIndexEnabled = true;
+	mPreviewEnabled = true;
+	mPreviewPeriod = 0;
+	mCancelled.store(0);
+	mInsertDhtEnabled = false;
+	mResumeEnabled = true;
+	mJournalPeriod = JOURNAL_PERIOD;
+	mOutputFormat = OUTPUT_IMAGES;
+	mFrameRate = MUXER_DEFAULT_FPS;
+	mPipePath = OUTPUT_STDOUT;
+	mNameDigits = 0;
+	mMuxer = NULL;
+	mPipelineEnabled = false;
+	mWriter = NULL;
+	mCsvEnabled = false;
+	mFrameIndex = NULL;
+	mSequencesEnabled = false;
+	init();
+}
+
+RecoverExtractor::~RecoverExtractor() {
+	purge();
+}
+
+void RecoverExtractor::init() {
+	// Clear all data to reset to new open file
+	mLastPosition = 0;
+	mFileSize = 0;
+	mImageIndex = 0;
+	mParseCount = 0;
+	mStatus = tr("Init");
+
+	mProgress = 0;
+	mEndOfFile = false;
+	mWrittenBytes = 0;
+	mIndexedSpan = 0;
+	mPendingJournals.clear();
+
+	memset(mTag, 0, sizeof(uint8_t) * 5);
+	mTag32 = 0;
+
+	mKnownFrames.clear();
+	mKnownIndex = 0;
+	mPredictor.reset();
+	mSequences.reset();
+
+	mResumed = false;
+	mLastImageSize = 0;
+	mDigits = 0;
+	mPreviewIndex = 0;
+	mPreviewTimer.invalidate();
+}
+
+void RecoverExtractor::purge() {
+	mProgress = 100;
+
+	CPP_DELETE(mInput);
+	mInput = NULL;
+
+	// The movie is closed with its index, so it plays even if stopped early
+	CPP_DELETE(mMuxer);
+	mMuxer = NULL;
+	// The images already queued are written
+	CPP_DELETE(mWriter);
+	mWriter = NULL;
+	CPP_DELETE(mFrameIndex);
+	mFrameIndex = NULL;
+}
+
+void RecoverExtractor::setFilename(const QString & filename) {
+	purge();
+	init();
+	mValidator.reset();
+
+	mFilename = filename;
+	mDir = QDir(defaultOutputDirectory(mFilename));
+
+    // Create the subdir, the pipe needs none
+    if(mOutputFormat != OUTPUT_PIPE) {
+        mDir.mkpath(".");
+    }
+
+    QString ExportDir = mDir.absolutePath();
+    MSG_PRINT(LOG_INFO, "Saving images in '%s'", qPrintable(ExportDir));
+}
+
+bool RecoverExtractor::setOutputDirectory(const QString & path) {
+	QDir dir(path);
+	if(!dir.mkpath(".")) {
+		MSG_PRINT(LOG_ERROR, "Cannot create output directory '%s'", qPrintable(path));
+		return false;
+	}
+	mDir = QDir(dir.absolutePath());
+	MSG_PRINT(LOG_INFO, "Saving images in '%s'", qPrintable(mDir.absolutePath()));
+	return true;
+}
+
+bool RecoverExtractor::openInput() {
+	CPP_DELETE(mInput);
+	te_input_mode mode = mInputMode;
+	if(mPipelineEnabled && mode != INPUT_MMAP && mode != INPUT_DIRECT) {
+		mode = INPUT_PREFETCH;
+	}
+	if(input_is_stream(mFilename) && mode != INPUT_PREFETCH) {
+		mode = INPUT_STREAM;
+	}
+	mInput = RecoverInput::create(mode, mMaxFrameLength);
+	bool ok = mInput->open(mFilename);
+	if(!ok && mode == INPUT_MMAP) {
+		MSG_PRINT(LOG_WARNING, "%s, revert to read", qPrintable(mInput->getStatus()));
+		CPP_DELETE(mInput);
+		mInput = RecoverInput::create(INPUT_READ, mMaxFrameLength);
+		ok = mInput->open(mFilename);
+	}
+	if(!ok) {
+		mStatus = mInput->getStatus();
+		CPP_DELETE(mInput);
+		mInput = NULL;
+		return false;
+	}
+	MSG_PRINT(LOG_DEBUG, "Reading '%s' with %s", qPrintable(mFilename),
+			  input_mode_name(mInput->mode()));
+	return true;
+}
+
+bool RecoverExtractor::openOutput() {
+	CPP_DELETE(mMuxer);
+	mMuxer = RecoverMuxer::create(mOutputFormat);
+	if(!mMuxer) {
+		if(mPipelineEnabled && mOutputFormat == OUTPUT_IMAGES && !mWriter) {
+			CPP_ALLOC(mWriter, RecoverWriter());
+		}
+		return true;
+	}
+	mMuxer->setFrameRate(mFrameRate);
+	QString movie = (mOutputFormat == OUTPUT_PIPE ? mPipePath
+												  : mDir.absoluteFilePath(recoveredMovieName(mOutputFormat)));
+	if(!mMuxer->open(movie)) {
+		mStatus = mMuxer->getStatus();
+		CPP_DELETE(mMuxer);
+		mMuxer = NULL;
+		return false;
+	}
+	MSG_PRINT(LOG_INFO, "Writing frames in '%s'", qPrintable(movie));
+	return true;
+}
+
+static bool extentBefore(const t_jpeg_extent & a, const t_jpeg_extent & b) {
+	return a.pos < b.pos;
+}
+
+void RecoverExtractor::readIndex() {
+	mKnownFrames.clear();
+	mKnownIndex = 0;
+
+	QFile file(mFilename);
+	if(!file.open(QFile::ReadOnly)) {
+		return;
+	}
+	int tracks = mov_parse_samples(file, &mKnownFrames);
+	if(tracks > 0) {
+		MSG_PRINT(LOG_INFO, "MOV index: %d video tracks, %d frames",
+				  tracks, mKnownFrames.size());
+	} else if(avi_parse_frames(file, &mKnownFrames) > 0) {
+		MSG_PRINT(LOG_INFO, "AVI index: %d frames", mKnownFrames.size());
+	}
+
+	// Sort the frames of all tracks, and drop the ones overlapping the previous
+	std::sort(mKnownFrames.begin(), mKnownFrames.end(), extentBefore);
+	QVector<t_jpeg_extent> sorted;
+	for(int i = 0; i < mKnownFrames.size(); i++) {
+		const t_jpeg_extent & frame = mKnownFrames[i];
+		if(!sorted.isEmpty() && frame.pos < sorted.last().pos + sorted.last().length) {
+			continue;
+		}
+		sorted.append(frame);
+	}
+	mKnownFrames = sorted;
+}
+
+bool RecoverExtractor::hasContainerIndex(const QString & filename) {
+	QFile file(filename);
+	if(!file.open(QFile::ReadOnly)) {
+		return false;
+	}
+	QVector<t_jpeg_extent> frames;
+	if(mov_parse_samples(file, &frames) <= 0) {
+		avi_parse_frames(file, &frames);
+	}
+	return !frames.isEmpty();
+}
+
+int RecoverExtractor::findIndexedFrame(qint64 * found_at, t_jpeg_frame * frame,
+									   const uint8_t ** data) {
+	qint64 from = mLastPosition;
+	while(mKnownIndex < mKnownFrames.size()) {
+		const t_jpeg_extent & sample = mKnownFrames[mKnownIndex];
+		if(sample.pos < from) {
+			mKnownIndex++;
+			continue;
+		}
+
+		// Scan the gap before the known frame, where the index may have been lost
+		if(sample.pos > from) {
+			int found = findFrame(from, NULL, sample.pos, found_at, frame, data);
+			if(found < 0) {
+				return -1;
+			}
+			if(found > 0) {
+				if(*found_at + frame->length <= sample.pos) {
+					return 1;
+				}
+				// The known frame is trusted more than this one
+				from = *found_at + 1;
+				continue;
+			}
+			from = sample.pos;
+		}
+
+		// Check the known frame, it may have been overwritten
+		if(sample.length > mInput->windowLength() && sample.length <= mInput->maxWindow()) {
+			mInput->growWindow(sample.length);
+		}
+		qint64 len = 0;
+		const uint8_t * window = mInput->window(sample.pos, &len, false);
+		if(window && len < sample.length && !mInput->atEnd(sample.pos + len)) {
+			window = mInput->window(sample.pos, &len, true);
+		}
+		if(!window) {
+			return -1;
+		}
+		mKnownIndex++;
+		mParseCount++;
+		g_metrics.add(METRIC_CANDIDATES);
+		if(jpeg_parse_frame(window, qMin(len, sample.length), frame) == JPEG_FRAME_OK) {
+			g_metrics.add(METRIC_INDEXED_FRAMES);
+			*found_at = sample.pos;
+			*data = window;
+			return 1;
+		}
+		g_metrics.add(METRIC_BROKEN_CANDIDATES);
+		// then its bytes are scanned with the next gap
+		MSG_PRINT(LOG_WARNING, "Indexed frame at %lld, %lld bytes is not a JPEG",
+				  sample.pos, sample.length);
+	}
+	return 0;
+}
+
+int RecoverExtractor::findFrame(qint64 from, const uint8_t * tag, qint64 limit,
+								qint64 * found_at, t_jpeg_frame * frame,
+								const uint8_t ** data) {
+	qint64 pos = from;
+	bool force = false;
+
+	while(pos < limit) {
+		if(isCancelled()) {
+			return -1;
+		}
+		if(!tag) {
+			// No search again from before pos
+			mInput->release(pos);
+		}
+		qint64 len = 0;
+		const uint8_t * window = mInput->window(pos, &len, force);
+		if(!window) {
+			return mInput->atEnd(pos) ? 0 : -1;
+		}
+		force = false;
+		bool eof = mInput->atEnd(pos + len);
+
+		MSG_PRINT(LOG_TRACE, "Searching from %lld, window=%lld tag=%c",
+				  pos, len, tag ? 'T':'F');
+
+		qint64 offset = 0;
+		bool reread = false;
+		while(!reread) {
+			qint64 scan_from = offset;
+			offset = (tag ? jpeg_scan_tag(window, len, offset, tag)
+						  : jpeg_scan_soi(window, len, offset));
+			g_metrics.add(METRIC_BYTES_SCANNED, (offset < 0 ? len : offset) - scan_from);
+			if(offset < 0) {
+				break;
+			}
+			if(pos + offset >= limit) {
+				return 0;
+			}
+
+			mParseCount++;
+			g_metrics.add(METRIC_CANDIDATES);
+			te_jpeg_frame_status status = jpeg_parse_frame(window + offset, len - offset, frame);
+			if(status == JPEG_FRAME_OK) {
+				*found_at = pos + offset;
+				*data = window + offset;
+				return 1;
+			}
+
+			if(status == JPEG_FRAME_NEED_MORE && !eof) {
+				// read again, starting at this candidate, in larger windows if it fills one
+				if(offset > 0 || len < mInput->windowLength() || mInput->growWindow(2 * len)) {
+					pos += offset;
+					force = true;
+					reread = true;
+					continue;
+				}
+				MSG_PRINT(LOG_ERROR, "Frame at %lld is larger than max window %lld bytes",
+						  pos + offset, mInput->maxWindow());
+			} else {
+				g_metrics.add(METRIC_BROKEN_CANDIDATES);
+				MSG_PRINT(LOG_DEBUG, "at %lld, SOI but %s JPEG after %lld bytes",
+						  pos + offset,
+						  status == JPEG_FRAME_BROKEN ? "broken" : "truncated",
+						  frame->length);
+			}
+			offset++;
+		}
+
+		if(reread) {
+			continue;
+		}
+		if(eof) {
+			return 0;
+		}
+		// keep the last bytes so the SOI is not missed between windows
+		pos += len - 2;
+	}
+
+	return 0;
+}
+
+bool RecoverExtractor::extract() {
+	if(mFilename.isEmpty()) {
+		mStatus = tr("No file selected");
+		return false;
+	}
+
+	if(!mInput) {
+		if(!mMuxer && !openOutput()) {
+			return false;
+		}
+		if(!openInput()) {
+			return false;
+		}
+		mFileSize = mInput->size();
+		if(mFileSize == 0) {
+			mStatus = tr("Empty file ") + mFilename;
+			return false;
+		}
+		if(mOutputFormat == OUTPUT_INDEX) {
+			CPP_DELETE(mFrameIndex);
+			CPP_ALLOC(mFrameIndex, RecoverFrameIndex());
+			if(mCsvEnabled) {
+				mFrameIndex->setCsvPath(mDir.absoluteFilePath(recoveredIndexName(true)));
+			}
+			if(!mFrameIndex->create(mDir.absoluteFilePath(recoveredIndexName(false)),
+									mValidator.getLevel(), mFileSize)) {
+				mStatus = mFrameIndex->getStatus();
+				purge();
+				return false;
+			}
+		}
+		// The index is read with seeks, so not in streams
+		if(mIndexEnabled && !input_is_stream(mFilename)) {
+			readIndex();
+		}
+		// A stream can't be resumed, its bytes are gone, and a movie is written from start.
+		// Nothing is read yet, the first window starts at the position of the journal.
+		if(mResumeEnabled && mOutputFormat == OUTPUT_IMAGES && !input_is_stream(mFilename)) {
+			readJournal();
+		}
+	}
+
+	// Size of streams is unknown until their end
+	mFileSize = mInput->size();
+
+	MSG_PRINT(LOG_DEBUG, "Starting at mLastPosition=%lld Index=%d "
+						 "tag='0x%02x 0x%02x 0x%02x 0x%02x'",
+			  mLastPosition,
+			  mImageIndex,
+			  mTag[0], mTag[1], mTag[2], mTag[3]);
+
+	t_jpeg_frame frame;
+	qint64 found_at = 0;
+	const uint8_t * data = NULL;
+	int found = 0;
+
+	/***********************************************************************
+	 *
+	 * Indexed pass, the container index gives the frames
+	 *
+	 **********************************************************************/
+	if(mKnownIndex < mKnownFrames.size()) {
+		found = findIndexedFrame(&found_at, &frame, &data);
+	}
+
+	/***********************************************************************
+	 *
+	 * Accelerated pass, we already know the tag, so we look for it first
+	 *
+	 **********************************************************************/
+	if(found == 0 && mTag32 != 0) {
+		// A few of the recent frames far, so a lost tag doesn't cost a whole max frame
+		found = findFrame(mLastPosition, mTag,
+						  mLastPosition + mPredictor.tagSearchLength(TAG_SEARCH_LEN),
+						  &found_at, &frame, &data);
+		if(found == 0) {
+			MSG_PRINT(LOG_WARNING, "Cannot find JPEG with accelerated tag=0x%04x, revert to normal", mTag32);
+			g_metrics.add(METRIC_FALLBACK_SCANS);
+			mTag32 = 0;
+		}
+	}
+
+	/***********************************************************************
+	 *
+	 * Normal pass, we don't know the tag, so we check every SOI marker
+	 *
+	 **********************************************************************/
+	if(found == 0) {
+		found = findFrame(mLastPosition, NULL, INPUT_NO_LIMIT,
+						  &found_at, &frame, &data);
+	}
+
+	if(found < 0 && isCancelled()) {
+		mStatus = tr("Cancelled");
+		return false;
+	}
+	if(found < 0) {
+		mStatus = tr("Read failed for pos=")
+				+ QString::number(mLastPosition)
+				+ tr(" input=")
+				+ input_mode_name(mInput->mode())
+				;
+		return false;
+	}
+
+	if(found == 0) {
+		// No JPEG has been found until the end of file
+		mStatus = tr("End of file, finished");
+		MSG_PRINT(LOG_INFO, "END OF FILE");
+		mFileSize = mInput->size();
+		mLastPosition = mFileSize;
+		mProgress = 100;
+		mEndOfFile = true;
+
+		// The decoding of the last frames may still run
+		mValidator.waitForDone();
+		if(mMuxer && mMuxer->isOpen() && !mMuxer->close()) {
+			mStatus = mMuxer->getStatus();
+			return false;
+		}
+		if(mWriter && !mWriter->waitForDone()) {
+			mStatus = mWriter->getStatus();
+			return false;
+		}
+		if(mFrameIndex && mFrameIndex->isOpen()
+				&& !mFrameIndex->close(mFileSize, mValidator.getInvalidFrames())) {
+			mStatus = mFrameIndex->getStatus();
+			return false;
+		}
+		if(mJournalPeriod > 0) {
+			writeJournal();
+		}
+		if(mSequencesEnabled) {
+			// Not created yet with OUTPUT_PIPE
+			mDir.mkpath(".");
+			if(!mSequences.write(mDir.absoluteFilePath(recoveredSequencesName()))) {
+				mStatus = mSequences.getStatus();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// At first image, we store the header
+	if(mImageIndex == 0) {
+		memcpy(mTag, data, 4);
+		// On a disk, the search of the tag would skip the frames of the other recordings
+		if(!mSequencesEnabled) {
+			memcpy(&mTag32, data, 4);
+		}
+		// Unless a journal gave the names of the frames already saved
+		if(mDigits <= 0) {
+			mDigits = (mNameDigits > 0 ? mNameDigits : estimatedNameDigits(mFileSize, frame.length));
+		}
+	}
+	// Then we check if it's the same so we can accelerate the search
+	else if(mTag32 != 0 && memcmp(mTag, data, 4) != 0) {
+		MSG_PRINT(LOG_ERROR, "Not constant header: 1st=0x%02x%02x%02x%02x != cur=0x%02x%02x%02x%02x",
+				  mTag[0], mTag[1], mTag[2], mTag[3],
+				  data[0], data[1], data[2], data[3]);
+		mTag32 = 0; // So the search won't be accelerated
+	}
+
+	mImageIndex++;
+	if(mSequencesEnabled) {
+		mSequences.addFrame(mImageIndex, found_at, data, frame);
+	}
+	mPredictor.addFrame(found_at - mLastPosition, frame.length);
+	if(mPredictor.isReady()) {
+		// Just enough to parse the next frame at once
+		qint64 hint = mPredictor.windowLength(mInput->maxWindow());
+		if(hint > mInput->windowLength()) {
+			mInput->growWindow(hint);
+		}
+		mInput->setWindowHint(hint);
+	}
+	mLastPosition = found_at + frame.length;
+	g_metrics.add(METRIC_FRAMES);
+	if(mFileSize > 0) {
+		// Integer rounding, a float has no precision left in files of hundreds of GB
+		mProgress = (int)((200 * mLastPosition + mFileSize) / (2 * mFileSize));
+	}
+
+	MSG_PRINT(LOG_DEBUG, "    => Found JPG #%d at offset=%lld size=%lld %dx%d",
+			  mImageIndex,
+			  found_at, frame.length,
+			  frame.width, frame.height);
+
+	QString str;
+	str.sprintf("Found JPG #%d at %.1f MB",
+				mImageIndex,
+				(double)found_at / (1024. * 1024.));
+	mStatus = str;
+
+	// Many Motion JPEG encoders rely on the standard Huffman tables
+	qint64 imageLength = frame.length;
+	const uint8_t * image = data;
+	if(mPreviewEnabled || mInsertDhtEnabled) {
+		image = frameWithTables(data, frame, &imageLength);
+	}
+
+	// Decode once for preview, unless the last one is too recent
+	if(mPreviewEnabled
+			&& (!mPreviewTimer.isValid() || mPreviewTimer.elapsed() >= mPreviewPeriod)) {
+		mPreviewTimer.start();
+		if(decodePreview(image, imageLength, frame.width, frame.height)) {
+			mPreviewIndex = mImageIndex;
+		} else {
+			MSG_PRINT(LOG_WARNING, "JPG #%d at %lld is not decodable", mImageIndex, found_at);
+		}
+	}
+
+	// Save the exact JPEG buffer, from SOI to EOI, or only where it is
+	if(mFrameIndex) {
+		if(!mFrameIndex->append(mImageIndex, found_at, frame)) {
+			mStatus = mFrameIndex->getStatus();
+			return false;
+		}
+		mWrittenBytes += frame.length;
+	} else if(mInsertDhtEnabled ? saveImage(image, imageLength, frame.width, frame.height) < 0
+								: saveImage(data, frame.length, frame.width, frame.height) < 0) {
+		mStatus = tr("Cannot save image #") + QString::number(mImageIndex);
+		return false;
+	}
+	mValidator.check(mImageIndex, data, frame.length, frame.width, frame.height);
+	mInput->release(mLastPosition);
+
+	if(mJournalPeriod > 0 && mImageIndex % mJournalPeriod == 0) {
+		writeJournal();
+	} else if(!mPendingJournals.isEmpty()) {
+		flushJournal();
+	}
+
+	return true;
+}
+
+QString RecoverExtractor::defaultOutputDirectory(const QString & filename)
+{
+	if(filename == INPUT_STDIN) {
+		return QDir::current().absoluteFilePath("stdin");
+	}
+	QFileInfo fi(filename);
+	// Not in /dev for the disks
+	if(input_is_device(filename)) {
+		return QDir::current().absoluteFilePath(fi.baseName());
+	}
+	return fi.absoluteDir().absoluteFilePath(fi.baseName());
+}
+
+QString RecoverExtractor::recoveredImageName(int index, int digits)
+{
+	QString name;
+	name.sprintf("REC_%0*d.jpg", digits, index);
+	return name;
+}
+
+int RecoverExtractor::nameDigits(qint64 frames)
+{
+	int digits = 1;
+	for(qint64 max = 10; max <= frames; max *= 10) {
+		digits++;
+	}
+	return qMax(digits, IMAGE_NAME_DIGITS);
+}
+
+int RecoverExtractor::estimatedNameDigits(qint64 fileSize, qint64 firstFrameLen)
+{
+	if(fileSize <= 0 || firstFrameLen <= 0) {
+		return IMAGE_NAME_DIGITS;
+	}
+	return nameDigits(2 * fileSize / firstFrameLen);
+}
+
+QString RecoverExtractor::recoveredMovieName(te_output_format format)
+{
+	return QString("REC.") + output_format_name(format);
+}
+
+QString RecoverExtractor::recoveredIndexName(bool csv)
+{
+	return csv ? QString("REC.csv") : QString("REC.index");
+}
+
+QString RecoverExtractor::recoveredSequencesName()
+{
+	return QString("REC_sequences.csv");
+}
+
+int RecoverExtractor::writeFile(const QString & path, const uint8_t * data, qint64 len)
+{
+	RecoverMetricsTimer timer(TIMER_WRITE);
+	FILE * f = fopen(qPrintable(path), "wb");
+	if(!f) {
+		MSG_PRINT(LOG_ERROR, "Can't open file '%s' for writing", qPrintable(path));
+		return -1;
+	}
+	size_t written = fwrite(data, 1, (size_t)len, f);
+	if(fclose(f) != 0 || (qint64)written != len) {
+		MSG_PRINT(LOG_ERROR, "Can't write %lld bytes in file '%s'", len, qPrintable(path));
+		return -1;
+	}
+	g_metrics.add(METRIC_IMAGES_WRITTEN);
+	g_metrics.add(METRIC_BYTES_WRITTEN, len);
+	return 0;
+}
+
+bool RecoverExtractor::decodePreview(const uint8_t * data, qint64 len, int width, int height) {
+	QBuffer buffer;
+	buffer.setData((const char *)data, (int)len);
+	buffer.open(QIODevice::ReadOnly);
+	QImageReader reader(&buffer, "JPG");
+	if(mPreviewSize.isValid() && width > 0 && height > 0
+			&& (width > mPreviewSize.width() || height > mPreviewSize.height())) {
+		reader.setScaledSize(QSize(width, height).scaled(mPreviewSize, Qt::KeepAspectRatio));
+	}
+	QImage image;
+	if(!reader.read(&image) || image.isNull()) {
+		return false;
+	}
+	mLoadImage = image;
+	return true;
+}
+
+const uint8_t * RecoverExtractor::frameWithTables(const uint8_t * data, const t_jpeg_frame & frame,
+												  qint64 * len) {
+	if(!jpeg_needs_dht(&frame)) {
+		return data;
+	}
+	mWithTables.resize((int)(frame.length + JPEG_STANDARD_DHT_LEN));
+	*len = jpeg_insert_dht(data, &frame, (uint8_t *)mWithTables.data());
+	return (const uint8_t *)mWithTables.constData();
+}
+
+int RecoverExtractor::saveImage(const uint8_t * data, qint64 len, int width, int height)
+{
+	QString recoveredImageName = RecoverExtractor::recoveredImageName(mImageIndex, getNameDigits());
+	if(mMuxer) {
+		RecoverMetricsTimer timer(TIMER_WRITE);
+		if(!mMuxer->write(recoveredImageName, data, len, width, height)) {
+			MSG_PRINT(LOG_ERROR, "Can't write ImageIndex %d in %s", mImageIndex,
+					  output_format_name(mOutputFormat));
+			return -1;
+		}
+		g_metrics.add(METRIC_IMAGES_WRITTEN);
+		g_metrics.add(METRIC_BYTES_WRITTEN, len);
+		mWrittenBytes += len;
+		mLastImageSize = len;
+		return 0;
+	}
+
+	MSG_PRINT(LOG_DEBUG, "Saving %lld bytes in '%s'",
+			  len,
+			  qPrintable(recoveredImageName));
+
+	QString imageFile = mDir.absoluteFilePath(recoveredImageName);
+	if(mResumed && QFileInfo(imageFile).size() == len) {
+		// Saved after the last update of the journal, before the interruption
+		MSG_PRINT(LOG_DEBUG, "'%s' is already saved", qPrintable(recoveredImageName));
+	} else if(mWriter) {
+		if(!mWriter->write(imageFile, data, len)) {
+			MSG_PRINT(LOG_ERROR, "%s", qPrintable(mWriter->getStatus()));
+			return -1;
+		}
+	} else if(writeFile(imageFile, data, len) < 0) {
+		MSG_PRINT(LOG_ERROR, "Can't save ImageIndex %d", mImageIndex);
+		return -1;
+	}
+	mWrittenBytes += len;
+	mLastImageSize = len;
+	return 0;
+}
+
+/******************************************************************************
+ *
+ * EXTRACTION FROM INDEX
+ *
+ ******************************************************************************/
+int RecoverExtractor::extractRange(const QString & indexFile, int first, int last)
+{
+	QVector<t_indexed_frame> frames;
+	qint64 inputSize = -1;
+	if(!RecoverFrameIndex::read(indexFile, &frames, &inputSize)) {
+		mStatus = tr("Cannot read index ") + indexFile;
+		return -1;
+	}
+	if(!openInput()) {
+		return -1;
+	}
+	if(mInput->size() >= 0 && inputSize >= 0 && mInput->size() != inputSize) {
+		mStatus = tr("Index is not for ") + mFilename;
+		return -1;
+	}
+	if(!openOutput()) {
+		return -1;
+	}
+
+	// The number of frames is known, so the names are sized to it
+	int maxNumber = 0;
+	for(int i = 0; i < frames.size(); i++) {
+		maxNumber = qMax(maxNumber, frames[i].number);
+	}
+	mDigits = (mNameDigits > 0 ? mNameDigits : nameDigits(maxNumber));
+
+	int extracted = 0;
+	qint64 firstPos = -1;
+	for(int i = 0; i < frames.size(); i++) {
+		const t_indexed_frame & item = frames[i];
+		if(item.number < first || (last > 0 && item.number > last)) {
+			continue;
+		}
+		// The frames are in file order, so the data before are not read again
+		mInput->release(item.pos);
+		if(item.length > mInput->windowLength()) {
+			mInput->growWindow(item.length);
+		}
+		qint64 len = 0;
+		const uint8_t * window = mInput->window(item.pos, &len, false);
+		while(window && len < item.length && len < mInput->windowLength()
+				&& !mInput->atEnd(item.pos + len)) {
+			window = mInput->window(item.pos, &len, true);
+		}
+		if(!window || len < item.length) {
+			mStatus = tr("Read failed for pos=") + QString::number(item.pos);
+			return -1;
+		}
+
+		qint64 imageLength = item.length;
+		const uint8_t * image = window;
+		t_jpeg_frame frame;
+		if(mInsertDhtEnabled && jpeg_parse_frame(window, item.length, &frame) == JPEG_FRAME_OK) {
+			image = frameWithTables(window, frame, &imageLength);
+		}
+
+		mImageIndex = item.number;
+		mLastPosition = item.pos + item.length;
+		if(firstPos < 0) {
+			firstPos = item.pos;
+		}
+		mIndexedSpan = mLastPosition - firstPos;
+		g_metrics.add(METRIC_FRAMES);
+		if(saveImage(image, imageLength, item.width, item.height) < 0) {
+			mStatus = tr("Cannot save image #") + QString::number(mImageIndex);
+			return -1;
+		}
+		extracted++;
+	}
+
+	if(mMuxer && !mMuxer->close()) {
+		mStatus = mMuxer->getStatus();
+		return -1;
+	}
+	if(mWriter && !mWriter->waitForDone()) {
+		mStatus = mWriter->getStatus();
+		return -1;
+	}
+	mEndOfFile = true;
+	mStatus = tr("Extracted ") + QString::number(extracted) + tr(" frames from index");
+	return extracted;
+}
+
+/******************************************************************************
+ *
+ * JOURNAL
+ *
+ ******************************************************************************/
+bool RecoverExtractor::writeJournal()
+{
+	if(!mInput || mOutputFormat != OUTPUT_IMAGES || input_is_stream(mFilename)) {
+		return false;
+	}
+	uint32_t tag = 0;
+	memcpy(&tag, mTag, 4);
+
+	// One "key=value" per line, written once the frames it counts are on disk
+	QString journal = QString("# RecoverFromMJPEG journal\n")
+			+ "input=" + QFileInfo(mFilename).absoluteFilePath() + "\n"
+			+ "size=" + QString::number(mFileSize) + "\n"
+			+ "position=" + QString::number(mLastPosition) + "\n"
+			+ "frames=" + QString::number(mImageIndex) + "\n"
+			+ "last_size=" + QString::number(mLastImageSize) + "\n"
+			+ "written=" + QString::number(mWrittenBytes) + "\n"
+			+ "tag=" + QString::number(tag) + "\n"
+			+ "digits=" + QString::number(getNameDigits()) + "\n"
+			+ "accelerated=" + QString::number(mTag32 != 0 ? 1 : 0) + "\n";
+	t_pending_journal pending;
+	pending.data = journal.toUtf8();
+	pending.queued = (mWriter ? mWriter->queuedCount() : 0);
+	pending.frames = mImageIndex;
+	pending.position = mLastPosition;
+	mPendingJournals.append(pending);
+	return flushJournal();
+}
+
+bool RecoverExtractor::flushJournal()
+{
+	// The journal counts only frames which are on disk, the writer is not drained
+	qint64 written = (mWriter ? mWriter->writtenCount() : 0);
+	int ready = -1;
+	for(int i = 0; i < mPendingJournals.size() && mPendingJournals[i].queued <= written; i++) {
+		ready = i;
+	}
+	if(ready < 0) {
+		return false;
+	}
+	t_pending_journal pending = mPendingJournals[ready];
+	mPendingJournals.erase(mPendingJournals.begin(), mPendingJournals.begin() + ready + 1);
+
+	// QSaveFile replaces the previous journal only once the new one is complete
+	QSaveFile file(mDir.absoluteFilePath(JOURNAL_FILENAME));
+	if(!file.open(QIODevice::WriteOnly)
+			|| file.write(pending.data) != pending.data.size()
+			|| !file.commit()) {
+		MSG_PRINT(LOG_WARNING, "Can't write journal in '%s'", qPrintable(mDir.absolutePath()));
+		return false;
+	}
+	MSG_PRINT(LOG_DEBUG, "Journal: %d frames until %lld", pending.frames, pending.position);
+	return true;
+}
+
+bool RecoverExtractor::readJournal()
+{
+	QFile file(mDir.absoluteFilePath(JOURNAL_FILENAME));
+	if(!file.exists() || !file.open(QFile::ReadOnly)) {
+		return false;
+	}
+
+	QString input;
+	qint64 size = -1, position = -1, last_size = 0, written = 0;
+	int frames = -1;
+	int digits = IMAGE_NAME_DIGITS;
+	uint32_t tag = 0;
+	bool accelerated = false;
+	while(!file.atEnd()) {
+		QString line = QString::fromUtf8(file.readLine()).trimmed();
+		int sep = line.indexOf("=");
+		if(line.startsWith("#") || sep <= 0) {
+			continue;
+		}
+		QString key = line.left(sep);
+		QString value = line.mid(sep + 1);
+		if(key == "input") { input = value; }
+		else if(key == "size") { size = value.toLongLong(); }
+		else if(key == "position") { position = value.toLongLong(); }
+		else if(key == "frames") { frames = value.toInt(); }
+		else if(key == "last_size") { last_size = value.toLongLong(); }
+		else if(key == "written") { written = value.toLongLong(); }
+		else if(key == "tag") { tag = (uint32_t)value.toULongLong(); }
+		else if(key == "accelerated") { accelerated = (value.toInt() != 0); }
+		else if(key == "digits") { digits = value.toInt(); }
+	}
+
+	if(input != QFileInfo(mFilename).absoluteFilePath() || size != mInput->size()) {
+		MSG_PRINT(LOG_WARNING, "Journal of '%s' is for another file, ignored",
+				  qPrintable(mDir.absolutePath()));
+		return false;
+	}
+	if(position < 0 || position > size || frames < 0 || digits <= 0) {
+		MSG_PRINT(LOG_WARNING, "Journal of '%s' is damaged, ignored",
+				  qPrintable(mDir.absolutePath()));
+		return false;
+	}
+
+	// The frames which are already on disk are kept, whatever happens, with their names
+	mResumed = true;
+	mDigits = digits;
+
+	// The frames are not synced, so the last one may be lost after a reboot
+	if(frames > 0
+			&& QFileInfo(mDir.absoluteFilePath(recoveredImageName(frames, digits))).size() != last_size) {
+		MSG_PRINT(LOG_WARNING, "%s of journal is not on disk, restart from beginning",
+				  qPrintable(recoveredImageName(frames, digits)));
+		return false;
+	}
+
+	mLastPosition = position;
+	mImageIndex = frames;
+	mLastImageSize = last_size;
+	mWrittenBytes = written;
+	memcpy(mTag, &tag, 4);
+	mTag32 = (accelerated ? tag : 0);
+	MSG_PRINT(LOG_INFO, "Resume from journal at %lld after %d frames", mLastPosition, mImageIndex);
+	return true;
+}
+
+
+
+static bool s_debug_alloc = false;
+void registerAlloc(const char * file, const char *func, int line,
+				   void * buf, size_t size) {
+    if(!s_debug_alloc) { return; }
+    fprintf(stderr, "%s:%s:%d: allocate %p / %zu bytes\n", file, func, line, buf, size);
+}
+
+void registerDelete(const char * file, const char *func, int line,
+					void * buf) {
+    if(!s_debug_alloc) { return; }
+    fprintf(stderr, "%s:%s:%d: delete %p\n", file, func, line, buf);
+}
+
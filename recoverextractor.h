@@ -0,0 +1,541 @@
+/*! \file recoverextractor.h
+ * \brief Extractor header
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Extraction of the JPEG frames from a broken MJPEG file, without any
+ * dependency on the GUI
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVEREXTRACTOR_H
+#define RECOVEREXTRACTOR_H
+
+#include <QObject>
+#include <QDir>
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QList>
+
+#include "jpegparser.h"
+#include "jpegscan.h"
+#include "recoverinput.h"
+#include "movparser.h"
+#include "aviparser.h"
+#include "recovervalidator.h"
+#include "recovermuxer.h"
+#include "recoverindex.h"
+#include "recovermetrics.h"
+#include "recoverpredictor.h"
+#include "recoverwriter.h"
+#include "recoversequence.h"
+
+/*! \brief Log level */
+typedef enum {
+	LOG_CRITICAL,
+	LOG_ERROR,
+	LOG_WARNING,
+	LOG_INFO,
+	LOG_DEBUG,
+	LOG_TRACE,
+	LOG_MAX
+} te_log_level;
+
+const char * log_descr(int lvl);
+
+/*! \brief Max level of the messages compiled in
+ * The messages above are removed by the compiler, so the traces of the scan
+ * loops cost nothing. Build with DEFINES += LOG_COMPILE_LEVEL=LOG_TRACE to
+ * get them.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL	LOG_DEBUG
+#endif
+
+/*! \brief Print one message line, flushed only for warnings and errors
+ * The format is checked by the compiler against the arguments.
+ */
+void log_print(int lvl, const char * func, int line, const char * format, ...)
+	Q_ATTRIBUTE_FORMAT_PRINTF(4, 5);
+
+extern te_log_level g_log_level;
+
+/// \brief Print the messages on stderr, when stdout carries the frames of OUTPUT_PIPE
+extern bool g_log_stderr;
+#define MSG_PRINT(_lvl, ...)	do { if((_lvl) <= LOG_COMPILE_LEVEL && (_lvl) <= g_log_level) { \
+									log_print((_lvl), __func__, __LINE__, __VA_ARGS__); \
+								}} while(0)
+
+/* MEMORY ALLOCATIONS MACROS */
+#define CPP_ALLOC(_var, _type)	(_var) = new _type; \
+								registerAlloc(__FILE__, __func__, __LINE__, \
+									(void*)(_var), sizeof((_type)));
+#define REGISTER_ALLOC(_var, _size)	registerAlloc(__FILE__, __func__, __LINE__, \
+									(void*)(_var), (_size));
+#define CPP_ALLOC_ARRAY(_var, _type, _size)	(_var) = new _type [ (_size) ]; \
+								registerAlloc(__FILE__, __func__, __LINE__, \
+									(void*)(_var), sizeof(_type) * ((_size)));
+#define REGISTER_ALLOC_ARRAY(_var, _size)	registerAlloc(__FILE__, __func__, __LINE__, \
+									(void*)(_var), (_size));
+#define CPP_DELETE(_var)		registerDelete(__FILE__, __func__, __LINE__, \
+										(void*)(_var)); \
+								if((_var)) { delete (_var); }
+#define CPP_DELETE_ARRAY(_var)		registerDelete(__FILE__, __func__, __LINE__, \
+										(void*)(_var)); \
+								if((_var)) { delete [] (_var); }
+#define REGISTER_DELETE(_var, _size)	registerDelete(__FILE__, __func__, __LINE__, \
+									(void*)(_var), (_size));
+
+/*! \brief Track memory allocations */
+void registerAlloc(const char * file, const char *func, int line,
+				   void * buf, size_t size);
+
+/*! \brief Track memory delete */
+void registerDelete(const char * file, const char *func, int line,
+				   void * buf);
+
+
+/// Default max jpeg length, the windows grow up to it for the larger frames
+#define MAX_JPEG_LEN (64*1024*1024)
+
+/// Max distance where the known tag is searched before reverting to any SOI, a 4K frame of DxO One
+#define TAG_SEARCH_LEN 7000000
+
+/// Name of the journal in the output directory, to resume an interrupted extraction
+#define JOURNAL_FILENAME	"recover.journal"
+
+/// Min number of digits of the image numbers, in their names
+#define IMAGE_NAME_DIGITS	4
+
+/// Default number of frames between two updates of the journal
+#define JOURNAL_PERIOD	100
+
+/*! \brief Journal waiting until the writer saved its frames */
+typedef struct {
+	QByteArray data;	///< Content of the journal
+	qint64 queued;		///< Files queued in the writer until its last frame
+	int frames;			///< Frames it counts, for the logs
+	qint64 position;	///< Position it resumes from, for the logs
+} t_pending_journal;
+
+
+/*! \brief Extractor class to extract data from the file */
+class RecoverExtractor : public QObject {
+	Q_OBJECT
+public:
+	RecoverExtractor();
+	~RecoverExtractor();
+
+	/// \brief Set MOV input file name
+	void setFilename(const QString & filename);
+
+	/*! \brief Set output directory, instead of the subdirectory next to the input file
+	 * To be called after setFilename()
+	 */
+	bool setOutputDirectory(const QString & path);
+
+	/// \brief Set how the input file is accessed, INPUT_READ by default
+	void setInputMode(te_input_mode mode) { mInputMode = mode; }
+
+	/*! \brief Set the length of the longest frame, MAX_JPEG_LEN by default
+	 * The windows on the input start small and grow up to it when a frame
+	 * doesn't fit, a longer candidate is considered as broken.
+	 */
+	void setMaxFrameLength(qint64 len) { mMaxFrameLength = len; }
+
+	/*! \brief Use the index of the container when it survived, true by default
+	 * The indexed frames are extracted directly, and only the bytes between
+	 * them are scanned.
+	 */
+	void setIndexEnabled(bool on) { mIndexEnabled = on; }
+
+	/// \brief Set the verification of the frames after the structure check
+	void setValidationLevel(te_validation_level level) { mValidator.setLevel(level); }
+
+	/// \brief Set the number of threads decoding the frames, 0 for the number of cores
+	void setDecodeThreadCount(int threads) { mValidator.setThreadCount(threads); }
+
+	/// \brief Get number of frames which could not be decoded, final at end of file
+	int getInvalidCount() { return mValidator.getInvalidCount(); }
+
+	/// \brief Get numbers of the frames which could not be decoded
+	QVector<int> getInvalidFrames() { return mValidator.getInvalidFrames(); }
+
+	/*! \brief Resume from the journal of the output directory, true by default
+	 * To be called before the first extract()
+	 */
+	void setResumeEnabled(bool on) { mResumeEnabled = on; }
+
+	/// \brief Set the number of frames between two updates of the journal, 0 to disable it
+	void setJournalPeriod(int frames) { mJournalPeriod = frames; }
+
+	/*! \brief Set how the frames are saved, OUTPUT_IMAGES by default
+	 * With a movie or archive format, the frames are copied in recoveredMovieName() in
+	 * the output directory. With OUTPUT_INDEX, only the index of the frames
+	 * is written in recoveredIndexName(). With OUTPUT_PIPE, the frames are
+	 * written in the pipe of setPipePath(), and the output directory is not
+	 * created. The journal is used only for images.
+	 */
+	void setOutputFormat(te_output_format format) { mOutputFormat = format; }
+
+	/// \brief Set the named pipe or file of OUTPUT_PIPE, OUTPUT_STDOUT by default
+	void setPipePath(const QString & path) { mPipePath = path; }
+
+	/// \brief Set frame rate of the movie
+	void setFrameRate(int fps) { mFrameRate = fps; }
+
+	/*! \brief Set the number of digits of the image numbers in their names
+	 * With 0, the default, they are sized from the expected number of frames
+	 * so the names sort in frame order.
+	 */
+	void setNameDigits(int digits) { mNameDigits = digits; }
+
+	/// \brief Get the number of digits of the image names of this extraction
+	int getNameDigits() { return mDigits > 0 ? mDigits : IMAGE_NAME_DIGITS; }
+
+	/// \brief Also write the index in CSV with OUTPUT_INDEX, false by default
+	void setCsvEnabled(bool on) { mCsvEnabled = on; }
+
+	/*! \brief Read ahead and write the images on other threads, false by default
+	 * The input is then read in INPUT_PREFETCH mode, unless INPUT_MMAP or INPUT_DIRECT is set,
+	 * and the images are written by a RecoverWriter while the scan goes on.
+	 */
+	void setPipelineEnabled(bool on) { mPipelineEnabled = on; }
+
+	/// \brief Get number of blocks read ahead and not scanned yet
+	int getReadQueueDepth() { return mInput ? mInput->queueDepth() : 0; }
+
+	/// \brief Get number of images waiting to be written
+	int getWriteQueueDepth() { return mWriter ? mWriter->queueDepth() : 0; }
+
+	/// \brief Enable the decoding of each frame for getImage(), true by default
+	void setPreviewEnabled(bool on) { mPreviewEnabled = on; }
+
+	/*! \brief Decode the previews reduced to fit in size, invalid size for the full resolution
+	 * The JPEG decoder then skips most of the IDCT, like the scaled validation.
+	 */
+	void setPreviewSize(const QSize & size) { mPreviewSize = size; }
+
+	/// \brief Set the min time between two previews in ms, 0 to decode every frame
+	void setPreviewPeriod(int ms) { mPreviewPeriod = ms; }
+
+	/*! \brief Stop extract() from another thread, even inside a long scan
+	 * It then returns false with the status "Cancelled", until it's reset
+	 * with false, and the next extract() goes on from the last frame found.
+	 */
+	void setCancelled(bool on) { mCancelled.store(on ? 1 : 0); }
+
+	/// \brief Return true if the extraction has been cancelled
+	bool isCancelled() { return mCancelled.load() != 0; }
+
+	/*! \brief Write the frames without Huffman tables with the standard ones, false by default
+	 * They are always decoded with them, for the preview and the validation.
+	 */
+	void setInsertDhtEnabled(bool on) { mInsertDhtEnabled = on; }
+
+	/*! \brief Group the frames in recordings, false by default
+	 * For whole disks, where the frames of many files follow each other. The
+	 * sequences are written in recoveredSequencesName() at the end of file.
+	 */
+	void setSequencesEnabled(bool on) { mSequencesEnabled = on; }
+
+	/// \brief Set the cluster size of the file system of the disk, for the sequences
+	void setClusterSize(qint64 size) { mSequences.setClusterSize(size); }
+
+	/// \brief Get the recordings found with setSequencesEnabled()
+	const QVector<t_frame_sequence> & getSequences() { return mSequences.sequences(); }
+
+	/// \brief Extract one frame
+	bool extract();
+
+	/*! \brief Extract frames from an index written with OUTPUT_INDEX, without scanning
+	 * The input is read forward only, from frame to frame, so it may be a
+	 * stream. The frames are saved like extract() does, with their numbers.
+	 * \param indexFile index file of the input file
+	 * \param first number of the first frame to extract
+	 * \param last number of the last frame to extract, 0 for the last one
+	 * \return number of frames extracted, -1 on error with getStatus()
+	 */
+	int extractRange(const QString & indexFile, int first, int last);
+
+	/// \brief Get status string
+	QString getStatus() { return mStatus; }
+
+	/// \brief Get progress in %
+	int getProgress() { return mProgress; }
+
+	/// \brief Return true when the end of file has been reached
+	bool atEnd() { return mEndOfFile; }
+
+	/// \brief Get current position in input file
+	qint64 getPosition() { return mLastPosition; }
+
+	/// \brief Get size of input file, known after first extract()
+	qint64 getFileSize() { return mFileSize; }
+
+	/// \brief Get number of recovered images
+	int getImageCount() { return mImageIndex; }
+
+	/// \brief Get number of JPEG candidates parsed, for statistics
+	qint64 getParseCount() { return mParseCount; }
+
+	/// \brief Get number of frames decoded by the validation, final at end of file
+	int getDecodeCount() { return mValidator.getCheckedCount(); }
+
+	/// \brief Get number of bytes written in recovered images
+	qint64 getWrittenBytes() { return mWrittenBytes; }
+
+	/// \brief Get number of bytes of input from the first to the end of the last frame of extractRange()
+	qint64 getIndexedSpan() { return mIndexedSpan; }
+
+	/// \brief Get output directory
+	QString getOutputDirectory() { return mDir.absolutePath(); }
+
+	/// \brief Get the last preview
+	QImage getImage() { return mLoadImage; }
+
+	/// \brief Get number of the frame of the last preview, 0 before the first one
+	int getPreviewIndex() { return mPreviewIndex; }
+
+	/// \brief Default output directory: subdirectory next to the input file
+	static QString defaultOutputDirectory(const QString & filename);
+
+	/// \brief Name of the file of the recovered image, from 1
+	static QString recoveredImageName(int index, int digits = IMAGE_NAME_DIGITS);
+
+	/// \brief Number of digits of the image names for a number of frames
+	static int nameDigits(qint64 frames);
+
+	/*! \brief Number of digits of the image names of a file, before its scan
+	 * The number of frames is estimated from the length of the first one,
+	 * with a margin, as the other frames may be smaller.
+	 * \param fileSize size of input file, -1 for a stream
+	 */
+	static int estimatedNameDigits(qint64 fileSize, qint64 firstFrameLen);
+
+	/// \brief Name of the movie or archive file for format
+	static QString recoveredMovieName(te_output_format format);
+
+	/// \brief Name of the index file, binary or CSV
+	static QString recoveredIndexName(bool csv);
+
+	/// \brief Name of the CSV file of the sequences
+	static QString recoveredSequencesName();
+
+	/// \brief Return true if the MOV or AVI index of the file lists frames, then extracted directly
+	static bool hasContainerIndex(const QString & filename);
+
+	/*! \brief Write a buffer in a new file
+	 * \return 0 if ok, -1 on error
+	 */
+	static int writeFile(const QString & path, const uint8_t * data, qint64 len);
+
+private:
+	void init();
+	void purge();
+
+	/// \brief Current file name
+	QString mFilename;
+
+	/// \brief Current directory
+	QDir mDir;
+
+	/// \brief Current status
+	QString mStatus;
+
+	/// \brief Last position in file, for reading next frame
+	qint64 mLastPosition;
+
+	/// \brief Size of input file
+	qint64 mFileSize;
+
+	/// \brief Progress in %
+	int mProgress;
+
+	/// \brief End of file reached
+	bool mEndOfFile;
+
+	/// \brief Decode each frame for preview
+	bool mPreviewEnabled;
+
+	/// \brief Number of bytes written in recovered images
+	qint64 mWrittenBytes;
+
+	/// \brief Span of input extracted by extractRange()
+	qint64 mIndexedSpan;
+
+	/// \brief Index of recovered imafe
+	int mImageIndex;
+
+	/// \brief Number of JPEG candidates parsed
+	qint64 mParseCount;
+
+	/// \brief How the input file is accessed
+	te_input_mode mInputMode;
+
+	/// \brief Max length of a frame, so of the windows
+	qint64 mMaxFrameLength;
+
+	/// \brief Input file, once open
+	RecoverInput * mInput;
+
+	/// \brief Open the input, with a fallback on read if the mapping fails
+	bool openInput();
+
+	/// \brief Create the movie for a movie format, or the writer of the images for the pipeline
+	bool openOutput();
+
+	/// \brief Use the index of the container
+	bool mIndexEnabled;
+
+	/// \brief Frames known from the index, sorted by position
+	QVector<t_jpeg_extent> mKnownFrames;
+
+	/// \brief Next known frame to extract
+	int mKnownIndex;
+
+	/// \brief Read the frames known from the index of the container
+	void readIndex();
+
+	/*! \brief Find the next frame with the index
+	 * Scan the gap before the next known frame, then check the known frame.
+	 * \return 1 if found, 0 if there are no more known frames, -1 on read error
+	 */
+	int findIndexedFrame(qint64 * found_at, t_jpeg_frame * frame, const uint8_t ** data);
+
+	/*! \brief Find the first complete JPEG frame from position
+	 * \param from position in file where the search starts
+	 * \param tag 4 first bytes to match, or NULL to accept any SOI
+	 * \param limit position in file where the frame must start before
+	 * \param found_at returned position of the frame in file
+	 * \param frame returned frame information, with its length
+	 * \param data returned pointer on the frame data in buffer
+	 * \return 1 if found, 0 if not found, -1 on read error
+	 */
+	int findFrame(qint64 from, const uint8_t * tag, qint64 limit,
+				  qint64 * found_at, t_jpeg_frame * frame, const uint8_t ** data);
+
+	/*! \brief Save the image in buffer, in its file or in the movie
+	 * \param width width from SOF, for the movie
+	 * \param height height from SOF
+	 */
+	int saveImage(const uint8_t * data, qint64 len, int width, int height);
+
+	/*! \brief Get the frame with the standard Huffman tables if it has none
+	 * \param len length of the frame, then of the returned data
+	 * \return data, or its copy with the tables, valid until the next call
+	 */
+	const uint8_t * frameWithTables(const uint8_t * data, const t_jpeg_frame & frame, qint64 * len);
+
+	/// \brief Write the frames with the standard Huffman tables when they have none
+	bool mInsertDhtEnabled;
+
+	/// \brief Last frame with the standard Huffman tables inserted
+	QByteArray mWithTables;
+
+	/// \brief How the frames are saved
+	te_output_format mOutputFormat;
+
+	/// \brief Frame rate of the movie
+	int mFrameRate;
+
+	/// \brief Named pipe or file of OUTPUT_PIPE
+	QString mPipePath;
+
+	/// \brief Digits of the image names requested, 0 for automatic
+	int mNameDigits;
+
+	/// \brief Digits of the image names of this extraction, 0 until the first frame
+	int mDigits;
+
+	/// \brief Movie of the frames, NULL for images
+	RecoverMuxer * mMuxer;
+
+	/// \brief Read ahead and write the images on other threads
+	bool mPipelineEnabled;
+
+	/// \brief Writer of the images with the pipeline, NULL otherwise
+	RecoverWriter * mWriter;
+
+	/// \brief Write the index in CSV too
+	bool mCsvEnabled;
+
+	/// \brief Index of the frames with OUTPUT_INDEX, NULL otherwise
+	RecoverFrameIndex * mFrameIndex;
+
+	/// \brief Resume from the journal
+	bool mResumeEnabled;
+
+	/// \brief The extraction resumed, so the frames already on disk are kept
+	bool mResumed;
+
+	/// \brief Number of frames between two updates of the journal
+	int mJournalPeriod;
+
+	/// \brief Size of the last saved frame, for the journal
+	qint64 mLastImageSize;
+
+	/*! \brief Restore the position, numbering and tag from the journal
+	 * The journal is used only if it was written for the same input file
+	 * and if its last frame is on disk.
+	 * \return true if the extraction resumes
+	 */
+	bool readJournal();
+
+	/*! \brief Write the journal atomically, after the frames it counts
+	 * The state is kept until the writer saved its frames, without waiting.
+	 * \return false if no journal could be written yet
+	 */
+	bool writeJournal();
+
+	/*! \brief Write the newest kept journal whose frames are on disk
+	 * \return false if none is ready or it can't be written
+	 */
+	bool flushJournal();
+
+	/// \brief Journals waiting for their frames, oldest first
+	QList<t_pending_journal> mPendingJournals;
+
+	/// \brief Model of the recent frames, for the windows and the search of the tag
+	RecoverFramePredictor mPredictor;
+
+	/// \brief Group the frames in recordings
+	bool mSequencesEnabled;
+
+	/// \brief Recordings found on the disk
+	RecoverSequences mSequences;
+
+	uint8_t mTag[5];	///< 4 first chars of the searched JPEG buffer
+	uint32_t mTag32;	///< unsigned int 32bit version of the \see tag
+
+	QImage mLoadImage;	///< Last read image
+	QSize mPreviewSize;	///< Size of the previews, invalid for the full resolution
+	int mPreviewPeriod;	///< Min time between two previews in ms
+	QElapsedTimer mPreviewTimer;	///< Time since the last preview
+	int mPreviewIndex;	///< Number of the frame of mLoadImage
+	QAtomicInt mCancelled;	///< Stop request from another thread
+
+	/*! \brief Decode the preview in mLoadImage, reduced to mPreviewSize
+	 * \return false if the frame is not decodable
+	 */
+	bool decodePreview(const uint8_t * data, qint64 len, int width, int height);
+
+	RecoverValidator mValidator;	///< Decoding of the saved frames
+};
+
+#endif // RECOVEREXTRACTOR_H
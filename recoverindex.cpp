@@ -0,0 +1,234 @@
+/*! \file recoverindex.cpp
+ * \brief Index of the frames found in the broken file
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverindex.h"
+#include "recoverextractor.h"
+
+#include <QSaveFile>
+
+#include <algorithm>
+
+const char * c_frame_status_names[FRAME_STATUS_MAX] = {
+	"structure",
+	"decoded",
+	"invalid"
+};
+
+const char * frame_status_name(int status) {
+	if(status < 0 || status >= FRAME_STATUS_MAX) {
+		return "unknown";
+	}
+	return c_frame_status_names[status];
+}
+
+/// \brief Store value in little endian on bytes
+static void index_put(uint8_t * p, uint64_t value, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		p[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+/// \brief Read a little endian value on bytes
+static uint64_t index_get(const uint8_t * p, int bytes) {
+	uint64_t value = 0;
+	for(int i = 0; i < bytes; i++) {
+		value |= (uint64_t)p[i] << (8 * i);
+	}
+	return value;
+}
+
+RecoverFrameIndex::RecoverFrameIndex() {
+	mLevel = VALIDATE_STRUCTURE;
+	mInputSize = -1;
+}
+
+RecoverFrameIndex::~RecoverFrameIndex() {
+	if(isOpen()) {
+		// Interrupted, so the frames are not known as decoded
+		finish(mInputSize, true);
+	}
+}
+
+QByteArray RecoverFrameIndex::header(int count, qint64 inputSize) {
+	QByteArray header(FRAME_INDEX_HEADER_LEN, '\0');
+	uint8_t * p = (uint8_t *)header.data();
+	memcpy(p, FRAME_INDEX_MAGIC, 4);
+	index_put(p + 4, FRAME_INDEX_VERSION, 2);
+	index_put(p + 6, FRAME_INDEX_RECORD_LEN, 2);
+	index_put(p + 8, (uint32_t)count, 4);
+	index_put(p + 12, mLevel, 4);
+	index_put(p + 16, (uint64_t)inputSize, 8);
+	return header;
+}
+
+bool RecoverFrameIndex::create(const QString & path, te_validation_level level,
+							   qint64 inputSize) {
+	mLevel = level;
+	mInputSize = inputSize;
+	mFrames.clear();
+	mFile.setFileName(path);
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		mStatus = QObject::tr("Cannot create index ") + path;
+		return false;
+	}
+	// The count is set at close, so an interrupted index is recognized
+	QByteArray data = header(-1, inputSize);
+	if(mFile.write(data) != data.size()) {
+		mStatus = QObject::tr("Cannot write index ") + path;
+		return false;
+	}
+	MSG_PRINT(LOG_INFO, "Writing frame index in '%s'", qPrintable(path));
+	return true;
+}
+
+void RecoverFrameIndex::record(const t_indexed_frame & item, uint8_t * record) {
+	memset(record, 0, FRAME_INDEX_RECORD_LEN);
+	index_put(record, (uint64_t)item.pos, 8);
+	index_put(record + 8, (uint32_t)item.length, 4);
+	index_put(record + 12, (uint32_t)item.number, 4);
+	index_put(record + 16, (uint16_t)item.width, 2);
+	index_put(record + 18, (uint16_t)item.height, 2);
+	index_put(record + 20, item.status, 1);
+}
+
+bool RecoverFrameIndex::append(int number, qint64 pos, const t_jpeg_frame & frame) {
+	t_indexed_frame item;
+	item.number = number;
+	item.pos = pos;
+	item.length = frame.length;
+	item.width = frame.width;
+	item.height = frame.height;
+	// The decoding runs later, an interrupted index doesn't claim it
+	item.status = FRAME_STRUCTURE_OK;
+
+	uint8_t data[FRAME_INDEX_RECORD_LEN];
+	record(item, data);
+	if(mFile.write((const char *)data, FRAME_INDEX_RECORD_LEN) != FRAME_INDEX_RECORD_LEN
+			|| !mFile.flush()) {
+		mStatus = QObject::tr("Cannot write index ") + mFile.fileName();
+		return false;
+	}
+	mFrames.append(item);
+	return true;
+}
+
+static bool indexedFrameBefore(const t_indexed_frame & a, int number) {
+	return a.number < number;
+}
+
+bool RecoverFrameIndex::close(qint64 inputSize, const QVector<int> & invalid) {
+	if(!isOpen()) {
+		return false;
+	}
+	MSG_PRINT(LOG_INFO, "Frame index: %d frames, %d invalid", mFrames.size(), invalid.size());
+	if(mLevel == VALIDATE_STRUCTURE) {
+		return finish(inputSize, true);
+	}
+
+	// The decoding results came after the records, so all the records are written again
+	for(int i = 0; i < mFrames.size(); i++) {
+		mFrames[i].status = FRAME_DECODED;
+	}
+	for(int i = 0; i < invalid.size(); i++) {
+		QVector<t_indexed_frame>::iterator it = std::lower_bound(mFrames.begin(), mFrames.end(),
+																  invalid[i], indexedFrameBefore);
+		if(it != mFrames.end() && it->number == invalid[i]) {
+			it->status = FRAME_NOT_DECODABLE;
+		}
+	}
+	QByteArray records(mFrames.size() * FRAME_INDEX_RECORD_LEN, '\0');
+	for(int i = 0; i < mFrames.size(); i++) {
+		record(mFrames[i], (uint8_t *)records.data() + i * FRAME_INDEX_RECORD_LEN);
+	}
+	bool ok = mFile.seek(FRAME_INDEX_HEADER_LEN) && mFile.write(records) == records.size();
+	return finish(inputSize, ok);
+}
+
+bool RecoverFrameIndex::finish(qint64 inputSize, bool ok) {
+	mInputSize = inputSize;
+	QByteArray data = header(mFrames.size(), inputSize);
+	ok = ok && mFile.seek(0) && mFile.write(data) == data.size();
+	mFile.close();
+	if(!ok) {
+		mStatus = QObject::tr("Cannot write index ") + mFile.fileName();
+		return false;
+	}
+	return mCsvPath.isEmpty() || writeCsv();
+}
+
+bool RecoverFrameIndex::writeCsv() {
+	QString csv("frame,offset,length,width,height,status\n");
+	for(int i = 0; i < mFrames.size(); i++) {
+		const t_indexed_frame & item = mFrames[i];
+		csv += QString::number(item.number) + ","
+				+ QString::number(item.pos) + ","
+				+ QString::number(item.length) + ","
+				+ QString::number(item.width) + ","
+				+ QString::number(item.height) + ","
+				+ frame_status_name(item.status) + "\n";
+	}
+	QByteArray data = csv.toUtf8();
+	QSaveFile file(mCsvPath);
+	if(!file.open(QIODevice::WriteOnly)
+			|| file.write(data) != data.size()
+			|| !file.commit()) {
+		mStatus = QObject::tr("Cannot write CSV index ") + mCsvPath;
+		return false;
+	}
+	return true;
+}
+
+bool RecoverFrameIndex::read(const QString & path, QVector<t_indexed_frame> * frames,
+							 qint64 * inputSize) {
+	frames->clear();
+	QFile file(path);
+	if(!file.open(QFile::ReadOnly)) {
+		MSG_PRINT(LOG_ERROR, "Cannot open index '%s'", qPrintable(path));
+		return false;
+	}
+	QByteArray data = file.read(FRAME_INDEX_HEADER_LEN);
+	const uint8_t * p = (const uint8_t *)data.constData();
+	if(data.size() != FRAME_INDEX_HEADER_LEN || memcmp(p, FRAME_INDEX_MAGIC, 4) != 0
+			|| index_get(p + 4, 2) != FRAME_INDEX_VERSION
+			|| index_get(p + 6, 2) != FRAME_INDEX_RECORD_LEN) {
+		MSG_PRINT(LOG_ERROR, "'%s' is not a frame index", qPrintable(path));
+		return false;
+	}
+	qint64 count = (qint64)index_get(p + 8, 4);
+	qint64 available = (file.size() - FRAME_INDEX_HEADER_LEN) / FRAME_INDEX_RECORD_LEN;
+	if(count == 0xFFFFFFFF || count > available) {
+		MSG_PRINT(LOG_WARNING, "Index '%s' was not closed, read %lld frames", qPrintable(path), available);
+		count = available;
+	}
+	*inputSize = (qint64)index_get(p + 16, 8);
+
+	data = file.read(count * FRAME_INDEX_RECORD_LEN);
+	p = (const uint8_t *)data.constData();
+	frames->reserve((int)count);
+	for(qint64 i = 0; i < count; i++, p += FRAME_INDEX_RECORD_LEN) {
+		t_indexed_frame item;
+		item.pos = (qint64)index_get(p, 8);
+		item.length = (qint64)index_get(p + 8, 4);
+		item.number = (int)index_get(p + 12, 4);
+		item.width = (int)index_get(p + 16, 2);
+		item.height = (int)index_get(p + 18, 2);
+		item.status = (te_frame_status)index_get(p + 20, 1);
+		frames->append(item);
+	}
+	return true;
+}
@@ -0,0 +1,136 @@
+/*! \file recoverindex.h
+ * \brief Index of the frames found in the broken file
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The scan may only write where the frames are: position, length, size
+ * and validation status of each frame, in a compact binary file and
+ * optionally in CSV. The frames are then extracted from the index with
+ * forward reads of the broken file, without scanning it again.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERINDEX_H
+#define RECOVERINDEX_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+#include "jpegparser.h"
+#include "recovervalidator.h"
+
+/// Magic of the index file
+#define FRAME_INDEX_MAGIC	"RMJI"
+
+/// Version of the index file
+#define FRAME_INDEX_VERSION	1
+
+/*! Header: magic, version (16bit), record length (16bit), number of frames
+ * (32bit, 0xFFFFFFFF until the index is closed), validation level (32bit),
+ * size of input file (64bit, -1 if unknown), reserved (64bit)
+ */
+#define FRAME_INDEX_HEADER_LEN	32
+
+/*! Record: position (64bit), length (32bit), number (32bit), width (16bit),
+ * height (16bit), status (8bit), reserved (24bit). All little endian.
+ */
+#define FRAME_INDEX_RECORD_LEN	24
+
+/*! \brief Validation status of an indexed frame */
+typedef enum {
+	FRAME_STRUCTURE_OK,		///< only the structure was checked, or not decoded yet
+	FRAME_DECODED,			///< decoded by the validation
+	FRAME_NOT_DECODABLE,	///< failed the validation
+	FRAME_STATUS_MAX
+} te_frame_status;
+
+/// \brief Name of the frame status, for the CSV index
+const char * frame_status_name(int status);
+
+/*! \brief Frame of the index */
+typedef struct {
+	int number;				///< Number of the frame, from 1
+	qint64 pos;				///< Position of SOI in input file
+	qint64 length;			///< Length of the frame, EOI included
+	int width;				///< Width from SOF
+	int height;				///< Height from SOF
+	te_frame_status status;	///< Validation status
+} t_indexed_frame;
+
+/*! \brief Writer and reader of the index file */
+class RecoverFrameIndex {
+public:
+	RecoverFrameIndex();
+	~RecoverFrameIndex();
+
+	/// \brief Also write the index in CSV at close(), none by default
+	void setCsvPath(const QString & path) { mCsvPath = path; }
+
+	/*! \brief Create the index file and write its header
+	 * \param inputSize size of input file, -1 for a stream
+	 * \return false on error with getStatus()
+	 */
+	bool create(const QString & path, te_validation_level level, qint64 inputSize);
+
+	/// \brief Append a frame, written at once so an interrupted scan keeps it
+	bool append(int number, qint64 pos, const t_jpeg_frame & frame);
+
+	/*! \brief Write the final status and header, then the CSV
+	 * The frames are appended before their decoding, so with a validation
+	 * level they are all decoded or invalid only now.
+	 * \param inputSize final size of input file
+	 * \param invalid numbers of the frames which could not be decoded
+	 */
+	bool close(qint64 inputSize, const QVector<int> & invalid);
+
+	/// \brief Return true between create() and close()
+	bool isOpen() { return mFile.isOpen(); }
+
+	/// \brief Get error string
+	QString getStatus() { return mStatus; }
+
+	/*! \brief Read an index file
+	 * An index which was not closed gives the frames written before.
+	 * \param inputSize returned size of input file, -1 if unknown
+	 * \return false if the file is not an index
+	 */
+	static bool read(const QString & path, QVector<t_indexed_frame> * frames, qint64 * inputSize);
+
+private:
+	/// \brief Build the header
+	QByteArray header(int count, qint64 inputSize);
+
+	/// \brief Build the record of a frame
+	static void record(const t_indexed_frame & item, uint8_t * record);
+
+	/*! \brief Write the final header and close the file, then the CSV
+	 * \param ok false if the records could not be written
+	 */
+	bool finish(qint64 inputSize, bool ok);
+
+	/// \brief Write the frames in CSV
+	bool writeCsv();
+
+	QFile mFile;			///< Index file
+	QString mCsvPath;		///< CSV file, empty if none
+	QString mStatus;		///< Error
+	te_validation_level mLevel;		///< Validation level of the frames
+	qint64 mInputSize;		///< Size of input file, -1 if unknown
+	QVector<t_indexed_frame> mFrames;	///< Frames written, for status and CSV
+};
+
+#endif // RECOVERINDEX_H
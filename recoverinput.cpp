@@ -0,0 +1,792 @@
+/*! \file recoverinput.cpp
+ * \brief Access to the bytes of the broken file
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverinput.h"
+#include "recoverextractor.h"
+
+#include <stdio.h>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+const char * c_input_mode_names[INPUT_MAX] = {
+	"read",
+	"mmap",
+	"stream",
+	"prefetch",
+	"direct"
+};
+
+const char * input_mode_name(int mode) {
+	if(mode < 0 || mode >= INPUT_MAX) {
+		return "invalid";
+	}
+	return c_input_mode_names[mode];
+}
+
+bool input_is_stream(const QString & filename) {
+	if(filename == INPUT_STDIN) {
+		return true;
+	}
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if(stat(qPrintable(filename), &st) == 0) {
+		return S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+	}
+#endif
+	return false;
+}
+
+bool input_is_device(const QString & filename) {
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if(filename != INPUT_STDIN && stat(qPrintable(filename), &st) == 0) {
+		return S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode);
+	}
+#else
+	Q_UNUSED(filename);
+#endif
+	return false;
+}
+
+qint64 input_file_size(QFile & file) {
+	qint64 size = file.size();
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if(size == 0 && fstat(file.handle(), &st) == 0 && S_ISBLK(st.st_mode)) {
+		// The size of a block device is only known from its end
+		off_t pos = lseek(file.handle(), 0, SEEK_CUR);
+		off_t end = lseek(file.handle(), 0, SEEK_END);
+		lseek(file.handle(), pos, SEEK_SET);
+		size = (end > 0 ? (qint64)end : 0);
+	}
+#endif
+	return size;
+}
+
+RecoverInput::RecoverInput(qint64 maxWindow) {
+	mSize = 0;
+	mMaxWindow = maxWindow;
+	mWindow = qMin((qint64)INPUT_INITIAL_WINDOW, maxWindow);
+	mWindowHint = 0;
+}
+
+RecoverInput::~RecoverInput() {
+}
+
+bool RecoverInput::growWindow(qint64 len) {
+	if(mWindow >= mMaxWindow) {
+		return false;
+	}
+	mWindow = qMin(qMax(2 * mWindow, len), mMaxWindow);
+	MSG_PRINT(LOG_DEBUG, "Windows grown to %lld bytes", mWindow);
+	return true;
+}
+
+RecoverInput * RecoverInput::create(te_input_mode mode, qint64 maxWindow) {
+	RecoverInput * input = NULL;
+	switch(mode) {
+	case INPUT_MMAP:
+		CPP_ALLOC(input, RecoverMappedInput(maxWindow));
+		break;
+	case INPUT_STREAM:
+		CPP_ALLOC(input, RecoverStreamInput(maxWindow));
+		break;
+	case INPUT_PREFETCH:
+		CPP_ALLOC(input, RecoverPrefetchInput(maxWindow));
+		break;
+	case INPUT_DIRECT:
+		CPP_ALLOC(input, RecoverDirectInput(maxWindow));
+		break;
+	default:
+		CPP_ALLOC(input, RecoverReadInput(maxWindow));
+		break;
+	}
+	return input;
+}
+
+/******************************************************************************
+ *
+ * BUFFERED READ
+ *
+ ******************************************************************************/
+RecoverReadInput::RecoverReadInput(qint64 maxWindow)
+	: RecoverInput(maxWindow) {
+	mBufferRaw = NULL;
+	mBufferSize = 0;
+	mBufferPos = 0;
+	mBufferLen = 0;
+	mReadEnd = 0;
+}
+
+RecoverReadInput::~RecoverReadInput() {
+	close();
+}
+
+bool RecoverReadInput::open(const QString & filename) {
+	close();
+	mFile.setFileName(filename);
+	if(!mFile.open(QFile::ReadOnly)) {
+		mStatus = QObject::tr("Cannot open file ") + filename;
+		return false;
+	}
+	mSize = input_file_size(mFile);
+	mBufferSize = mWindow;
+	CPP_ALLOC_ARRAY(mBufferRaw, uint8_t, mBufferSize);
+	mBufferPos = 0;
+	mBufferLen = 0;
+	mReadEnd = 0;
+	return true;
+}
+
+void RecoverReadInput::close() {
+	CPP_DELETE_ARRAY(mBufferRaw);
+	mBufferRaw = NULL;
+	mBufferSize = 0;
+	mBufferLen = 0;
+	if(mFile.isOpen()) {
+		mFile.close();
+	}
+}
+
+const uint8_t * RecoverReadInput::window(qint64 pos, qint64 * len, bool force) {
+	*len = 0;
+
+	// Use the data already in buffer if it's long enough to contain a frame
+	qint64 end = mBufferPos + mBufferLen;
+	bool inBuffer = (pos >= mBufferPos && pos < end);
+	if(!force && inBuffer) {
+		qint64 remaining = end - pos;
+		if(remaining >= (mWindowHint > 0 ? qMin(mWindowHint, mWindow) : mWindow / 2)
+				|| end >= mSize) {
+			*len = remaining;
+			return mBufferRaw + (pos - mBufferPos);
+		}
+	}
+
+	// Keep the bytes from pos already in buffer and read only the rest
+	qint64 keep = inBuffer ? qMin(end - pos, mWindow) : 0;
+	if(mBufferSize < mWindow) {
+		uint8_t * buffer = NULL;
+		CPP_ALLOC_ARRAY(buffer, uint8_t, mWindow);
+		if(keep > 0) {
+			memcpy(buffer, mBufferRaw + (pos - mBufferPos), keep);
+		}
+		CPP_DELETE_ARRAY(mBufferRaw);
+		mBufferRaw = buffer;
+		mBufferSize = mWindow;
+	} else if(keep > 0 && pos > mBufferPos) {
+		memmove(mBufferRaw, mBufferRaw + (pos - mBufferPos), keep);
+	}
+	mBufferPos = pos;
+	mBufferLen = keep;
+
+	if(keep < mWindow && mFile.seek(pos + keep)) {
+		qint64 readBytes = 0;
+		{
+			RecoverMetricsTimer timer(TIMER_READ);
+			readBytes = mFile.read((char *)mBufferRaw + keep, mWindow - keep);
+		}
+		if(readBytes > 0) {
+			qint64 readPos = pos + keep;
+			g_metrics.add(METRIC_BYTES_READ, readBytes);
+			if(readPos < mReadEnd) {
+				g_metrics.add(METRIC_BYTES_REREAD, qMin(mReadEnd, readPos + readBytes) - readPos);
+			}
+			mReadEnd = qMax(mReadEnd, readPos + readBytes);
+			mBufferLen += readBytes;
+		}
+	}
+	if(mBufferLen <= 0) {
+		return NULL;
+	}
+
+	*len = mBufferLen;
+	return mBufferRaw;
+}
+
+/******************************************************************************
+ *
+ * DIRECT READ
+ *
+ ******************************************************************************/
+RecoverDirectInput::RecoverDirectInput(qint64 maxWindow)
+	: RecoverInput(maxWindow) {
+	mBufferRaw = NULL;
+	mBufferSize = 0;
+	mBufferPos = 0;
+	mBufferLen = 0;
+	mReadEnd = 0;
+	mDirect = false;
+}
+
+RecoverDirectInput::~RecoverDirectInput() {
+	close();
+}
+
+bool RecoverDirectInput::open(const QString & filename) {
+	close();
+	mFilename = filename;
+	mFile.setFileName(filename);
+	mDirect = false;
+	bool ok = false;
+#if defined(Q_OS_UNIX) && defined(O_DIRECT)
+	int fd = ::open(QFile::encodeName(filename).constData(), O_RDONLY | O_DIRECT);
+	if(fd >= 0) {
+		ok = mFile.open(fd, QFile::ReadOnly | QFile::Unbuffered, QFileDevice::AutoCloseHandle);
+		if(!ok) {
+			::close(fd);
+		}
+		mDirect = ok;
+	}
+#endif
+	// Refused by tmpfs and some network file systems
+	if(!ok) {
+		ok = mFile.open(QFile::ReadOnly | QFile::Unbuffered);
+	}
+	if(!ok) {
+		mStatus = QObject::tr("Cannot open file ") + filename;
+		return false;
+	}
+#ifdef Q_OS_MACOS
+	mDirect = (fcntl(mFile.handle(), F_NOCACHE, 1) == 0);
+#endif
+	if(!mDirect) {
+		MSG_PRINT(LOG_WARNING, "No direct read of '%s', the pages are dropped from the cache after the reads",
+				  qPrintable(filename));
+	}
+	mSize = input_file_size(mFile);
+	mBufferPos = 0;
+	mBufferLen = 0;
+	mReadEnd = 0;
+	MSG_PRINT(LOG_DEBUG, "Reading %lld bytes of '%s' in chunks of %d bytes",
+			  mSize, qPrintable(filename), INPUT_DIRECT_READ_LEN);
+	return true;
+}
+
+void RecoverDirectInput::close() {
+	if(mBufferRaw) {
+		qFreeAligned(mBufferRaw);
+		mBufferRaw = NULL;
+	}
+	mBufferSize = 0;
+	mBufferLen = 0;
+	if(mFile.isOpen()) {
+		mFile.close();
+	}
+}
+
+qint64 RecoverDirectInput::readAligned(qint64 pos, uint8_t * data, qint64 len) {
+	RecoverMetricsTimer timer(TIMER_READ);
+	qint64 readBytes = -1;
+	if(mFile.seek(pos)) {
+		readBytes = mFile.read((char *)data, len);
+	}
+	if(readBytes < 0 && mDirect) {
+		// Some file systems accept O_DIRECT at open, but not the reads
+		MSG_PRINT(LOG_WARNING, "Direct read failed at %lld, revert to cached reads", pos);
+		mFile.close();
+		mFile.setFileName(mFilename);
+		mDirect = false;
+		if(!mFile.open(QFile::ReadOnly | QFile::Unbuffered) || !mFile.seek(pos)) {
+			return -1;
+		}
+		readBytes = mFile.read((char *)data, len);
+	}
+#if defined(Q_OS_UNIX) && defined(POSIX_FADV_DONTNEED)
+	if(readBytes > 0 && !mDirect) {
+		posix_fadvise(mFile.handle(), pos, readBytes, POSIX_FADV_DONTNEED);
+	}
+#endif
+	return readBytes;
+}
+
+const uint8_t * RecoverDirectInput::window(qint64 pos, qint64 * len, bool force) {
+	*len = 0;
+	if(pos < 0 || pos >= mSize) {
+		return NULL;
+	}
+
+	// The chunks are much longer than the windows, so they are rarely read
+	qint64 end = mBufferPos + mBufferLen;
+	bool inBuffer = (pos >= mBufferPos && pos < end);
+	if(inBuffer) {
+		qint64 remaining = end - pos;
+		if(end >= mSize || remaining >= mWindow
+				|| (!force && remaining >= (mWindowHint > 0 ? qMin(mWindowHint, mWindow) : mWindow / 2))) {
+			// Same window length as the buffered read, so the same frames are found
+			*len = qMin(remaining, mWindow);
+			return mBufferRaw + (pos - mBufferPos);
+		}
+	}
+
+	// Keep the bytes from the sector of pos, they end on a sector
+	qint64 start = pos - pos % INPUT_DIRECT_ALIGN;
+	qint64 keep = inBuffer ? end - start : 0;
+	qint64 size = (mWindow + 2 * INPUT_DIRECT_ALIGN - 1) / INPUT_DIRECT_ALIGN * INPUT_DIRECT_ALIGN
+				  + INPUT_DIRECT_READ_LEN;
+	if(mBufferSize < size) {
+		uint8_t * buffer = (uint8_t *)qMallocAligned((size_t)size, INPUT_DIRECT_ALIGN);
+		if(!buffer) {
+			mStatus = QObject::tr("Cannot allocate read buffer of ") + QString::number(size);
+			return NULL;
+		}
+		if(keep > 0) {
+			memcpy(buffer, mBufferRaw + (start - mBufferPos), keep);
+		}
+		if(mBufferRaw) {
+			qFreeAligned(mBufferRaw);
+		}
+		mBufferRaw = buffer;
+		mBufferSize = size;
+	} else if(keep > 0 && start > mBufferPos) {
+		memmove(mBufferRaw, mBufferRaw + (start - mBufferPos), keep);
+	}
+	mBufferPos = start;
+	mBufferLen = keep;
+
+	qint64 readPos = start + keep;
+	qint64 readBytes = readAligned(readPos, mBufferRaw + keep,
+								   (mBufferSize - keep) / INPUT_DIRECT_ALIGN * INPUT_DIRECT_ALIGN);
+	if(readBytes > 0) {
+		g_metrics.add(METRIC_BYTES_READ, readBytes);
+		if(readPos < mReadEnd) {
+			g_metrics.add(METRIC_BYTES_REREAD, qMin(mReadEnd, readPos + readBytes) - readPos);
+		}
+		mReadEnd = qMax(mReadEnd, readPos + readBytes);
+		mBufferLen += readBytes;
+	}
+	if(pos >= mBufferPos + mBufferLen) {
+		return NULL;
+	}
+
+	*len = qMin(mBufferPos + mBufferLen - pos, mWindow);
+	return mBufferRaw + (pos - mBufferPos);
+}
+
+/******************************************************************************
+ *
+ * MEMORY MAPPING
+ *
+ ******************************************************************************/
+RecoverMappedInput::RecoverMappedInput(qint64 maxWindow)
+	: RecoverInput(maxWindow) {
+	mMap = NULL;
+	mReleasedPos = 0;
+}
+
+RecoverMappedInput::~RecoverMappedInput() {
+	close();
+}
+
+bool RecoverMappedInput::open(const QString & filename) {
+	close();
+	mFile.setFileName(filename);
+	if(!mFile.open(QFile::ReadOnly)) {
+		mStatus = QObject::tr("Cannot open file ") + filename;
+		return false;
+	}
+	mSize = input_file_size(mFile);
+	if(mSize <= 0) {
+		// nothing to map, the extractor will report the empty file
+		return true;
+	}
+
+	// May fail for files larger than the address space of 32bit systems
+	mMap = mFile.map(0, mSize);
+	if(!mMap) {
+		mStatus = QObject::tr("Cannot map file ") + filename;
+		mFile.close();
+		return false;
+	}
+	mReleasedPos = 0;
+
+#ifdef Q_OS_UNIX
+	if(madvise(mMap, (size_t)mSize, MADV_SEQUENTIAL) != 0) {
+		MSG_PRINT(LOG_WARNING, "madvise(SEQUENTIAL) failed on %lld bytes", mSize);
+	}
+#endif
+	MSG_PRINT(LOG_DEBUG, "Mapped %lld bytes of '%s'", mSize, qPrintable(filename));
+	return true;
+}
+
+void RecoverMappedInput::close() {
+	if(mMap) {
+		mFile.unmap(mMap);
+		mMap = NULL;
+	}
+	if(mFile.isOpen()) {
+		mFile.close();
+	}
+}
+
+const uint8_t * RecoverMappedInput::window(qint64 pos, qint64 * len, bool force) {
+	Q_UNUSED(force);
+	*len = 0;
+	if(!mMap || pos < 0 || pos >= mSize) {
+		return NULL;
+	}
+	// Same window length as the buffered read, so the same frames are found
+	*len = qMin(mWindow, mSize - pos);
+	return mMap + pos;
+}
+
+void RecoverMappedInput::release(qint64 pos) {
+	if(!mMap || pos - mReleasedPos < INPUT_RELEASE_LEN) {
+		return;
+	}
+	// Whole blocks only, so the address stays aligned on pages
+	qint64 len = (pos - mReleasedPos) / INPUT_RELEASE_LEN * INPUT_RELEASE_LEN;
+#ifdef Q_OS_UNIX
+	if(madvise(mMap + mReleasedPos, (size_t)len, MADV_DONTNEED) != 0) {
+		MSG_PRINT(LOG_DEBUG, "madvise(DONTNEED) failed at %lld", mReleasedPos);
+	}
+#endif
+	mReleasedPos += len;
+}
+
+/******************************************************************************
+ *
+ * STREAM
+ *
+ ******************************************************************************/
+RecoverStreamInput::RecoverStreamInput(qint64 maxWindow)
+	: RecoverInput(maxWindow) {
+	mBufferRaw = NULL;
+	mBufferSize = 0;
+	mBufferPos = 0;
+	mBufferLen = 0;
+	mKeepPos = 0;
+	mEndOfStream = false;
+}
+
+RecoverStreamInput::~RecoverStreamInput() {
+	close();
+}
+
+bool RecoverStreamInput::open(const QString & filename) {
+	close();
+	bool ok = false;
+	if(filename == INPUT_STDIN) {
+		ok = mFile.open(fileno(stdin), QFile::ReadOnly);
+	} else {
+		mFile.setFileName(filename);
+		ok = mFile.open(QFile::ReadOnly);
+	}
+	if(!ok) {
+		mStatus = QObject::tr("Cannot open stream ") + filename;
+		return false;
+	}
+	// Unknown until the end of stream
+	mSize = -1;
+	// A known tag is searched until one window after the last frame, then
+	// the frame may need one more window
+	mBufferSize = 2 * mWindow + INPUT_STREAM_READ_LEN;
+	CPP_ALLOC_ARRAY(mBufferRaw, uint8_t, mBufferSize);
+	mBufferPos = 0;
+	mBufferLen = 0;
+	mKeepPos = 0;
+	mEndOfStream = false;
+	return true;
+}
+
+void RecoverStreamInput::close() {
+	CPP_DELETE_ARRAY(mBufferRaw);
+	mBufferRaw = NULL;
+	mBufferSize = 0;
+	mBufferLen = 0;
+	if(mFile.isOpen()) {
+		mFile.close();
+	}
+}
+
+void RecoverStreamInput::resizeBuffer(qint64 size) {
+	if(mBufferSize >= size) {
+		return;
+	}
+	uint8_t * buffer = NULL;
+	CPP_ALLOC_ARRAY(buffer, uint8_t, size);
+	memcpy(buffer, mBufferRaw, mBufferLen);
+	CPP_DELETE_ARRAY(mBufferRaw);
+	mBufferRaw = buffer;
+	mBufferSize = size;
+}
+
+bool RecoverStreamInput::readMore(qint64 pos) {
+	// Slide the buffer only when it is full, so each byte is moved rarely,
+	// or when all of it is released, to skip data up to a later position
+	qint64 keep = qMin(mKeepPos, pos);
+	if((mBufferLen + INPUT_STREAM_READ_LEN > mBufferSize || keep >= mBufferPos + mBufferLen)
+			&& keep > mBufferPos) {
+		qint64 drop = qMin(keep - mBufferPos, mBufferLen);
+		memmove(mBufferRaw, mBufferRaw + drop, mBufferLen - drop);
+		mBufferPos += drop;
+		mBufferLen -= drop;
+	}
+
+	// A search of the known tag may keep more than two windows
+	qint64 maxSize = 2 * mMaxWindow + INPUT_STREAM_READ_LEN;
+	if(mBufferLen + INPUT_STREAM_READ_LEN > mBufferSize && mBufferSize < maxSize) {
+		resizeBuffer(qMin(2 * mBufferSize, maxSize));
+	}
+	qint64 room = qMin(mBufferSize - mBufferLen, (qint64)INPUT_STREAM_READ_LEN);
+	if(room <= 0) {
+		mStatus = QObject::tr("Stream buffer is full at ") + QString::number(mBufferPos + mBufferLen);
+		MSG_PRINT(LOG_ERROR, "Stream buffer is full: kept from %lld, requested %lld",
+				  mBufferPos, pos);
+		return false;
+	}
+
+	qint64 readBytes = readBlock(mBufferRaw + mBufferLen, room);
+	if(readBytes < 0) {
+		mStatus = QObject::tr("Read failed in stream at ") + QString::number(mBufferPos + mBufferLen);
+		return false;
+	}
+	if(readBytes == 0) {
+		mEndOfStream = true;
+		mSize = mBufferPos + mBufferLen;
+		MSG_PRINT(LOG_DEBUG, "End of stream after %lld bytes", mSize);
+		return false;
+	}
+	mBufferLen += readBytes;
+	return true;
+}
+
+const uint8_t * RecoverStreamInput::window(qint64 pos, qint64 * len, bool force) {
+	*len = 0;
+	if(!mBufferRaw) {
+		return NULL;
+	}
+	// Resume from the journal, jumps of the index, or extraction of a range
+	if((pos < mBufferPos || pos > mBufferPos + mBufferLen)
+			&& restartAt(pos, mBufferPos + mBufferLen)) {
+		mBufferPos = pos;
+		mBufferLen = 0;
+		mKeepPos = pos;
+		mEndOfStream = false;
+	}
+	if(pos < mBufferPos) {
+		mStatus = QObject::tr("Cannot go back in stream at ") + QString::number(pos);
+		MSG_PRINT(LOG_ERROR, "Cannot go back in stream to %lld, data kept from %lld",
+				  pos, mBufferPos);
+		return NULL;
+	}
+	resizeBuffer(2 * mWindow + INPUT_STREAM_READ_LEN);
+
+	// With force, the previous window was too short for a frame
+	qint64 wanted = force ? mBufferPos + mBufferLen - pos + 1
+						  : qMax((qint64)INPUT_STREAM_READ_LEN, mWindowHint);
+	wanted = qMin(wanted, mWindow);
+	while(mBufferPos + mBufferLen - pos < wanted) {
+		if(!readMore(pos)) {
+			if(!mEndOfStream) {
+				return NULL;
+			}
+			break;
+		}
+	}
+
+	qint64 remaining = mBufferPos + mBufferLen - pos;
+	if(remaining <= 0) {
+		return NULL;
+	}
+	*len = qMin(remaining, mWindow);
+	return mBufferRaw + (pos - mBufferPos);
+}
+
+void RecoverStreamInput::release(qint64 pos) {
+	if(pos > mKeepPos) {
+		mKeepPos = pos;
+	}
+}
+
+bool RecoverStreamInput::atEnd(qint64 pos) {
+	return mEndOfStream && pos >= mBufferPos + mBufferLen;
+}
+
+qint64 RecoverStreamInput::readBlock(uint8_t * data, qint64 len) {
+	RecoverMetricsTimer timer(TIMER_READ);
+	qint64 readBytes = mFile.read((char *)data, len);
+	if(readBytes > 0) {
+		g_metrics.add(METRIC_BYTES_READ, readBytes);
+	}
+	return readBytes;
+}
+
+/******************************************************************************
+ *
+ * READ AHEAD
+ *
+ ******************************************************************************/
+/*! \brief Job reading the blocks */
+class RecoverPrefetchJob : public QRunnable {
+public:
+	RecoverPrefetchJob(RecoverPrefetchInput * input) : mInput(input) {}
+	void run() { mInput->runReader(); }
+private:
+	RecoverPrefetchInput * mInput;
+};
+
+RecoverPrefetchInput::RecoverPrefetchInput(qint64 maxWindow)
+	: RecoverStreamInput(maxWindow) {
+	mFilled = NULL;
+	mFreeBlocks = NULL;
+	mCurrent.data = NULL;
+	mCurrent.len = 0;
+	mCurrentPos = 0;
+	mReaderEnd = false;
+	mSeekable = false;
+	mStop.store(0);
+	mPool.setMaxThreadCount(1);
+}
+
+RecoverPrefetchInput::~RecoverPrefetchInput() {
+	close();
+}
+
+bool RecoverPrefetchInput::open(const QString & filename) {
+	close();
+	if(!RecoverStreamInput::open(filename)) {
+		return false;
+	}
+	// Only the size of pipes is unknown until their end
+	mSeekable = !input_is_stream(filename);
+	if(mSeekable) {
+		mSize = input_file_size(mFile);
+	}
+
+	for(int i = 0; i < INPUT_PREFETCH_BLOCKS; i++) {
+		uint8_t * block = NULL;
+		CPP_ALLOC_ARRAY(block, uint8_t, INPUT_PREFETCH_BLOCK_LEN);
+		mBlocks.append(block);
+	}
+	// Started by the first read, so a resume doesn't read from the start
+	mCurrent.data = NULL;
+	mCurrentPos = 0;
+	mReaderEnd = false;
+	return true;
+}
+
+void RecoverPrefetchInput::close() {
+	stopReader();
+	for(int i = 0; i < mBlocks.size(); i++) {
+		CPP_DELETE_ARRAY(mBlocks[i]);
+	}
+	mBlocks.clear();
+	RecoverStreamInput::close();
+}
+
+void RecoverPrefetchInput::startReader() {
+	CPP_ALLOC(mFilled, RecoverQueue<t_input_block>(INPUT_PREFETCH_BLOCKS));
+	// One more place for the stop request
+	CPP_ALLOC(mFreeBlocks, RecoverQueue<uint8_t *>(INPUT_PREFETCH_BLOCKS + 1));
+	for(int i = 0; i < mBlocks.size(); i++) {
+		mFreeBlocks->push(mBlocks[i]);
+	}
+	mCurrent.data = NULL;
+	mCurrentPos = 0;
+	mReaderEnd = false;
+	mStop.store(0);
+	mPool.start(new RecoverPrefetchJob(this));
+}
+
+void RecoverPrefetchInput::stopReader() {
+	if(mFilled) {
+		// Wake the reader up, whether it waits for a free block or a free place
+		mStop.store(1);
+		mFreeBlocks->push(NULL);
+		t_input_block block;
+		do {
+			while(mFilled->tryPop(&block)) {}
+		} while(!mPool.waitForDone(10));
+
+		CPP_DELETE(mFilled);
+		mFilled = NULL;
+		CPP_DELETE(mFreeBlocks);
+		mFreeBlocks = NULL;
+	}
+	mCurrent.data = NULL;
+}
+
+bool RecoverPrefetchInput::restartAt(qint64 pos, qint64 end) {
+	if(!mSeekable) {
+		return false;
+	}
+	// The reader may already have these bytes in its blocks
+	if(mFilled && pos > end && pos - end < (qint64)INPUT_PREFETCH_BLOCKS * INPUT_PREFETCH_BLOCK_LEN) {
+		return false;
+	}
+	stopReader();
+	if(!mFile.seek(pos)) {
+		MSG_PRINT(LOG_ERROR, "Cannot seek at %lld in '%s'", pos, qPrintable(mFile.fileName()));
+		return false;
+	}
+	MSG_PRINT(LOG_DEBUG, "Reading ahead from %lld instead of %lld", pos, end);
+	return true;
+}
+
+void RecoverPrefetchInput::runReader() {
+	while(true) {
+		uint8_t * data = mFreeBlocks->pop();
+		if(!data || mStop.load()) {
+			return;
+		}
+		t_input_block block;
+		block.data = data;
+		{
+			RecoverMetricsTimer timer(TIMER_READ);
+			block.len = mFile.read((char *)data, INPUT_PREFETCH_BLOCK_LEN);
+		}
+		if(block.len > 0) {
+			g_metrics.add(METRIC_BYTES_READ, block.len);
+		}
+		mFilled->push(block);
+		if(block.len <= 0) {
+			return;
+		}
+	}
+}
+
+qint64 RecoverPrefetchInput::readBlock(uint8_t * data, qint64 len) {
+	if(!mFilled) {
+		startReader();
+	}
+	if(!mCurrent.data || mCurrentPos >= mCurrent.len) {
+		if(mReaderEnd) {
+			return mCurrent.len;
+		}
+		if(mCurrent.data) {
+			mFreeBlocks->push(mCurrent.data);
+		}
+		// Wait here only if the reader is slower than the scanner
+		mCurrent = mFilled->pop();
+		mCurrentPos = 0;
+		if(mCurrent.len <= 0) {
+			mReaderEnd = true;
+			return mCurrent.len;
+		}
+	}
+	qint64 copied = qMin(len, mCurrent.len - mCurrentPos);
+	memcpy(data, mCurrent.data + mCurrentPos, copied);
+	mCurrentPos += copied;
+	return copied;
+}
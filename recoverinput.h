@@ -0,0 +1,350 @@
+/*! \file recoverinput.h
+ * \brief Access to the bytes of the broken file
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The extractor scans windows of the input. The windows are either read in
+ * a buffer, or pointers in a memory mapping of the whole file, so the
+ * frames can be scanned and written without any copy, or parts of a stream
+ * which is read only once, for pipes and stdin. The stream may also be read
+ * ahead by another thread, so the reads overlap the scan. Block devices and
+ * disk images may be read in large aligned chunks without the page cache.
+ * The windows start small and grow when a frame doesn't fit, up to the
+ * longest frame accepted, so the memory follows the size of the frames.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERINPUT_H
+#define RECOVERINPUT_H
+
+#include <QFile>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include <QAtomicInteger>
+#include <stdint.h>
+
+#include "recoverqueue.h"
+
+/*! \brief How the input file is accessed */
+typedef enum {
+	INPUT_READ,		///< read() in a buffer
+	INPUT_MMAP,		///< whole file mapped in memory
+	INPUT_STREAM,	///< pipe or stdin, read once without seeking
+	INPUT_PREFETCH,	///< file or stream, read ahead by another thread
+	INPUT_DIRECT,	///< device or disk image, aligned reads bypassing the page cache
+	INPUT_MAX
+} te_input_mode;
+
+/// \brief Name of the input mode, for logs
+const char * input_mode_name(int mode);
+
+/// \brief Return true if the input can't be seeked: stdin, pipe or socket
+bool input_is_stream(const QString & filename);
+
+/// \brief Return true if the input is a block or character device, like a whole SD card
+bool input_is_device(const QString & filename);
+
+/// \brief Size of an open file, also for the devices, whose file size is 0
+qint64 input_file_size(QFile & file);
+
+/// Data before the position are released from memory by blocks of this size
+#define INPUT_RELEASE_LEN	(64*1024*1024)
+
+/// File name of the standard input
+#define INPUT_STDIN		"-"
+
+/// Size of each read in a stream, so the frames are found without waiting for more data
+#define INPUT_STREAM_READ_LEN	(256*1024)
+
+/// Size of the blocks read ahead in INPUT_PREFETCH mode
+#define INPUT_PREFETCH_BLOCK_LEN	(1024*1024)
+
+/// Number of blocks read ahead, then the reader waits for the scanner
+#define INPUT_PREFETCH_BLOCKS	16
+
+/// Size of the reads of the direct input, so the device is read at full speed
+#define INPUT_DIRECT_READ_LEN	(8*1024*1024)
+
+/// Alignment of the direct reads and of their buffer, a multiple of the sectors
+#define INPUT_DIRECT_ALIGN	4096
+
+/// Initial length of the windows, they grow for the larger frames
+#define INPUT_INITIAL_WINDOW	(1024*1024)
+
+/// Search limit meaning until the end of input
+#define INPUT_NO_LIMIT	Q_INT64_C(0x7FFFFFFFFFFFFFFF)
+
+/*! \brief Input of the extractor */
+class RecoverInput {
+public:
+	RecoverInput(qint64 maxWindow);
+	virtual ~RecoverInput();
+
+	/*! \brief Create the input for mode
+	 * \param maxWindow max length of the windows, so the longest frame
+	 */
+	static RecoverInput * create(te_input_mode mode, qint64 maxWindow);
+
+	/// \brief Open file, false on error with getStatus()
+	virtual bool open(const QString & filename) = 0;
+
+	/// \brief Close file and release memory
+	virtual void close() = 0;
+
+	/*! \brief Get a window of the file starting at pos
+	 * \param pos position in file
+	 * \param len returned number of bytes available in window, at most windowLength()
+	 * \param force true to read more than the previous window at pos
+	 * \return pointer on the data at pos, valid until next call, NULL if read failed
+	 */
+	virtual const uint8_t * window(qint64 pos, qint64 * len, bool force) = 0;
+
+	/// \brief Hint: the data before pos won't be used anymore
+	virtual void release(qint64 pos) { Q_UNUSED(pos); }
+
+	/*! \brief Hint: bytes needed at the start of the next windows, 0 if unknown
+	 * The buffered inputs read again, or wait for more data, only when less
+	 * is available, instead of half the max window for the files and
+	 * INPUT_STREAM_READ_LEN for the streams.
+	 */
+	void setWindowHint(qint64 len) { mWindowHint = len; }
+
+	/// \brief Return true if there is no data at pos and after
+	virtual bool atEnd(qint64 pos) { return pos >= mSize; }
+
+	/// \brief Access mode
+	virtual te_input_mode mode() = 0;
+
+	/// \brief Number of blocks read ahead and not scanned yet, for statistics
+	virtual int queueDepth() { return 0; }
+
+	/// \brief Size of input file, -1 while the end of a stream is not reached
+	qint64 size() { return mSize; }
+
+	/// \brief Max length of the windows
+	qint64 maxWindow() { return mMaxWindow; }
+
+	/// \brief Current length of the windows, from INPUT_INITIAL_WINDOW to maxWindow()
+	qint64 windowLength() { return mWindow; }
+
+	/*! \brief Grow the windows for a frame which doesn't fit, the buffers follow at next window()
+	 * \param len length needed, the windows at least double
+	 * \return false if they already have the max length
+	 */
+	bool growWindow(qint64 len);
+
+	/// \brief Get error string
+	QString getStatus() { return mStatus; }
+
+protected:
+	QString mStatus;		///< Error
+	QFile mFile;			///< Input file
+	qint64 mSize;			///< Size of file
+	qint64 mMaxWindow;		///< Max length of windows
+	qint64 mWindow;			///< Current length of windows
+	qint64 mWindowHint;		///< Bytes needed at the start of windows, 0 if unknown
+};
+
+/*! \brief Input read in a buffer
+ * The bytes of the buffer from the requested position are kept and only
+ * the rest of the window is read, so the file is read once when the
+ * windows move forward.
+ */
+class RecoverReadInput : public RecoverInput {
+public:
+	RecoverReadInput(qint64 maxWindow);
+	~RecoverReadInput();
+
+	bool open(const QString & filename);
+	void close();
+
+	/*! \brief Get a window of the file starting at pos
+	 * The buffer is filled only if pos is not already in buffer, or if
+	 * the remaining part is too short, or if force is true.
+	 */
+	const uint8_t * window(qint64 pos, qint64 * len, bool force);
+	te_input_mode mode() { return INPUT_READ; }
+
+private:
+	uint8_t * mBufferRaw;	///< Reading buffer
+	qint64 mBufferSize;		///< Allocated size of mBufferRaw, the window length
+	qint64 mBufferPos;		///< Position in file of the first byte of mBufferRaw
+	qint64 mBufferLen;		///< Number of valid bytes in mBufferRaw
+	qint64 mReadEnd;		///< End of the furthest read, the bytes before are read again
+};
+
+/*! \brief Input mapped in memory
+ * The windows point in the mapping, and the kernel is told the file is
+ * read sequentially, then that the pages before the position are not
+ * needed anymore, so the resident memory stays low on large files.
+ */
+class RecoverMappedInput : public RecoverInput {
+public:
+	RecoverMappedInput(qint64 maxWindow);
+	~RecoverMappedInput();
+
+	bool open(const QString & filename);
+	void close();
+	const uint8_t * window(qint64 pos, qint64 * len, bool force);
+	void release(qint64 pos);
+	te_input_mode mode() { return INPUT_MMAP; }
+
+	/// \brief Whole file, for the direct access of the parallel extractor
+	const uint8_t * data() { return mMap; }
+
+private:
+	uint8_t * mMap;			///< Mapping of the whole file
+	qint64 mReleasedPos;	///< Data before are released
+};
+
+/*! \brief Input read once from a stream
+ * The data from the last released position are kept in a buffer of fixed
+ * size, which slides when it is full, so the memory doesn't depend on the
+ * length of the stream. The data before the released position are lost, so
+ * the windows must be requested at increasing positions.
+ */
+class RecoverStreamInput : public RecoverInput {
+public:
+	RecoverStreamInput(qint64 maxWindow);
+	~RecoverStreamInput();
+
+	bool open(const QString & filename);
+	void close();
+
+	/*! \brief Get a window of the stream starting at pos
+	 * The stream is read until INPUT_STREAM_READ_LEN bytes are available at
+	 * pos, or with force, until more bytes than the previous window. A file
+	 * may restart its reads at pos, before the data kept or far after it.
+	 */
+	const uint8_t * window(qint64 pos, qint64 * len, bool force);
+	void release(qint64 pos);
+	bool atEnd(qint64 pos);
+	te_input_mode mode() { return INPUT_STREAM; }
+
+protected:
+	/*! \brief Read the next bytes of the stream
+	 * \return number of bytes read, 0 at end of stream, -1 on error
+	 */
+	virtual qint64 readBlock(uint8_t * data, qint64 len);
+
+	/*! \brief Read the next blocks from pos, instead of the end of the data kept
+	 * \param end end of the data kept
+	 * \return false to go on reading the stream, as a pipe can only
+	 */
+	virtual bool restartAt(qint64 pos, qint64 end) { Q_UNUSED(pos); Q_UNUSED(end); return false; }
+
+private:
+	/*! \brief Read one more block, after moving the kept data at start of buffer if needed
+	 * \return false at end of stream or on error
+	 */
+	bool readMore(qint64 pos);
+
+	/// \brief Enlarge the buffer to size, keeping its data
+	void resizeBuffer(qint64 size);
+
+	uint8_t * mBufferRaw;	///< Reading buffer
+	qint64 mBufferSize;		///< Allocated size of mBufferRaw
+	qint64 mBufferPos;		///< Position in stream of the first byte of mBufferRaw
+	qint64 mBufferLen;		///< Number of valid bytes in mBufferRaw
+	qint64 mKeepPos;		///< Data before may be discarded
+	bool mEndOfStream;		///< Read returned end of stream
+};
+
+/*! \brief Input read in large aligned chunks, with O_DIRECT when available
+ * Whole SD cards or their images are read once, at the bandwidth of the
+ * device, without filling the page cache with data which is never read
+ * again. The windows are kept from the sector of the requested position,
+ * so every read starts and ends on a sector. Where O_DIRECT is refused, by
+ * the file system or the platform, the pages read are dropped from the cache.
+ */
+class RecoverDirectInput : public RecoverInput {
+public:
+	RecoverDirectInput(qint64 maxWindow);
+	~RecoverDirectInput();
+
+	bool open(const QString & filename);
+	void close();
+	const uint8_t * window(qint64 pos, qint64 * len, bool force);
+	te_input_mode mode() { return INPUT_DIRECT; }
+
+private:
+	/*! \brief Read at the aligned position pos, in the aligned data
+	 * \return number of bytes read, less than len at the end of file, -1 on error
+	 */
+	qint64 readAligned(qint64 pos, uint8_t * data, qint64 len);
+
+	QString mFilename;		///< Input file, to open it again without O_DIRECT
+
+	uint8_t * mBufferRaw;	///< Reading buffer, aligned on INPUT_DIRECT_ALIGN
+	qint64 mBufferSize;		///< Allocated size of mBufferRaw
+	qint64 mBufferPos;		///< Position in file of the first byte of mBufferRaw, aligned
+	qint64 mBufferLen;		///< Number of valid bytes in mBufferRaw
+	qint64 mReadEnd;		///< End of the furthest read, the bytes before are read again
+	bool mDirect;			///< Opened with O_DIRECT, else the cache is dropped after the reads
+};
+
+/*! \brief Block read ahead */
+typedef struct {
+	uint8_t * data;		///< Data of the block, from the pool of blocks
+	qint64 len;			///< Bytes read, 0 at end of stream, -1 on error
+} t_input_block;
+
+/*! \brief Input read ahead by another thread
+ * A reader job reads the file or the stream in blocks, which are queued
+ * until the scanner needs them, so the disk is read while the frames are
+ * searched. The blocks are recycled, so the memory is fixed.
+ */
+class RecoverPrefetchInput : public RecoverStreamInput {
+public:
+	RecoverPrefetchInput(qint64 maxWindow);
+	~RecoverPrefetchInput();
+
+	bool open(const QString & filename);
+	void close();
+	te_input_mode mode() { return INPUT_PREFETCH; }
+	int queueDepth() { return mFilled ? mFilled->depth() : 0; }
+
+	/// \brief Read blocks until the end of file or close(), called by the reader job
+	void runReader();
+
+protected:
+	/// \brief Copy the next bytes from the queued blocks, the reader starts at the first call
+	qint64 readBlock(uint8_t * data, qint64 len);
+
+	/*! \brief Stop the reader and read again from pos, for the jumps in files
+	 * A jump forward shorter than the blocks read ahead goes on reading.
+	 */
+	bool restartAt(qint64 pos, qint64 end);
+
+private:
+	/// \brief Start the reader job at the current position of the file
+	void startReader();
+
+	/// \brief Stop the reader job and drop the blocks it has read
+	void stopReader();
+
+	QThreadPool mPool;						///< Thread of the reader
+	RecoverQueue<t_input_block> * mFilled;	///< Blocks read, in order
+	RecoverQueue<uint8_t *> * mFreeBlocks;	///< Blocks to read in, NULL to stop the reader
+	QVector<uint8_t *> mBlocks;				///< All the blocks
+	t_input_block mCurrent;					///< Block being copied in the stream buffer
+	qint64 mCurrentPos;						///< Bytes of mCurrent already copied
+	bool mReaderEnd;						///< Last block has been received
+	bool mSeekable;							///< File, not a pipe
+	QAtomicInteger<int> mStop;				///< Stop the reader
+};
+
+#endif // RECOVERINPUT_H
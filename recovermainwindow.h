@@ -23,151 +23,17 @@
 #define RECOVERMAINWINDOW_H
 
 #include <QMainWindow>
-#include <QFile>
-#include <QDir>
 #include <QString>
+#include <QThread>
 #include <QImage>
 
+#include "recoverextractor.h"
+#include "recoverworker.h"
+
 namespace Ui {
 class RecoverMainWindow;
 }
 
-/*! \brief Log level */
-typedef enum {
-	LOG_CRITICAL,
-	LOG_ERROR,
-	LOG_WARNING,
-	LOG_INFO,
-	LOG_DEBUG,
-	LOG_TRACE,
-	LOG_MAX
-} te_log_level;
-
-const char * log_descr(int lvl);
-
-extern te_log_level g_log_level;
-#define MSG_PRINT(_lvl, ...)	do { if((_lvl) <= g_log_level) { \
-									fprintf(stdout, "[%s] %s:%d: ", log_descr((_lvl)), __func__, __LINE__); \
-									fprintf(stdout, __VA_ARGS__); fprintf(stdout, "\n"); fflush(stdout); \
-								}} while(0)
-
-/* MEMORY ALLOCATIONS MACROS */
-#define CPP_ALLOC(_var, _type)	(_var) = new _type; \
-								registerAlloc(__FILE__, __func__, __LINE__, \
-									(void*)(_var), sizeof((_type)));
-#define REGISTER_ALLOC(_var, _size)	registerAlloc(__FILE__, __func__, __LINE__, \
-									(void*)(_var), (_size));
-#define CPP_ALLOC_ARRAY(_var, _type, _size)	(_var) = new _type [ (_size) ]; \
-								registerAlloc(__FILE__, __func__, __LINE__, \
-									(void*)(_var), sizeof(_type) * ((_size)));
-#define REGISTER_ALLOC_ARRAY(_var, _size)	registerAlloc(__FILE__, __func__, __LINE__, \
-									(void*)(_var), (_size));
-#define CPP_DELETE(_var)		registerDelete(__FILE__, __func__, __LINE__, \
-										(void*)(_var)); \
-								if((_var)) { delete (_var); }
-#define CPP_DELETE_ARRAY(_var)		registerDelete(__FILE__, __func__, __LINE__, \
-										(void*)(_var)); \
-								if((_var)) { delete [] (_var); }
-#define REGISTER_DELETE(_var, _size)	registerDelete(__FILE__, __func__, __LINE__, \
-									(void*)(_var), (_size));
-
-/*! \brief Track memory allocations */
-void registerAlloc(const char * file, const char *func, int line,
-				   void * buf, size_t size);
-
-/*! \brief Track memory delete */
-void registerDelete(const char * file, const char *func, int line,
-				   void * buf);
-
-
-/// Max jpeg length for 4K on DxO One
-#define MAX_JPEG_LEN 7000000
-
-
-/*! \brief Extractor class to extract data from the file */
-class RecoverExtractor : public QObject {
-	Q_OBJECT
-public:
-	RecoverExtractor();
-	~RecoverExtractor();
-
-	/// \brief Set MOV input file name
-	void setFilename(const QString & filename);
-
-	/// \brief Extract one frame
-	bool extract();
-
-	/// \brief Get status string
-	QString getStatus() { return mStatus; }
-
-	/// \brief Get progress in %
-	int getProgress() { return mProgress; }
-
-	QImage getImage() { return mLoadImage; }
-
-private:
-	void init();
-	void purge();
-
-	/// \brief Current file name
-	QString mFilename;
-
-	/// \brief Current directory
-	QDir mDir;
-
-	/// \brief Current status
-	QString mStatus;
-
-	/// \brief Last position in file, for reading next frame
-    qint64 mLastPosition;
-
-	/// \brief Progress in %
-	int mProgress;
-
-	/// \brief Index of recovered imafe
-	int mImageIndex;
-
-	/// \brief Hint of image minimal size (3/4 of first frame)
-	int mImageSize;
-
-	/// \brief Reading buffer
-	uint8_t * mBufferRaw;
-
-	/*! \brief Double buffer for the raw JPEG
-		We need to store the buffer because we need to find the next image
-		before saving the original JPEG file.
-	  */
-	uint8_t * mDoubleJpegBuffer[2];
-
-	/*! \brief Size of the block copied at last iteration */
-	int mDoubleJpegBufferSize[2];
-
-	/*! \brief Last size of the jpeg, used to save at end of file */
-	int mDoubleJpegBufferLastSize;
-
-
-	/*! \brief Size of the previous file pointer increment at last iteration */
-	int mDoubleJpegBufferIncrement[2];
-	/*! \brief JPEG position in buffer */
-	int mDoubleJpegBufferFoundAt[2];
-
-	/// \brief Index of the current buffer
-	int mDoubleJpegBufferIndex;
-
-	/// \brief Size of buffer read iteration
-	int mBufferMaxLen;
-
-	/*! \brief Save the image in buffer */
-	int savePreviousImage();
-
-	QFile mFile;		///< Current file, once open
-	uint8_t mTag[5];	///< 4 first chars of the searched JPEG buffer
-	uint32_t mTag32;	///< unsigned int 32bit version of the \see tag
-
-	QImage mLoadImage;	///< Last read image
-};
-
-
 /*! \brief Main program header */
 class RecoverMainWindow : public QMainWindow
 {
@@ -177,16 +43,34 @@ public:
 	explicit RecoverMainWindow(QWidget *parent = 0);
 	~RecoverMainWindow();
 
+signals:
+	/// \brief Start the worker, in its thread
+	void extractRequested();
+
 private slots:
 	void on_openButton_clicked();
 	void on_stepButton_clicked();
+	void on_pauseButton_toggled(bool checked);
+	void on_cancelButton_clicked();
+	void on_goOnCheckBox_toggled(bool checked);
+
+	void onProgress(int percent, const QString & status, int frames);
+	void onPreview(const QImage & image);
+	void onFinished(bool ok, const QString & status);
 
 private:
 	Ui::RecoverMainWindow *ui;
 	void loadSettings();
 	void saveSettings();
 
+	/// \brief Enable the buttons for a running or stopped extraction
+	void setRunning(bool running);
+
 	RecoverExtractor mRecoverExtractor;
+	/// \brief Thread of the extraction
+	QThread mThread;
+	/// \brief Runs mRecoverExtractor in mThread
+	RecoverWorker * mWorker;
 	/// \brief Path of last directory
 	QString mLastDir;
 };
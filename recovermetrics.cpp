@@ -0,0 +1,194 @@
+/*! \file recovermetrics.cpp
+ * \brief Counters and timers of the extraction stages
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recovermetrics.h"
+#include "recoverextractor.h"
+
+#include <QSaveFile>
+
+/// \brief Metrics of the process
+RecoverMetrics g_metrics;
+
+const char * c_metric_names[METRIC_MAX] = {
+	"bytes_read",
+	"bytes_reread",
+	"bytes_scanned",
+	"candidates",
+	"broken_candidates",
+	"indexed_frames",
+	"fallback_scans",
+	"frames",
+	"decoded",
+	"decode_failures",
+	"images_written",
+	"bytes_written"
+};
+
+/// \brief Description of the counters, for the Prometheus HELP lines
+const char * c_metric_help[METRIC_MAX] = {
+	"Bytes read from the input file",
+	"Bytes read again as windows and ranges overlap",
+	"Bytes searched for a SOI or the known tag",
+	"Positions parsed as a JPEG frame",
+	"Candidates which are not a complete JPEG frame",
+	"Frames given by the index of the container",
+	"Searches of the known tag reverted to every SOI",
+	"Frames found",
+	"Frames decoded by the validation",
+	"Complete frames which could not be decoded",
+	"Images written",
+	"Bytes of the images written"
+};
+
+const char * metric_name(int metric) {
+	if(metric < 0 || metric >= METRIC_MAX) {
+		return "invalid";
+	}
+	return c_metric_names[metric];
+}
+
+const char * c_metric_timer_names[TIMER_MAX] = {
+	"read",
+	"decode",
+	"write"
+};
+
+const char * metric_timer_name(int timer) {
+	if(timer < 0 || timer >= TIMER_MAX) {
+		return "invalid";
+	}
+	return c_metric_timer_names[timer];
+}
+
+const char * c_metrics_format_names[METRICS_FORMAT_MAX] = {
+	"json",
+	"prometheus"
+};
+
+const char * metrics_format_name(int format) {
+	if(format < 0 || format >= METRICS_FORMAT_MAX) {
+		return "invalid";
+	}
+	return c_metrics_format_names[format];
+}
+
+/// \brief Seconds from ns, with the precision of the dumps
+static QString metrics_seconds(qint64 nsecs) {
+	return QString::number((double)nsecs / 1e9, 'f', 6);
+}
+
+RecoverMetrics::RecoverMetrics() {
+	mFormat = METRICS_JSON;
+	mPeriod = METRICS_DEFAULT_PERIOD * 1000;
+	reset();
+}
+
+void RecoverMetrics::reset() {
+	for(int i = 0; i < METRIC_MAX; i++) {
+		mCounters[i].store(0);
+	}
+	for(int i = 0; i < TIMER_MAX; i++) {
+		mTimerCount[i].store(0);
+		mTimerTotal[i].store(0);
+		mTimerMax[i].store(0);
+	}
+	mElapsed.start();
+	mLastWrite = 0;
+}
+
+void RecoverMetrics::addTime(te_metric_timer timer, qint64 nsecs) {
+	mTimerCount[timer].fetchAndAddRelaxed(1);
+	mTimerTotal[timer].fetchAndAddRelaxed(nsecs);
+	qint64 max = mTimerMax[timer].load();
+	while(nsecs > max && !mTimerMax[timer].testAndSetRelaxed(max, nsecs)) {
+		max = mTimerMax[timer].load();
+	}
+}
+
+QString RecoverMetrics::toJson() {
+	QString json = "{\n\t\"elapsed_seconds\": " + metrics_seconds(mElapsed.nsecsElapsed());
+	json += ",\n\t\"counters\": {";
+	for(int i = 0; i < METRIC_MAX; i++) {
+		json += QString(i > 0 ? ",\n\t\t\"" : "\n\t\t\"") + c_metric_names[i] + "\": "
+				+ QString::number(mCounters[i].load());
+	}
+	json += "\n\t},\n\t\"timers\": {";
+	for(int i = 0; i < TIMER_MAX; i++) {
+		json += QString(i > 0 ? ",\n\t\t\"" : "\n\t\t\"") + c_metric_timer_names[i] + "\": {"
+				+ "\"count\": " + QString::number(mTimerCount[i].load())
+				+ ", \"total_seconds\": " + metrics_seconds(mTimerTotal[i].load())
+				+ ", \"max_seconds\": " + metrics_seconds(mTimerMax[i].load())
+				+ "}";
+	}
+	json += "\n\t}\n}\n";
+	return json;
+}
+
+QString RecoverMetrics::toPrometheus() {
+	QString prefix(METRICS_PROMETHEUS_PREFIX);
+	QString text;
+	for(int i = 0; i < METRIC_MAX; i++) {
+		QString name = prefix + c_metric_names[i] + "_total";
+		text += "# HELP " + name + " " + c_metric_help[i] + "\n"
+				+ "# TYPE " + name + " counter\n"
+				+ name + " " + QString::number(mCounters[i].load()) + "\n";
+	}
+	for(int i = 0; i < TIMER_MAX; i++) {
+		QString name = prefix + c_metric_timer_names[i] + "_seconds";
+		text += "# TYPE " + name + " summary\n"
+				+ name + "_count " + QString::number(mTimerCount[i].load()) + "\n"
+				+ name + "_sum " + metrics_seconds(mTimerTotal[i].load()) + "\n"
+				+ "# TYPE " + name + "_max gauge\n"
+				+ name + "_max " + metrics_seconds(mTimerMax[i].load()) + "\n";
+	}
+	text += "# TYPE " + prefix + "elapsed_seconds gauge\n"
+			+ prefix + "elapsed_seconds " + metrics_seconds(mElapsed.nsecsElapsed()) + "\n";
+	return text;
+}
+
+void RecoverMetrics::setOutput(const QString & path, te_metrics_format format, qint64 period_ms) {
+	mPath = path;
+	mFormat = format;
+	mPeriod = period_ms;
+	mLastWrite = mElapsed.elapsed();
+}
+
+bool RecoverMetrics::update() {
+	if(mPath.isEmpty() || mPeriod <= 0 || mElapsed.elapsed() - mLastWrite < mPeriod) {
+		return true;
+	}
+	return write();
+}
+
+bool RecoverMetrics::write() {
+	if(mPath.isEmpty()) {
+		return true;
+	}
+	mLastWrite = mElapsed.elapsed();
+	// Replaced atomically, so a collector never reads half a dump
+	QByteArray data = (mFormat == METRICS_PROMETHEUS ? toPrometheus() : toJson()).toUtf8();
+	QSaveFile file(mPath);
+	if(!file.open(QIODevice::WriteOnly)
+			|| file.write(data) != data.size()
+			|| !file.commit()) {
+		mStatus = QObject::tr("Cannot write metrics ") + mPath;
+		MSG_PRINT(LOG_ERROR, "Cannot write metrics in '%s'", qPrintable(mPath));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,157 @@
+/*! \file recovermetrics.h
+ * \brief Counters and timers of the extraction stages
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Each stage adds to global atomic counters: the input counts the bytes it
+ * reads, the scan the candidates it parses, the validation the frames it
+ * decodes and the writers the time of each image. The counters are dumped
+ * in JSON or in the Prometheus text format, periodically and at exit, so
+ * they can be compared between runs or collected by a node exporter.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERMETRICS_H
+#define RECOVERMETRICS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QString>
+
+/*! \brief Counters */
+typedef enum {
+	METRIC_BYTES_READ,			///< bytes read from the input file, nothing with the mapping
+	METRIC_BYTES_REREAD,		///< bytes read again, as windows and ranges overlap
+	METRIC_BYTES_SCANNED,		///< bytes searched for a SOI or the known tag
+	METRIC_CANDIDATES,			///< SOI, tag or indexed positions parsed as a JPEG
+	METRIC_BROKEN_CANDIDATES,	///< candidates which are not a complete JPEG
+	METRIC_INDEXED_FRAMES,		///< frames given by the index of the container
+	METRIC_FALLBACK_SCANS,		///< known tag not found, search reverted to every SOI
+	METRIC_FRAMES,				///< frames found
+	METRIC_DECODED,				///< frames decoded by the validation
+	METRIC_DECODE_FAILURES,		///< complete frames which don't decode: false positives
+	METRIC_IMAGES_WRITTEN,		///< images written, in files or in a movie or archive
+	METRIC_BYTES_WRITTEN,		///< bytes of the images written
+	METRIC_MAX
+} te_metric;
+
+/// \brief Name of the counter, for the dumps
+const char * metric_name(int metric);
+
+/*! \brief Timers, with the number of calls, the total and the max time */
+typedef enum {
+	TIMER_READ,		///< read of the input
+	TIMER_DECODE,	///< decoding of a frame by the validation
+	TIMER_WRITE,	///< write of an image, so the write latency
+	TIMER_MAX
+} te_metric_timer;
+
+/// \brief Name of the timer, for the dumps
+const char * metric_timer_name(int timer);
+
+/*! \brief Format of the dumps */
+typedef enum {
+	METRICS_JSON,		///< one JSON object
+	METRICS_PROMETHEUS,	///< Prometheus text exposition format
+	METRICS_FORMAT_MAX
+} te_metrics_format;
+
+/// \brief Name of the format of the dumps, for the command line
+const char * metrics_format_name(int format);
+
+/// Default period of the dumps, in seconds
+#define METRICS_DEFAULT_PERIOD	10
+
+/// Prefix of the Prometheus metrics
+#define METRICS_PROMETHEUS_PREFIX	"recovermjpeg_"
+
+/*! \brief Counters and timers of all the stages */
+class RecoverMetrics {
+public:
+	RecoverMetrics();
+
+	/// \brief Clear the counters and restart the elapsed time
+	void reset();
+
+	/// \brief Add to a counter, from any thread
+	void add(te_metric metric, qint64 value = 1) {
+		mCounters[metric].fetchAndAddRelaxed(value);
+	}
+
+	/// \brief Add the time of one call, from any thread
+	void addTime(te_metric_timer timer, qint64 nsecs);
+
+	/// \brief Get value of a counter
+	qint64 value(te_metric metric) { return mCounters[metric].load(); }
+
+	/// \brief Get number of calls timed
+	qint64 timerCount(te_metric_timer timer) { return mTimerCount[timer].load(); }
+
+	/// \brief Get total time of the calls, in ns
+	qint64 timerTotal(te_metric_timer timer) { return mTimerTotal[timer].load(); }
+
+	/// \brief Get longest call, in ns
+	qint64 timerMax(te_metric_timer timer) { return mTimerMax[timer].load(); }
+
+	/// \brief Dump in JSON
+	QString toJson();
+
+	/// \brief Dump in the Prometheus text format
+	QString toPrometheus();
+
+	/*! \brief Set the file of the dumps
+	 * \param path file replaced at each dump, empty to disable the dumps
+	 * \param period_ms min time between two dumps of update()
+	 */
+	void setOutput(const QString & path, te_metrics_format format, qint64 period_ms);
+
+	/// \brief Dump when the period has elapsed since the last dump, false on error
+	bool update();
+
+	/// \brief Dump now, atomically, false on error with getStatus()
+	bool write();
+
+	/// \brief Get error string
+	QString getStatus() { return mStatus; }
+
+private:
+	QAtomicInteger<qint64> mCounters[METRIC_MAX];	///< Counters
+	QAtomicInteger<qint64> mTimerCount[TIMER_MAX];	///< Number of calls of each timer
+	QAtomicInteger<qint64> mTimerTotal[TIMER_MAX];	///< Total time in ns
+	QAtomicInteger<qint64> mTimerMax[TIMER_MAX];	///< Longest call in ns
+	QElapsedTimer mElapsed;		///< Time since reset()
+
+	QString mStatus;			///< Error
+	QString mPath;				///< File of the dumps, empty if disabled
+	te_metrics_format mFormat;	///< Format of the dumps
+	qint64 mPeriod;				///< Min time between two dumps in ms
+	qint64 mLastWrite;			///< Time of the last dump in ms
+};
+
+/// \brief Metrics of the process
+extern RecoverMetrics g_metrics;
+
+/*! \brief Time a call until the end of the scope */
+class RecoverMetricsTimer {
+public:
+	RecoverMetricsTimer(te_metric_timer timer) : mTimer(timer) { mElapsed.start(); }
+	~RecoverMetricsTimer() { g_metrics.addTime(mTimer, mElapsed.nsecsElapsed()); }
+
+private:
+	te_metric_timer mTimer;		///< Timer to add to
+	QElapsedTimer mElapsed;		///< Start of the call
+};
+
+#endif // RECOVERMETRICS_H
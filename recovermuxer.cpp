@@ -0,0 +1,939 @@
+/*! \file recovermuxer.cpp
+ * \brief Remux of the recovered frames in a new movie or archive
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recovermuxer.h"
+#include "recoverextractor.h"
+
+#include <time.h>
+
+const char * c_output_format_names[OUTPUT_MAX] = {
+	"images",
+	"avi",
+	"mov",
+	"tar",
+	"zip",
+	"index",
+	"pipe"
+};
+
+const char * output_format_name(int format) {
+	if(format < 0 || format >= OUTPUT_MAX) {
+		return "invalid";
+	}
+	return c_output_format_names[format];
+}
+
+static void muxer_le16(QByteArray * out, uint32_t value) {
+	out->append((char)(value & 0xFF));
+	out->append((char)((value >> 8) & 0xFF));
+}
+
+static void muxer_le32(QByteArray * out, uint32_t value) {
+	muxer_le16(out, value & 0xFFFF);
+	muxer_le16(out, value >> 16);
+}
+
+static void muxer_le64(QByteArray * out, uint64_t value) {
+	muxer_le32(out, (uint32_t)value);
+	muxer_le32(out, (uint32_t)(value >> 32));
+}
+
+static void muxer_be16(QByteArray * out, uint32_t value) {
+	out->append((char)((value >> 8) & 0xFF));
+	out->append((char)(value & 0xFF));
+}
+
+static void muxer_be32(QByteArray * out, uint32_t value) {
+	muxer_be16(out, value >> 16);
+	muxer_be16(out, value & 0xFFFF);
+}
+
+static void muxer_be64(QByteArray * out, uint64_t value) {
+	muxer_be32(out, (uint32_t)(value >> 32));
+	muxer_be32(out, (uint32_t)value);
+}
+
+static void muxer_zeros(QByteArray * out, int len) {
+	out->append(QByteArray(len, '\0'));
+}
+
+/******************************************************************************
+ *
+ * MUXER
+ *
+ ******************************************************************************/
+RecoverMuxer::RecoverMuxer() {
+	mFrameRate = MUXER_DEFAULT_FPS;
+	mFrameCount = 0;
+	mWidth = 0;
+	mHeight = 0;
+	mMaxFrameLen = 0;
+	mLastFramePos = -1;
+}
+
+RecoverMuxer::~RecoverMuxer() {
+}
+
+RecoverMuxer * RecoverMuxer::create(te_output_format format) {
+	RecoverMuxer * muxer = NULL;
+	switch(format) {
+	case OUTPUT_AVI:
+		CPP_ALLOC(muxer, RecoverAviMuxer());
+		break;
+	case OUTPUT_MOV:
+		CPP_ALLOC(muxer, RecoverMovMuxer());
+		break;
+	case OUTPUT_TAR:
+		CPP_ALLOC(muxer, RecoverTarMuxer());
+		break;
+	case OUTPUT_ZIP:
+		CPP_ALLOC(muxer, RecoverZipMuxer());
+		break;
+	case OUTPUT_PIPE:
+		CPP_ALLOC(muxer, RecoverPipeMuxer());
+		break;
+	default:
+		break;
+	}
+	return muxer;
+}
+
+void RecoverMuxer::addFrame(qint64 pos, qint64 len, int width, int height) {
+	if(mFrameCount == 0) {
+		mWidth = width;
+		mHeight = height;
+	}
+	mFrameCount++;
+	mMaxFrameLen = qMax(mMaxFrameLen, len);
+	mLastFramePos = pos;
+}
+
+bool RecoverMuxer::writeData(const char * data, qint64 len) {
+	if(mFile.write(data, len) != len) {
+		mStatus = QObject::tr("Cannot write in ") + mFile.fileName();
+		MSG_PRINT(LOG_ERROR, "Can't write %lld bytes in '%s'", len, qPrintable(mFile.fileName()));
+		return false;
+	}
+	return true;
+}
+
+bool RecoverMuxer::patch(qint64 pos, const QByteArray & data) {
+	qint64 end = mFile.pos();
+	if(!mFile.seek(pos)) {
+		mStatus = QObject::tr("Cannot seek in ") + mFile.fileName();
+		return false;
+	}
+	bool ok = writeData(data.constData(), data.size());
+	return mFile.seek(end) && ok;
+}
+
+/******************************************************************************
+ *
+ * AVI
+ *
+ ******************************************************************************/
+/// \brief RIFF chunk with its header, padded to 16bit
+static QByteArray avi_chunk(uint32_t id, const QByteArray & payload) {
+	QByteArray chunk;
+	muxer_le32(&chunk, id);
+	muxer_le32(&chunk, (uint32_t)payload.size());
+	chunk.append(payload);
+	if(payload.size() & 1) {
+		chunk.append('\0');
+	}
+	return chunk;
+}
+
+RecoverAviMuxer::RecoverAviMuxer()
+	: RecoverMuxer() {
+	mRiffPos = 0;
+	mMoviPos = 0;
+	mFirstRiffFrames = 0;
+}
+
+RecoverAviMuxer::~RecoverAviMuxer() {
+	if(isOpen()) {
+		close();
+	}
+}
+
+QByteArray RecoverAviMuxer::header() {
+	uint32_t usPerFrame = 1000000 / mFrameRate;
+
+	QByteArray avih;
+	muxer_le32(&avih, usPerFrame);
+	muxer_le32(&avih, (uint32_t)qMin(mMaxFrameLen * mFrameRate, (qint64)0xFFFFFFFF));
+	muxer_le32(&avih, 0);						// padding granularity
+	muxer_le32(&avih, 0x10);					// AVIF_HASINDEX
+	muxer_le32(&avih, mFirstRiffFrames);		// frames of the first RIFF only
+	muxer_le32(&avih, 0);						// initial frames
+	muxer_le32(&avih, 1);						// streams
+	muxer_le32(&avih, (uint32_t)mMaxFrameLen);	// suggested buffer size
+	muxer_le32(&avih, mWidth);
+	muxer_le32(&avih, mHeight);
+	muxer_zeros(&avih, 16);
+
+	QByteArray strh;
+	muxer_le32(&strh, AVI_FOURCC('v','i','d','s'));
+	muxer_le32(&strh, AVI_FOURCC('M','J','P','G'));
+	muxer_le32(&strh, 0);						// flags
+	muxer_le32(&strh, 0);						// priority and language
+	muxer_le32(&strh, 0);						// initial frames
+	muxer_le32(&strh, 1);						// scale
+	muxer_le32(&strh, mFrameRate);				// rate
+	muxer_le32(&strh, 0);						// start
+	muxer_le32(&strh, mFrameCount);				// length of all RIFF
+	muxer_le32(&strh, (uint32_t)mMaxFrameLen);
+	muxer_le32(&strh, 0xFFFFFFFF);				// default quality
+	muxer_le32(&strh, 0);						// sample size, 0 for video
+	muxer_le16(&strh, 0);						// frame rectangle
+	muxer_le16(&strh, 0);
+	muxer_le16(&strh, mWidth);
+	muxer_le16(&strh, mHeight);
+
+	QByteArray strf;
+	muxer_le32(&strf, 40);						// BITMAPINFOHEADER size
+	muxer_le32(&strf, mWidth);
+	muxer_le32(&strf, mHeight);
+	muxer_le16(&strf, 1);						// planes
+	muxer_le16(&strf, 24);						// bit count
+	muxer_le32(&strf, AVI_FOURCC('M','J','P','G'));
+	muxer_le32(&strf, mWidth * mHeight * 3);
+	muxer_zeros(&strf, 16);
+
+	// Super index, with a fixed number of entries so the header keeps its length
+	QByteArray indx;
+	muxer_le16(&indx, 4);						// longs per entry
+	indx.append('\0');							// sub type
+	indx.append('\0');							// AVI_INDEX_OF_INDEXES
+	muxer_le32(&indx, mSuperIndex.size());
+	muxer_le32(&indx, AVI_FOURCC('0','0','d','c'));
+	muxer_zeros(&indx, 12);
+	for(int i = 0; i < MUXER_AVI_SUPER_INDEX_LEN; i++) {
+		if(i < mSuperIndex.size()) {
+			muxer_le64(&indx, mSuperIndex[i].pos);
+			muxer_le32(&indx, (uint32_t)mSuperIndex[i].size);
+			muxer_le32(&indx, mSuperIndex[i].frames);
+		} else {
+			muxer_zeros(&indx, 16);
+		}
+	}
+
+	QByteArray strl;
+	muxer_le32(&strl, AVI_FOURCC('s','t','r','l'));
+	strl.append(avi_chunk(AVI_FOURCC('s','t','r','h'), strh));
+	strl.append(avi_chunk(AVI_FOURCC('s','t','r','f'), strf));
+	strl.append(avi_chunk(AVI_FOURCC('i','n','d','x'), indx));
+
+	QByteArray dmlh;
+	muxer_le32(&dmlh, mFrameCount);
+	muxer_zeros(&dmlh, 244);
+	QByteArray odml;
+	muxer_le32(&odml, AVI_FOURCC('o','d','m','l'));
+	odml.append(avi_chunk(AVI_FOURCC('d','m','l','h'), dmlh));
+
+	QByteArray hdrl;
+	muxer_le32(&hdrl, AVI_FOURCC('h','d','r','l'));
+	hdrl.append(avi_chunk(AVI_FOURCC('a','v','i','h'), avih));
+	hdrl.append(avi_chunk(AVI_FOURCC('L','I','S','T'), strl));
+	hdrl.append(avi_chunk(AVI_FOURCC('L','I','S','T'), odml));
+
+	// After the RIFF header, which is patched with the other RIFF sizes
+	QByteArray header;
+	muxer_le32(&header, AVI_FOURCC('A','V','I',' '));
+	header.append(avi_chunk(AVI_FOURCC('L','I','S','T'), hdrl));
+	return header;
+}
+
+bool RecoverAviMuxer::open(const QString & path) {
+	mFile.setFileName(path);
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		mStatus = QObject::tr("Cannot create movie ") + path;
+		return false;
+	}
+
+	QByteArray riff;
+	muxer_le32(&riff, AVI_FOURCC('R','I','F','F'));
+	muxer_le32(&riff, 0);
+	riff.append(header());
+	mRiffPos = 0;
+	mMoviPos = riff.size();
+	muxer_le32(&riff, AVI_FOURCC('L','I','S','T'));
+	muxer_le32(&riff, 0);
+	muxer_le32(&riff, AVI_FOURCC('m','o','v','i'));
+	return writeData(riff.constData(), riff.size());
+}
+
+bool RecoverAviMuxer::startRiff() {
+	if(mSuperIndex.size() >= MUXER_AVI_SUPER_INDEX_LEN) {
+		mStatus = QObject::tr("Movie is too large for the AVI index");
+		MSG_PRINT(LOG_ERROR, "AVI super index is full after %d RIFF", mSuperIndex.size());
+		return false;
+	}
+	mRiffPos = mFile.pos();
+	mMoviPos = mRiffPos + 12;
+
+	QByteArray riff;
+	muxer_le32(&riff, AVI_FOURCC('R','I','F','F'));
+	muxer_le32(&riff, 0);
+	muxer_le32(&riff, AVI_FOURCC('A','V','I','X'));
+	muxer_le32(&riff, AVI_FOURCC('L','I','S','T'));
+	muxer_le32(&riff, 0);
+	muxer_le32(&riff, AVI_FOURCC('m','o','v','i'));
+	return writeData(riff.constData(), riff.size());
+}
+
+bool RecoverAviMuxer::closeRiff() {
+	// Standard index at end of movi, its offsets are from the movi list
+	QByteArray ix;
+	muxer_le16(&ix, 2);							// longs per entry
+	ix.append('\0');							// sub type
+	ix.append('\1');							// AVI_INDEX_OF_CHUNKS
+	muxer_le32(&ix, mFrames.size());
+	muxer_le32(&ix, AVI_FOURCC('0','0','d','c'));
+	muxer_le64(&ix, mMoviPos);
+	muxer_le32(&ix, 0);
+	for(int i = 0; i < mFrames.size(); i++) {
+		muxer_le32(&ix, (uint32_t)(mFrames[i].pos - mMoviPos));
+		muxer_le32(&ix, (uint32_t)mFrames[i].length);	// high bit clear: key frame
+	}
+	QByteArray chunk = avi_chunk(AVI_FOURCC('i','x','0','0'), ix);
+
+	t_muxer_index entry;
+	entry.pos = mFile.pos();
+	entry.size = chunk.size();
+	entry.frames = mFrames.size();
+	mSuperIndex.append(entry);
+	if(!writeData(chunk.constData(), chunk.size())) {
+		return false;
+	}
+
+	QByteArray size;
+	muxer_le32(&size, (uint32_t)(mFile.pos() - mMoviPos - 8));
+	if(!patch(mMoviPos + 4, size)) {
+		return false;
+	}
+
+	// Legacy index of the first RIFF, after movi, with offsets from the 'movi' fourcc
+	if(mSuperIndex.size() == 1) {
+		mFirstRiffFrames = mFrames.size();
+		QByteArray idx1;
+		for(int i = 0; i < mFrames.size(); i++) {
+			muxer_le32(&idx1, AVI_FOURCC('0','0','d','c'));
+			muxer_le32(&idx1, 0x10);			// AVIIF_KEYFRAME
+			muxer_le32(&idx1, (uint32_t)(mFrames[i].pos - 8 - (mMoviPos + 8)));
+			muxer_le32(&idx1, (uint32_t)mFrames[i].length);
+		}
+		chunk = avi_chunk(AVI_FOURCC('i','d','x','1'), idx1);
+		if(!writeData(chunk.constData(), chunk.size())) {
+			return false;
+		}
+	}
+
+	size.clear();
+	muxer_le32(&size, (uint32_t)(mFile.pos() - mRiffPos - 8));
+	mFrames.clear();
+	return patch(mRiffPos + 4, size);
+}
+
+bool RecoverAviMuxer::write(const QString & name, const uint8_t * data, qint64 len,
+							int width, int height) {
+	Q_UNUSED(name);
+	// Next RIFF when this one is full, each has at least one frame
+	if(!mFrames.isEmpty() && mFile.pos() + 8 + len - mRiffPos > MUXER_AVI_RIFF_LEN) {
+		if(!closeRiff() || !startRiff()) {
+			return false;
+		}
+	}
+
+	QByteArray chunk;
+	muxer_le32(&chunk, AVI_FOURCC('0','0','d','c'));
+	muxer_le32(&chunk, (uint32_t)len);
+	t_muxer_frame frame;
+	frame.pos = mFile.pos() + 8;
+	frame.length = len;
+	if(!writeData(chunk.constData(), chunk.size())
+			|| !writeData((const char *)data, len)
+			|| ((len & 1) && !writeData("", 1))) {
+		return false;
+	}
+	mFrames.append(frame);
+	addFrame(frame.pos, len, width, height);
+	return true;
+}
+
+bool RecoverAviMuxer::close() {
+	if(!isOpen()) {
+		return false;
+	}
+	// The header is written again with the final size and super index
+	bool ok = closeRiff() && patch(8, header());
+	mFile.close();
+	MSG_PRINT(LOG_INFO, "AVI: %d frames in %d RIFF, %dx%d at %d fps",
+			  mFrameCount, mSuperIndex.size(), mWidth, mHeight, mFrameRate);
+	return ok;
+}
+
+/******************************************************************************
+ *
+ * MOV
+ *
+ ******************************************************************************/
+/// \brief Atom with its header
+static QByteArray mov_atom(uint32_t type, const QByteArray & payload) {
+	QByteArray atom;
+	muxer_be32(&atom, (uint32_t)(payload.size() + 8));
+	muxer_be32(&atom, type);
+	atom.append(payload);
+	return atom;
+}
+
+/// \brief Identity matrix of mvhd and tkhd
+static void mov_matrix(QByteArray * out) {
+	muxer_be32(out, 0x00010000);
+	muxer_be32(out, 0);
+	muxer_be32(out, 0);
+	muxer_be32(out, 0);
+	muxer_be32(out, 0x00010000);
+	muxer_be32(out, 0);
+	muxer_be32(out, 0);
+	muxer_be32(out, 0);
+	muxer_be32(out, 0x40000000);
+}
+
+RecoverMovMuxer::RecoverMovMuxer()
+	: RecoverMuxer() {
+	mMdatPos = 0;
+}
+
+RecoverMovMuxer::~RecoverMovMuxer() {
+	if(isOpen()) {
+		close();
+	}
+}
+
+bool RecoverMovMuxer::open(const QString & path) {
+	mFile.setFileName(path);
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		mStatus = QObject::tr("Cannot create movie ") + path;
+		return false;
+	}
+
+	QByteArray ftyp;
+	muxer_be32(&ftyp, MOV_FOURCC('q','t',' ',' '));
+	muxer_be32(&ftyp, 0x20050300);
+	muxer_be32(&ftyp, MOV_FOURCC('q','t',' ',' '));
+	QByteArray header = mov_atom(MOV_FOURCC('f','t','y','p'), ftyp);
+
+	// 64bit size, patched at the end
+	mMdatPos = header.size();
+	muxer_be32(&header, 1);
+	muxer_be32(&header, MOV_FOURCC('m','d','a','t'));
+	muxer_be64(&header, 16);
+	return writeData(header.constData(), header.size());
+}
+
+bool RecoverMovMuxer::write(const QString & name, const uint8_t * data, qint64 len,
+							int width, int height) {
+	Q_UNUSED(name);
+	t_muxer_frame frame;
+	frame.pos = mFile.pos();
+	frame.length = len;
+	if(!writeData((const char *)data, len)) {
+		return false;
+	}
+	mFrames.append(frame);
+	addFrame(frame.pos, len, width, height);
+	return true;
+}
+
+QByteArray RecoverMovMuxer::moov() {
+	// Time scale is the frame rate, so each sample lasts 1
+	QByteArray mvhd;
+	muxer_be32(&mvhd, 0);						// version and flags
+	muxer_be32(&mvhd, 0);						// creation time
+	muxer_be32(&mvhd, 0);						// modification time
+	muxer_be32(&mvhd, mFrameRate);				// time scale
+	muxer_be32(&mvhd, mFrameCount);				// duration
+	muxer_be32(&mvhd, 0x00010000);				// rate 1.0
+	muxer_be16(&mvhd, 0x0100);					// volume 1.0
+	muxer_zeros(&mvhd, 10);
+	mov_matrix(&mvhd);
+	muxer_zeros(&mvhd, 24);						// preview, poster, selection, current time
+	muxer_be32(&mvhd, 2);						// next track id
+
+	QByteArray tkhd;
+	muxer_be32(&tkhd, 0x00000003);				// enabled, in movie
+	muxer_be32(&tkhd, 0);
+	muxer_be32(&tkhd, 0);
+	muxer_be32(&tkhd, 1);						// track id
+	muxer_be32(&tkhd, 0);
+	muxer_be32(&tkhd, mFrameCount);				// duration in movie time scale
+	muxer_zeros(&tkhd, 8);
+	muxer_be16(&tkhd, 0);						// layer
+	muxer_be16(&tkhd, 0);						// alternate group
+	muxer_be16(&tkhd, 0);						// volume
+	muxer_be16(&tkhd, 0);
+	mov_matrix(&tkhd);
+	muxer_be32(&tkhd, (uint32_t)mWidth << 16);
+	muxer_be32(&tkhd, (uint32_t)mHeight << 16);
+
+	QByteArray mdhd;
+	muxer_be32(&mdhd, 0);
+	muxer_be32(&mdhd, 0);
+	muxer_be32(&mdhd, 0);
+	muxer_be32(&mdhd, mFrameRate);
+	muxer_be32(&mdhd, mFrameCount);
+	muxer_be16(&mdhd, 0);						// language
+	muxer_be16(&mdhd, 0);						// quality
+
+	QByteArray mhlr;
+	muxer_be32(&mhlr, 0);
+	muxer_be32(&mhlr, MOV_FOURCC('m','h','l','r'));
+	muxer_be32(&mhlr, MOV_FOURCC('v','i','d','e'));
+	muxer_zeros(&mhlr, 12);
+	mhlr.append('\0');							// empty name
+
+	QByteArray vmhd;
+	muxer_be32(&vmhd, 0x00000001);
+	muxer_be16(&vmhd, 0x0040);					// dither copy
+	muxer_be16(&vmhd, 0x8000);
+	muxer_be16(&vmhd, 0x8000);
+	muxer_be16(&vmhd, 0x8000);
+
+	QByteArray dhlr;
+	muxer_be32(&dhlr, 0);
+	muxer_be32(&dhlr, MOV_FOURCC('d','h','l','r'));
+	muxer_be32(&dhlr, MOV_FOURCC('a','l','i','s'));
+	muxer_zeros(&dhlr, 12);
+	dhlr.append('\0');
+
+	// The samples are in this file
+	QByteArray alis;
+	muxer_be32(&alis, 0x00000001);
+	QByteArray dref;
+	muxer_be32(&dref, 0);
+	muxer_be32(&dref, 1);
+	dref.append(mov_atom(MOV_FOURCC('a','l','i','s'), alis));
+
+	QByteArray stsd;
+	muxer_be32(&stsd, 0);
+	muxer_be32(&stsd, 1);
+	muxer_be32(&stsd, 86);						// size of the description
+	muxer_be32(&stsd, MOV_FOURCC('j','p','e','g'));
+	muxer_zeros(&stsd, 6);
+	muxer_be16(&stsd, 1);						// data reference index
+	muxer_be16(&stsd, 0);						// version
+	muxer_be16(&stsd, 0);						// revision
+	muxer_be32(&stsd, 0);						// vendor
+	muxer_be32(&stsd, 0);						// temporal quality
+	muxer_be32(&stsd, 0x00000200);				// spatial quality: normal
+	muxer_be16(&stsd, mWidth);
+	muxer_be16(&stsd, mHeight);
+	muxer_be32(&stsd, 0x00480000);				// 72 dpi
+	muxer_be32(&stsd, 0x00480000);
+	muxer_be32(&stsd, 0);						// data size
+	muxer_be16(&stsd, 1);						// frames per sample
+	QByteArray name("Photo - JPEG");
+	stsd.append((char)name.size());
+	stsd.append(name);
+	muxer_zeros(&stsd, 31 - name.size());
+	muxer_be16(&stsd, 24);						// depth
+	muxer_be16(&stsd, 0xFFFF);					// no color table
+
+	QByteArray stts;
+	muxer_be32(&stts, 0);
+	muxer_be32(&stts, 1);
+	muxer_be32(&stts, mFrameCount);
+	muxer_be32(&stts, 1);
+
+	// One sample per chunk, so the chunk offsets are the sample offsets
+	QByteArray stsc;
+	muxer_be32(&stsc, 0);
+	muxer_be32(&stsc, 1);
+	muxer_be32(&stsc, 1);
+	muxer_be32(&stsc, 1);
+	muxer_be32(&stsc, 1);
+
+	QByteArray stsz;
+	muxer_be32(&stsz, 0);
+	muxer_be32(&stsz, 0);						// sizes in table
+	muxer_be32(&stsz, mFrames.size());
+	for(int i = 0; i < mFrames.size(); i++) {
+		muxer_be32(&stsz, (uint32_t)mFrames[i].length);
+	}
+
+	bool large = (!mFrames.isEmpty() && mFrames.last().pos > (qint64)0xFFFFFFFF);
+	QByteArray stco;
+	muxer_be32(&stco, 0);
+	muxer_be32(&stco, mFrames.size());
+	for(int i = 0; i < mFrames.size(); i++) {
+		if(large) {
+			muxer_be64(&stco, mFrames[i].pos);
+		} else {
+			muxer_be32(&stco, (uint32_t)mFrames[i].pos);
+		}
+	}
+
+	QByteArray stbl = mov_atom(MOV_FOURCC('s','t','s','d'), stsd)
+			+ mov_atom(MOV_FOURCC('s','t','t','s'), stts)
+			+ mov_atom(MOV_FOURCC('s','t','s','c'), stsc)
+			+ mov_atom(MOV_FOURCC('s','t','s','z'), stsz)
+			+ mov_atom(large ? MOV_FOURCC('c','o','6','4') : MOV_FOURCC('s','t','c','o'), stco);
+	QByteArray minf = mov_atom(MOV_FOURCC('v','m','h','d'), vmhd)
+			+ mov_atom(MOV_FOURCC('h','d','l','r'), dhlr)
+			+ mov_atom(MOV_FOURCC('d','i','n','f'), mov_atom(MOV_FOURCC('d','r','e','f'), dref))
+			+ mov_atom(MOV_FOURCC('s','t','b','l'), stbl);
+	QByteArray mdia = mov_atom(MOV_FOURCC('m','d','h','d'), mdhd)
+			+ mov_atom(MOV_FOURCC('h','d','l','r'), mhlr)
+			+ mov_atom(MOV_FOURCC('m','i','n','f'), minf);
+	QByteArray trak = mov_atom(MOV_FOURCC('t','k','h','d'), tkhd)
+			+ mov_atom(MOV_FOURCC('m','d','i','a'), mdia);
+	return mov_atom(MOV_FOURCC('m','o','o','v'),
+					mov_atom(MOV_FOURCC('m','v','h','d'), mvhd)
+					+ mov_atom(MOV_FOURCC('t','r','a','k'), trak));
+}
+
+bool RecoverMovMuxer::close() {
+	if(!isOpen()) {
+		return false;
+	}
+	QByteArray size;
+	muxer_be64(&size, mFile.pos() - mMdatPos);
+	QByteArray atom = moov();
+	bool ok = patch(mMdatPos + 8, size)
+			&& writeData(atom.constData(), atom.size());
+	mFile.close();
+	MSG_PRINT(LOG_INFO, "MOV: %d frames, %dx%d at %d fps",
+			  mFrameCount, mWidth, mHeight, mFrameRate);
+	return ok;
+}
+
+/******************************************************************************
+ *
+ * ARCHIVES
+ *
+ ******************************************************************************/
+RecoverArchiveMuxer::RecoverArchiveMuxer()
+	: RecoverMuxer() {
+	mPos = 0;
+	mTime = 0;
+}
+
+bool RecoverArchiveMuxer::open(const QString & path) {
+	// The writes are buffered here, in larger blocks than QFile does
+	mFile.setFileName(path);
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+		mStatus = QObject::tr("Cannot create archive ") + path;
+		return false;
+	}
+	mPos = 0;
+	mTime = (uint32_t)time(NULL);
+	mBuffer.reserve(MUXER_ARCHIVE_BUFFER_LEN);
+	return true;
+}
+
+bool RecoverArchiveMuxer::append(const char * data, qint64 len) {
+	mPos += len;
+	if(mBuffer.size() + len <= MUXER_ARCHIVE_BUFFER_LEN) {
+		mBuffer.append(data, (int)len);
+		return true;
+	}
+	if(!flush()) {
+		return false;
+	}
+	if(len >= MUXER_ARCHIVE_BUFFER_LEN) {
+		return writeData(data, len);
+	}
+	mBuffer.append(data, (int)len);
+	return true;
+}
+
+bool RecoverArchiveMuxer::flush() {
+	bool ok = mBuffer.isEmpty() || writeData(mBuffer.constData(), mBuffer.size());
+	// The capacity is reserved, so it is kept
+	mBuffer.resize(0);
+	return ok;
+}
+
+/*** TAR ***/
+/// \brief ustar header of a regular file
+static QByteArray tar_header(const QString & name, qint64 len, uint32_t mtime) {
+	QByteArray header(512, '\0');
+	char * p = header.data();
+	QByteArray path = name.toUtf8();
+	memcpy(p, path.constData(), qMin(path.size(), 100));
+	snprintf(p + 100, 8, "%07o", 0644);		// mode
+	snprintf(p + 108, 8, "%07o", 0);		// uid
+	snprintf(p + 116, 8, "%07o", 0);		// gid
+	snprintf(p + 124, 12, "%011llo", (unsigned long long)len);
+	snprintf(p + 136, 12, "%011o", mtime);
+	memset(p + 148, ' ', 8);				// checksum, counted as spaces
+	p[156] = '0';							// regular file
+	memcpy(p + 257, "ustar", 6);
+	memcpy(p + 263, "00", 2);
+
+	unsigned int checksum = 0;
+	for(int i = 0; i < 512; i++) {
+		checksum += (uint8_t)p[i];
+	}
+	snprintf(p + 148, 7, "%06o", checksum);
+	p[155] = ' ';
+	return header;
+}
+
+RecoverTarMuxer::RecoverTarMuxer()
+	: RecoverArchiveMuxer() {
+}
+
+RecoverTarMuxer::~RecoverTarMuxer() {
+	if(isOpen()) {
+		close();
+	}
+}
+
+bool RecoverTarMuxer::write(const QString & name, const uint8_t * data, qint64 len,
+							int width, int height) {
+	QByteArray header = tar_header(name, len, mTime);
+	int padding = (int)((512 - len % 512) % 512);
+	qint64 pos = mPos + header.size();
+	if(!append(header.constData(), header.size())
+			|| !append((const char *)data, len)
+			|| !append(QByteArray(padding, '\0').constData(), padding)) {
+		return false;
+	}
+	addFrame(pos, len, width, height);
+	return true;
+}
+
+bool RecoverTarMuxer::close() {
+	if(!isOpen()) {
+		return false;
+	}
+	// End of archive: two empty blocks
+	QByteArray end(1024, '\0');
+	bool ok = append(end.constData(), end.size()) && flush();
+	mFile.close();
+	MSG_PRINT(LOG_INFO, "TAR: %d images, %lld bytes", mFrameCount, mPos);
+	return ok;
+}
+
+/*** ZIP ***/
+/// \brief Table of the CRC-32 of the bytes, reflected polynomial 0xEDB88320
+static QVector<uint32_t> zip_crc_table() {
+	QVector<uint32_t> table;
+	table.resize(256);
+	for(uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for(int bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+/// \brief CRC-32 of the zip entries
+static uint32_t zip_crc32(const uint8_t * data, qint64 len) {
+	static const QVector<uint32_t> table = zip_crc_table();
+	uint32_t crc = 0xFFFFFFFF;
+	for(qint64 i = 0; i < len; i++) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+/// \brief MS-DOS time in low 16 bits and date in high 16 bits
+static uint32_t zip_dos_time(uint32_t unixTime) {
+	time_t t = (time_t)unixTime;
+	struct tm * local = localtime(&t);
+	if(!local || local->tm_year < 80) {
+		return (1 << 21) | (1 << 16);	// 1980-01-01
+	}
+	uint32_t dosTime = (local->tm_hour << 11) | (local->tm_min << 5) | (local->tm_sec / 2);
+	uint32_t dosDate = ((local->tm_year - 80) << 9) | ((local->tm_mon + 1) << 5) | local->tm_mday;
+	return (dosDate << 16) | dosTime;
+}
+
+RecoverZipMuxer::RecoverZipMuxer()
+	: RecoverArchiveMuxer() {
+}
+
+RecoverZipMuxer::~RecoverZipMuxer() {
+	if(isOpen()) {
+		close();
+	}
+}
+
+bool RecoverZipMuxer::write(const QString & name, const uint8_t * data, qint64 len,
+							int width, int height) {
+	t_muxer_zip_entry entry;
+	entry.name = name.toUtf8();
+	entry.pos = mPos;
+	entry.length = len;
+	entry.crc = zip_crc32(data, len);
+
+	// The frames are far below 4 GB, so the local header never needs zip64
+	QByteArray header;
+	muxer_le32(&header, 0x04034b50);
+	muxer_le16(&header, 20);			// version needed
+	muxer_le16(&header, 0);				// flags
+	muxer_le16(&header, 0);				// stored
+	muxer_le32(&header, zip_dos_time(mTime));
+	muxer_le32(&header, entry.crc);
+	muxer_le32(&header, (uint32_t)len);	// compressed size
+	muxer_le32(&header, (uint32_t)len);	// uncompressed size
+	muxer_le16(&header, entry.name.size());
+	muxer_le16(&header, 0);				// extra field
+	header.append(entry.name);
+	if(!append(header.constData(), header.size())
+			|| !append((const char *)data, len)) {
+		return false;
+	}
+	mEntries.append(entry);
+	addFrame(entry.pos + header.size(), len, width, height);
+	return true;
+}
+
+bool RecoverZipMuxer::close() {
+	if(!isOpen()) {
+		return false;
+	}
+	bool ok = true;
+	qint64 directoryPos = mPos;
+	for(int i = 0; i < mEntries.size() && ok; i++) {
+		const t_muxer_zip_entry & entry = mEntries[i];
+		// Beyond 4 GB, the position is in a zip64 extra field
+		bool far = (entry.pos >= 0xFFFFFFFFLL);
+		QByteArray header;
+		muxer_le32(&header, 0x02014b50);
+		muxer_le16(&header, far ? 45 : 20);	// version made by
+		muxer_le16(&header, far ? 45 : 20);	// version needed
+		muxer_le16(&header, 0);
+		muxer_le16(&header, 0);
+		muxer_le32(&header, zip_dos_time(mTime));
+		muxer_le32(&header, entry.crc);
+		muxer_le32(&header, (uint32_t)entry.length);
+		muxer_le32(&header, (uint32_t)entry.length);
+		muxer_le16(&header, entry.name.size());
+		muxer_le16(&header, far ? 12 : 0);	// extra field
+		muxer_le16(&header, 0);				// comment
+		muxer_le16(&header, 0);				// disk
+		muxer_le16(&header, 0);				// internal attributes
+		muxer_le32(&header, 0);				// external attributes
+		muxer_le32(&header, far ? 0xFFFFFFFF : (uint32_t)entry.pos);
+		header.append(entry.name);
+		if(far) {
+			muxer_le16(&header, 0x0001);
+			muxer_le16(&header, 8);
+			muxer_le64(&header, entry.pos);
+		}
+		ok = append(header.constData(), header.size());
+	}
+	qint64 directoryLen = mPos - directoryPos;
+	qint64 count = mEntries.size();
+
+	QByteArray end;
+	if(count >= 0xFFFF || directoryPos >= 0xFFFFFFFFLL || directoryLen >= 0xFFFFFFFFLL) {
+		qint64 zip64Pos = mPos;
+		muxer_le32(&end, 0x06064b50);
+		muxer_le64(&end, 44);				// size of the record after this field
+		muxer_le16(&end, 45);
+		muxer_le16(&end, 45);
+		muxer_le32(&end, 0);
+		muxer_le32(&end, 0);
+		muxer_le64(&end, count);
+		muxer_le64(&end, count);
+		muxer_le64(&end, directoryLen);
+		muxer_le64(&end, directoryPos);
+		// Locator
+		muxer_le32(&end, 0x07064b50);
+		muxer_le32(&end, 0);
+		muxer_le64(&end, zip64Pos);
+		muxer_le32(&end, 1);
+	}
+	muxer_le32(&end, 0x06054b50);
+	muxer_le16(&end, 0);
+	muxer_le16(&end, 0);
+	muxer_le16(&end, (uint32_t)qMin(count, (qint64)0xFFFF));
+	muxer_le16(&end, (uint32_t)qMin(count, (qint64)0xFFFF));
+	muxer_le32(&end, (uint32_t)qMin(directoryLen, (qint64)0xFFFFFFFFLL));
+	muxer_le32(&end, (uint32_t)qMin(directoryPos, (qint64)0xFFFFFFFFLL));
+	muxer_le16(&end, 0);				// comment
+	ok = ok && append(end.constData(), end.size()) && flush();
+	mFile.close();
+	MSG_PRINT(LOG_INFO, "ZIP: %d images, %lld bytes", mFrameCount, mPos);
+	return ok;
+}
+
+
+/******************************************************************************
+ *
+ * PIPE
+ *
+ ******************************************************************************/
+RecoverPipeMuxer::RecoverPipeMuxer()
+	: RecoverMuxer() {
+	mPos = 0;
+}
+
+RecoverPipeMuxer::~RecoverPipeMuxer() {
+	if(isOpen()) {
+		close();
+	}
+}
+
+bool RecoverPipeMuxer::open(const QString & path) {
+	// Unbuffered, so each frame is one write() from the input buffer
+	bool ok;
+	if(path == OUTPUT_STDOUT) {
+		fflush(stdout);
+		ok = mFile.open(fileno(stdout), QIODevice::WriteOnly | QIODevice::Unbuffered,
+						QFileDevice::DontCloseHandle);
+	} else {
+		// Blocks until the consumer opens a named pipe
+		mFile.setFileName(path);
+		ok = mFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered);
+	}
+	if(!ok) {
+		mStatus = QObject::tr("Cannot open pipe ") + path;
+		return false;
+	}
+	mPos = 0;
+	return true;
+}
+
+bool RecoverPipeMuxer::write(const QString & name, const uint8_t * data, qint64 len,
+							 int width, int height) {
+	Q_UNUSED(name);
+	if(!writeData((const char *)data, len)) {
+		return false;
+	}
+	addFrame(mPos, len, width, height);
+	mPos += len;
+	return true;
+}
+
+bool RecoverPipeMuxer::close() {
+	if(!isOpen()) {
+		return false;
+	}
+	mFile.close();
+	MSG_PRINT(LOG_INFO, "PIPE: %d images, %lld bytes", mFrameCount, mPos);
+	return true;
+}
@@ -0,0 +1,277 @@
+/*! \file recovermuxer.h
+ * \brief Remux of the recovered frames in a new movie or archive
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * Instead of one JPEG file per frame, the frames are copied as they are
+ * found in a new AVI or MOV file, without encoding, and its index is
+ * written at the end, so the movie is playable after a single pass.
+ * The frames may also be packed as JPEG files in a tar or store-only zip
+ * archive, which avoids creating millions of small files.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERMUXER_H
+#define RECOVERMUXER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+/*! \brief Output of the recovered frames */
+typedef enum {
+	OUTPUT_IMAGES,	///< one JPEG file per frame
+	OUTPUT_AVI,		///< MJPEG AVI with idx1 and OpenDML indexes
+	OUTPUT_MOV,		///< QuickTime MOV with 'jpeg' samples
+	OUTPUT_TAR,		///< uncompressed ustar archive of the images
+	OUTPUT_ZIP,		///< store-only zip archive of the images, zip64 when needed
+	OUTPUT_INDEX,	///< only the index of the frames, see recoverindex.h
+	OUTPUT_PIPE,	///< concatenated JPEG stream on stdout or in a named pipe
+	OUTPUT_MAX
+} te_output_format;
+
+/// \brief Name of the output format, for logs and command line
+const char * output_format_name(int format);
+
+/// Path of the standard output for OUTPUT_PIPE
+#define OUTPUT_STDOUT	"-"
+
+/// Frame rate of the movie when it is not given
+#define MUXER_DEFAULT_FPS	25
+
+/// Max length of each RIFF of the AVI, the next frames go in AVIX extensions
+#define MUXER_AVI_RIFF_LEN	(1024*1024*1024)
+
+/// Number of entries of the OpenDML super index, so number of RIFF
+#define MUXER_AVI_SUPER_INDEX_LEN	256
+
+/// Size of the write buffer of the archives, so the small frames are written in large blocks
+#define MUXER_ARCHIVE_BUFFER_LEN	(4*1024*1024)
+
+/*! \brief Writer of a movie */
+class RecoverMuxer {
+public:
+	RecoverMuxer();
+	virtual ~RecoverMuxer();
+
+	/*! \brief Create the muxer for format
+	 * \return NULL for OUTPUT_IMAGES and OUTPUT_INDEX
+	 */
+	static RecoverMuxer * create(te_output_format format);
+
+	/// \brief Set frame rate, MUXER_DEFAULT_FPS by default
+	void setFrameRate(int fps) { mFrameRate = (fps > 0 ? fps : MUXER_DEFAULT_FPS); }
+
+	/// \brief Create the movie file and write its header, false on error with getStatus()
+	virtual bool open(const QString & path) = 0;
+
+	/*! \brief Append a frame
+	 * \param name name of the image, for the entries of the archives
+	 * \param width width from SOF, the first frame gives the size of the movie
+	 * \param height height from SOF
+	 * \return false on error
+	 */
+	virtual bool write(const QString & name, const uint8_t * data, qint64 len,
+					   int width, int height) = 0;
+
+	/// \brief Write the index and close the file, false on error
+	virtual bool close() = 0;
+
+	/// \brief Return true between open() and close()
+	bool isOpen() { return mFile.isOpen(); }
+
+	/// \brief Format of the movie
+	virtual te_output_format format() = 0;
+
+	/// \brief Get number of frames written
+	int getFrameCount() { return mFrameCount; }
+
+	/// \brief Get position of the data of the last frame in file, -1 before the first one
+	qint64 getLastFramePos() { return mLastFramePos; }
+
+	/// \brief Get error string
+	QString getStatus() { return mStatus; }
+
+protected:
+	/// \brief Keep the size of the movie, the largest frame and the last position
+	void addFrame(qint64 pos, qint64 len, int width, int height);
+
+	/// \brief Write a buffer in file at current position, false on error with status
+	bool writeData(const char * data, qint64 len);
+
+	/// \brief Write a buffer in file at pos then go back at end, false on error
+	bool patch(qint64 pos, const QByteArray & data);
+
+	QString mStatus;	///< Error
+	QFile mFile;		///< Movie file
+	int mFrameRate;		///< Frames per second
+	int mFrameCount;	///< Number of frames written
+	int mWidth;			///< Width of the first frame
+	int mHeight;		///< Height of the first frame
+	qint64 mMaxFrameLen;	///< Largest frame, for the suggested buffer size
+	qint64 mLastFramePos;	///< Position of the data of the last frame
+};
+
+/*! \brief Position and length of a frame in the movie */
+typedef struct {
+	qint64 pos;		///< Position of the data in file
+	qint64 length;	///< Length of the data
+} t_muxer_frame;
+
+/*! \brief Entry of the AVI super index */
+typedef struct {
+	qint64 pos;		///< Position of the ix00 chunk
+	qint64 size;	///< Size of the ix00 chunk with its header
+	int frames;		///< Number of frames indexed
+} t_muxer_index;
+
+/*! \brief MJPEG AVI writer
+ * The frames are '00dc' chunks of the movi list. The first RIFF has an idx1
+ * index, and each RIFF has an OpenDML ix00 index listed in the indx super
+ * index, so files larger than 1 GB are played too.
+ */
+class RecoverAviMuxer : public RecoverMuxer {
+public:
+	RecoverAviMuxer();
+	~RecoverAviMuxer();
+
+	bool open(const QString & path);
+	bool write(const QString & name, const uint8_t * data, qint64 len, int width, int height);
+	bool close();
+	te_output_format format() { return OUTPUT_AVI; }
+
+private:
+	/// \brief Build the headers before the first movi list, always the same length
+	QByteArray header();
+
+	/// \brief Start a RIFF AVIX and its movi list
+	bool startRiff();
+
+	/// \brief Write the indexes of the current RIFF and patch its sizes
+	bool closeRiff();
+
+	qint64 mRiffPos;	///< Position of the current RIFF header
+	qint64 mMoviPos;	///< Position of the current movi LIST header
+	int mFirstRiffFrames;	///< Number of frames in the first RIFF, for avih
+	QVector<t_muxer_frame> mFrames;	///< Frames of the current RIFF
+	QVector<t_muxer_index> mSuperIndex;	///< Standard indexes of each RIFF
+};
+
+/*! \brief QuickTime MOV writer
+ * The frames are copied in a 64bit mdat, then the moov with one video
+ * track of 'jpeg' samples is written at the end.
+ */
+class RecoverMovMuxer : public RecoverMuxer {
+public:
+	RecoverMovMuxer();
+	~RecoverMovMuxer();
+
+	bool open(const QString & path);
+	bool write(const QString & name, const uint8_t * data, qint64 len, int width, int height);
+	bool close();
+	te_output_format format() { return OUTPUT_MOV; }
+
+private:
+	/// \brief Build the moov atom from the frames
+	QByteArray moov();
+
+	qint64 mMdatPos;	///< Position of the mdat header
+	QVector<t_muxer_frame> mFrames;	///< All the frames
+};
+
+/*! \brief Writer of an archive of images
+ * The archive is written sequentially, through a large buffer, and never
+ * patched, so it can be piped and read as a stream without unpacking it.
+ */
+class RecoverArchiveMuxer : public RecoverMuxer {
+public:
+	RecoverArchiveMuxer();
+
+	bool open(const QString & path);
+
+protected:
+	/// \brief Append data to the buffer, written when it is full
+	bool append(const char * data, qint64 len);
+
+	/// \brief Write the buffer in file
+	bool flush();
+
+	qint64 mPos;		///< Position in archive, buffer included
+	QByteArray mBuffer;	///< Data not written yet
+	uint32_t mTime;		///< Creation time of the archive, for the entries
+};
+
+/*! \brief Uncompressed ustar writer
+ * Each image is a 512 byte header followed by its data, padded to 512.
+ */
+class RecoverTarMuxer : public RecoverArchiveMuxer {
+public:
+	RecoverTarMuxer();
+	~RecoverTarMuxer();
+
+	bool write(const QString & name, const uint8_t * data, qint64 len, int width, int height);
+	bool close();
+	te_output_format format() { return OUTPUT_TAR; }
+};
+
+/*! \brief Entry of the zip central directory */
+typedef struct {
+	QByteArray name;	///< Name of the image
+	qint64 pos;			///< Position of the local header
+	qint64 length;		///< Length of the image
+	uint32_t crc;		///< CRC-32 of the image
+} t_muxer_zip_entry;
+
+/*! \brief Store-only zip writer
+ * The sizes and CRC are known before each image, so the local headers are
+ * complete and the archive can be read as a stream. Zip64 records are added
+ * when the archive exceeds 4 GB or 65535 images.
+ */
+class RecoverZipMuxer : public RecoverArchiveMuxer {
+public:
+	RecoverZipMuxer();
+	~RecoverZipMuxer();
+
+	bool write(const QString & name, const uint8_t * data, qint64 len, int width, int height);
+	bool close();
+	te_output_format format() { return OUTPUT_ZIP; }
+
+private:
+	QVector<t_muxer_zip_entry> mEntries;	///< All the images, for the central directory
+};
+
+/*! \brief Concatenated JPEG stream, like ffmpeg -f image2pipe reads it
+ * Each frame is written as it is, straight from the buffer of the input,
+ * without copy nor header, so a consumer can encode while the file is
+ * scanned. The output is not seekable, and nothing is written at close.
+ */
+class RecoverPipeMuxer : public RecoverMuxer {
+public:
+	RecoverPipeMuxer();
+	~RecoverPipeMuxer();
+
+	/// \brief Open the named pipe or file, or the standard output for OUTPUT_STDOUT
+	bool open(const QString & path);
+	bool write(const QString & name, const uint8_t * data, qint64 len, int width, int height);
+	bool close();
+	te_output_format format() { return OUTPUT_PIPE; }
+
+private:
+	qint64 mPos;		///< Bytes written in the stream
+};
+
+#endif // RECOVERMUXER_H
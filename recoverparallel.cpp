@@ -0,0 +1,418 @@
+/*! \file recoverparallel.cpp
+ * \brief Multi-threaded extraction of large files
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverparallel.h"
+
+#include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+/*! \brief Job scanning one range */
+class RecoverScanJob : public QRunnable {
+public:
+	RecoverScanJob(RecoverParallelExtractor * extractor, t_parallel_range * range)
+		: mExtractor(extractor), mRange(range) {}
+	void run() { mExtractor->scanRange(mRange); }
+private:
+	RecoverParallelExtractor * mExtractor;
+	t_parallel_range * mRange;
+};
+
+/*! \brief Job saving a block of frames */
+class RecoverSaveJob : public QRunnable {
+public:
+	RecoverSaveJob(RecoverParallelExtractor * extractor, int first, int last)
+		: mExtractor(extractor), mFirst(first), mLast(last) {}
+	void run() { mExtractor->saveFrames(mFirst, mLast); }
+private:
+	RecoverParallelExtractor * mExtractor;
+	int mFirst;
+	int mLast;
+};
+
+RecoverParallelExtractor::RecoverParallelExtractor()
+	: QObject() {
+	mFileSize = 0;
+	mThreadCount = 0;
+	mRangeLength = PARALLEL_RANGE_LEN;
+	mInputMode = INPUT_READ;
+	mMaxFrameLength = MAX_JPEG_LEN;
+	mInsertDhtEnabled = false;
+	mNameDigits = 0;
+	mDigits = IMAGE_NAME_DIGITS;
+	mMapped = NULL;
+}
+
+RecoverParallelExtractor::~RecoverParallelExtractor() {
+	CPP_DELETE(mMapped);
+}
+
+void RecoverParallelExtractor::setFilename(const QString & filename, const QString & outputDir) {
+	mFilename = filename;
+	mDir = QDir(outputDir);
+}
+
+/*! \brief Read len bytes at pos, even if read() returns less */
+static qint64 readFully(QFile & file, qint64 pos, uint8_t * buffer, qint64 len) {
+	if(!file.seek(pos)) {
+		return -1;
+	}
+	qint64 total = 0;
+	while(total < len) {
+		qint64 readBytes = file.read((char *)buffer + total, len - total);
+		if(readBytes <= 0) {
+			break;
+		}
+		total += readBytes;
+	}
+	return total;
+}
+
+/*! \brief Read a frame again, after the scan of its range */
+static bool readFrame(QFile & file, qint64 pos, uint8_t * buffer, qint64 len) {
+	RecoverMetricsTimer timer(TIMER_READ);
+	qint64 readBytes = readFully(file, pos, buffer, len);
+	if(readBytes > 0) {
+		g_metrics.add(METRIC_BYTES_READ, readBytes);
+		g_metrics.add(METRIC_BYTES_REREAD, readBytes);
+	}
+	return readBytes == len;
+}
+
+/*! \brief Parse a frame going past the data read for its range, in buffers growing until end
+ * \param len bytes already parsed
+ * \return 1 if the frame is complete, 0 if not, -1 on read error
+ */
+static int parseLongFrame(QFile & file, qint64 pos, qint64 len, qint64 end, t_jpeg_frame * frame) {
+	te_jpeg_frame_status status = JPEG_FRAME_NEED_MORE;
+	while(status == JPEG_FRAME_NEED_MORE && len < end - pos) {
+		len = qMin(2 * len, end - pos);
+		uint8_t * buffer = NULL;
+		CPP_ALLOC_ARRAY(buffer, uint8_t, len);
+		bool ok = readFrame(file, pos, buffer, len);
+		if(ok) {
+			status = jpeg_parse_frame(buffer, len, frame);
+		}
+		CPP_DELETE_ARRAY(buffer);
+		if(!ok) {
+			MSG_PRINT(LOG_ERROR, "Read failed for frame at %lld, %lld bytes", pos, len);
+			return -1;
+		}
+	}
+	return (status == JPEG_FRAME_OK ? 1 : 0);
+}
+
+void RecoverParallelExtractor::scanRange(t_parallel_range * range) {
+	// The range is read with a small overlap, and the few frames which
+	// don't end in it are parsed again with more data up to the max frame,
+	// so every frame starting in range is found like the sequential extractor
+	qint64 len = qMin(range->end + (qint64)INPUT_INITIAL_WINDOW, mFileSize) - range->start;
+	uint8_t * buffer = NULL;
+	const uint8_t * data = NULL;
+	QFile file(mFilename);
+
+	if(mMapped) {
+		data = mMapped->data() + range->start;
+	} else {
+		if(!file.open(QFile::ReadOnly)) {
+			MSG_PRINT(LOG_ERROR, "Cannot open '%s'", qPrintable(mFilename));
+			range->error = true;
+			mErrors.fetchAndAddRelaxed(1);
+			return;
+		}
+		CPP_ALLOC_ARRAY(buffer, uint8_t, len);
+		qint64 readBytes = 0;
+		{
+			RecoverMetricsTimer timer(TIMER_READ);
+			readBytes = readFully(file, range->start, buffer, len);
+		}
+		g_metrics.add(METRIC_BYTES_READ, qMax(readBytes, (qint64)0));
+		// The overlap after the range is read again by the next range
+		g_metrics.add(METRIC_BYTES_REREAD, qMax(readBytes - (range->end - range->start), (qint64)0));
+		if(readBytes != len) {
+			MSG_PRINT(LOG_ERROR, "Read failed for range [%lld, %lld[ read=%lld",
+					  range->start, range->end, readBytes);
+			CPP_DELETE_ARRAY(buffer);
+			range->error = true;
+			mErrors.fetchAndAddRelaxed(1);
+			return;
+		}
+		data = buffer;
+	}
+
+	// Keep every complete frame starting in range, even inside another
+	// frame: the stitching will decide which ones are kept
+	qint64 range_len = range->end - range->start;
+	qint64 scan_len = qMin(range_len + 2, len);
+	qint64 offset = 0;
+	qint64 parsed = 0;
+	while((offset = jpeg_scan_soi(data, scan_len, offset)) >= 0) {
+		t_jpeg_frame frame;
+		parsed++;
+		qint64 pos = range->start + offset;
+		qint64 end = qMin(pos + mMaxFrameLength, mFileSize);
+		qint64 avail = qMin(end - pos, len - offset);
+		te_jpeg_frame_status status = jpeg_parse_frame(data + offset, avail, &frame);
+		if(status == JPEG_FRAME_NEED_MORE && avail < end - pos) {
+			if(mMapped) {
+				status = jpeg_parse_frame(mMapped->data() + pos, end - pos, &frame);
+			} else {
+				int found = parseLongFrame(file, pos, avail, end, &frame);
+				if(found < 0) {
+					CPP_DELETE_ARRAY(buffer);
+					range->error = true;
+					mErrors.fetchAndAddRelaxed(1);
+					return;
+				}
+				status = (found > 0 ? JPEG_FRAME_OK : JPEG_FRAME_BROKEN);
+			}
+		}
+		if(status == JPEG_FRAME_OK) {
+			t_frame_candidate candidate;
+			candidate.pos = pos;
+			candidate.length = frame.length;
+			memcpy(candidate.tag, data + offset, 4);
+			range->candidates.append(candidate);
+		}
+		offset++;
+	}
+	// Added once per range, so the threads don't share the counters in the loop
+	g_metrics.add(METRIC_BYTES_SCANNED, scan_len);
+	g_metrics.add(METRIC_CANDIDATES, parsed);
+	g_metrics.add(METRIC_BROKEN_CANDIDATES, parsed - range->candidates.size());
+
+	CPP_DELETE_ARRAY(buffer);
+	range->done = true;
+	mScannedBytes.fetchAndAddRelaxed(range_len);
+
+	MSG_PRINT(LOG_DEBUG, "Range [%lld, %lld[: %d frames",
+			  range->start, range->end, range->candidates.size());
+}
+
+void RecoverParallelExtractor::stitch() {
+	mFrames.clear();
+
+	QVector<t_frame_candidate> candidates;
+	for(int r = 0; r < mRanges.size(); ++r) {
+		candidates += mRanges[r].candidates;
+	}
+
+	qint64 pos = 0;
+	bool tagKnown = false;
+	uint8_t tag[4];
+	int first = 0;
+	int count = candidates.size();
+	// Same bound of the tag search as the sequential extractor, so the same frames are selected
+	RecoverFramePredictor predictor;
+
+	for(;;) {
+		while(first < count && candidates[first].pos < pos) {
+			first++;
+		}
+		if(first >= count) {
+			break;
+		}
+
+		// Accelerated pass: first frame with the known tag
+		int selected = -1;
+		if(tagKnown) {
+			qint64 limit = pos + predictor.tagSearchLength(TAG_SEARCH_LEN);
+			for(int i = first; i < count && candidates[i].pos < limit; ++i) {
+				if(memcmp(candidates[i].tag, tag, 4) == 0) {
+					selected = i;
+					break;
+				}
+			}
+			if(selected < 0) {
+				MSG_PRINT(LOG_WARNING, "Cannot find JPEG with accelerated tag after %lld, revert to normal", pos);
+				g_metrics.add(METRIC_FALLBACK_SCANS);
+				tagKnown = false;
+			}
+		}
+		// Normal pass: first frame
+		if(selected < 0) {
+			selected = first;
+		}
+
+		const t_frame_candidate & frame = candidates[selected];
+		if(mFrames.isEmpty()) {
+			memcpy(tag, frame.tag, 4);
+			tagKnown = true;
+		} else if(tagKnown && memcmp(tag, frame.tag, 4) != 0) {
+			MSG_PRINT(LOG_ERROR, "Not constant header at %lld", frame.pos);
+			tagKnown = false;
+		}
+
+		mFrames.append(frame);
+		g_metrics.add(METRIC_FRAMES);
+		predictor.addFrame(frame.pos - pos, frame.length);
+		pos = frame.pos + frame.length;
+	}
+}
+
+void RecoverParallelExtractor::saveFrames(int first, int last) {
+	QFile file(mFilename);
+	uint8_t * buffer = NULL;
+	if(!mMapped) {
+		if(!file.open(QFile::ReadOnly)) {
+			MSG_PRINT(LOG_ERROR, "Cannot open '%s'", qPrintable(mFilename));
+			mErrors.fetchAndAddRelaxed(1);
+			return;
+		}
+		// Sized for the largest frame of the block
+		qint64 maxLength = 1;
+		for(int index = first; index < last; ++index) {
+			maxLength = qMax(maxLength, mFrames[index].length);
+		}
+		CPP_ALLOC_ARRAY(buffer, uint8_t, maxLength);
+	}
+
+	for(int index = first; index < last; ++index) {
+		const t_frame_candidate & frame = mFrames[index];
+		const uint8_t * data = NULL;
+		if(mMapped) {
+			// Written straight from the mapping
+			data = mMapped->data() + frame.pos;
+		} else if(readFrame(file, frame.pos, buffer, frame.length)) {
+			data = buffer;
+		} else {
+			MSG_PRINT(LOG_ERROR, "Read failed for frame at %lld", frame.pos);
+			mErrors.fetchAndAddRelaxed(1);
+			break;
+		}
+
+		t_jpeg_frame info;
+		if(mInsertDhtEnabled || mValidator.getLevel() != VALIDATE_STRUCTURE) {
+			jpeg_parse_frame(data, frame.length, &info);
+		}
+		const uint8_t * image = data;
+		qint64 imageLength = frame.length;
+		QByteArray withTables;
+		if(mInsertDhtEnabled && jpeg_needs_dht(&info)) {
+			withTables.resize((int)(frame.length + JPEG_STANDARD_DHT_LEN));
+			imageLength = jpeg_insert_dht(data, &info, (uint8_t *)withTables.data());
+			image = (const uint8_t *)withTables.constData();
+		}
+
+		QString imageFile = mDir.absoluteFilePath(RecoverExtractor::recoveredImageName(index + 1, mDigits));
+		if(RecoverExtractor::writeFile(imageFile, image, imageLength) < 0) {
+			mErrors.fetchAndAddRelaxed(1);
+			break;
+		}
+		if(mValidator.getLevel() != VALIDATE_STRUCTURE) {
+			// Already on a worker, so decoded here instead of queued
+			mValidator.verify(index + 1, data, frame.length, info.width, info.height);
+		}
+		mWrittenBytes.fetchAndAddRelaxed(imageLength);
+		mSavedFrames.fetchAndAddRelaxed(1);
+	}
+
+	CPP_DELETE_ARRAY(buffer);
+}
+
+void RecoverParallelExtractor::waitJobs(int progress_ms, bool saving) {
+	QThreadPool * pool = QThreadPool::globalInstance();
+	while(!pool->waitForDone(progress_ms > 0 ? progress_ms : -1)) {
+		emit progress(mScannedBytes.load(), mFileSize,
+					  saving ? mSavedFrames.load() : 0);
+	}
+}
+
+bool RecoverParallelExtractor::run(int progress_ms) {
+	QFile file(mFilename);
+	// Whole disks are read too, their file size is 0
+	mFileSize = file.open(QFile::ReadOnly) ? input_file_size(file) : 0;
+	file.close();
+	if(mFileSize <= 0) {
+		mStatus = tr("Cannot read file ") + mFilename;
+		return false;
+	}
+	if(!mDir.mkpath(".")) {
+		mStatus = tr("Cannot create directory ") + mDir.absolutePath();
+		return false;
+	}
+
+	CPP_DELETE(mMapped);
+	mMapped = NULL;
+	if(mInputMode == INPUT_MMAP) {
+		CPP_ALLOC(mMapped, RecoverMappedInput(mMaxFrameLength));
+		if(!mMapped->open(mFilename)) {
+			MSG_PRINT(LOG_WARNING, "%s, revert to read", qPrintable(mMapped->getStatus()));
+			CPP_DELETE(mMapped);
+			mMapped = NULL;
+		}
+	}
+
+	QThreadPool * pool = QThreadPool::globalInstance();
+	if(mThreadCount > 0) {
+		pool->setMaxThreadCount(mThreadCount);
+	}
+	mScannedBytes.store(0);
+	mWrittenBytes.store(0);
+	mSavedFrames.store(0);
+	mErrors.store(0);
+	mValidator.reset();
+
+	MSG_PRINT(LOG_INFO, "Scanning %lld bytes with %d threads, ranges of %lld bytes, input=%s",
+			  mFileSize, pool->maxThreadCount(), mRangeLength,
+			  input_mode_name(mMapped ? INPUT_MMAP : INPUT_READ));
+
+	// Scan ranges
+	mRanges.clear();
+	for(qint64 start = 0; start < mFileSize; start += mRangeLength) {
+		t_parallel_range range;
+		range.start = start;
+		range.end = qMin(start + mRangeLength, mFileSize);
+		range.done = false;
+		range.error = false;
+		mRanges.append(range);
+	}
+	for(int r = 0; r < mRanges.size(); ++r) {
+		pool->start(new RecoverScanJob(this, &mRanges[r]));
+	}
+	waitJobs(progress_ms, false);
+	if(mErrors.load() > 0) {
+		mStatus = tr("Scan failed");
+		return false;
+	}
+
+	// Select the frames in order
+	stitch();
+	mRanges.clear();
+	MSG_PRINT(LOG_INFO, "%d frames found, saving", mFrames.size());
+	// Same names as the sequential extraction
+	mDigits = mNameDigits;
+	if(mDigits <= 0) {
+		mDigits = RecoverExtractor::estimatedNameDigits(mFileSize, mFrames.isEmpty() ? 0 : mFrames[0].length);
+	}
+
+	// Save blocks of consecutive frames
+	int block = qMax(1, mFrames.size() / (pool->maxThreadCount() * 8));
+	for(int first = 0; first < mFrames.size(); first += block) {
+		pool->start(new RecoverSaveJob(this, first, qMin(first + block, mFrames.size())));
+	}
+	waitJobs(progress_ms, true);
+	if(mErrors.load() > 0) {
+		mStatus = tr("Saving frames failed");
+		return false;
+	}
+
+	mStatus = tr("End of file, finished");
+	return true;
+}
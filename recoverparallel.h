@@ -0,0 +1,164 @@
+/*! \file recoverparallel.h
+ * \brief Multi-threaded extraction of large files
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The file is split in ranges which are scanned on a thread pool, then the
+ * frames found in every range are stitched in order, with the same choices
+ * as the sequential RecoverExtractor, so the numbering is identical.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERPARALLEL_H
+#define RECOVERPARALLEL_H
+
+#include <QObject>
+#include <QString>
+#include <QDir>
+#include <QVector>
+#include <QAtomicInteger>
+
+#include "recoverextractor.h"
+
+/// Default size of the ranges scanned by each job
+#define PARALLEL_RANGE_LEN	(32*1024*1024)
+
+/*! \brief Complete JPEG frame found in a range */
+typedef struct {
+	qint64 pos;			///< Position of SOI in file
+	qint64 length;		///< Length of the frame, EOI included
+	uint8_t tag[4];		///< 4 first bytes, to emulate the accelerated search
+} t_frame_candidate;
+
+/*! \brief Frames found in one range of the file */
+typedef struct {
+	qint64 start;		///< First byte of the range
+	qint64 end;			///< Last byte + 1 of the range
+	bool done;			///< Range has been scanned
+	bool error;			///< Read failed
+	QVector<t_frame_candidate> candidates;	///< Complete frames starting in range
+} t_parallel_range;
+
+/*! \brief Parallel version of RecoverExtractor for large files */
+class RecoverParallelExtractor : public QObject {
+	Q_OBJECT
+public:
+	RecoverParallelExtractor();
+	~RecoverParallelExtractor();
+
+	/// \brief Set input file name and output directory
+	void setFilename(const QString & filename, const QString & outputDir);
+
+	/// \brief Set number of threads, 0 for the number of cores
+	void setThreadCount(int threads) { mThreadCount = threads; }
+
+	/// \brief Set how the input file is accessed, INPUT_READ by default
+	void setInputMode(te_input_mode mode) { mInputMode = mode; }
+
+	/// \brief Set the length of the longest frame, MAX_JPEG_LEN by default
+	void setMaxFrameLength(qint64 len) { mMaxFrameLength = len; }
+
+	/// \brief Write the frames without Huffman tables with the standard ones, false by default
+	void setInsertDhtEnabled(bool on) { mInsertDhtEnabled = on; }
+
+	/// \brief Set the verification of the frames after the structure check
+	void setValidationLevel(te_validation_level level) { mValidator.setLevel(level); }
+
+	/// \brief Get number of frames which could not be decoded
+	int getInvalidCount() { return mValidator.getInvalidCount(); }
+
+	/// \brief Get number of frames decoded by the validation
+	int getDecodeCount() { return mValidator.getCheckedCount(); }
+
+	/// \brief Get numbers of the frames which could not be decoded
+	QVector<int> getInvalidFrames() { return mValidator.getInvalidFrames(); }
+
+	/// \brief Set size of the ranges scanned by each job
+	void setRangeLength(qint64 len) { mRangeLength = len; }
+
+	/// \brief Set the number of digits of the image names, 0 to size them like the sequential extraction
+	void setNameDigits(int digits) { mNameDigits = digits; }
+
+	/// \brief Get the number of digits of the image names, known after the scan
+	int getNameDigits() { return mDigits; }
+
+	/*! \brief Scan the whole file, then save the frames
+	 * \param progress_ms period of progress() signal, 0 to disable
+	 * \return false on read or write error
+	 */
+	bool run(int progress_ms);
+
+	/// \brief Get status string
+	QString getStatus() { return mStatus; }
+
+	/// \brief Get number of recovered images
+	int getImageCount() { return mFrames.size(); }
+
+	/// \brief Get number of bytes written in recovered images
+	qint64 getWrittenBytes() { return mWrittenBytes.load(); }
+
+	/// \brief Get size of input file
+	qint64 getFileSize() { return mFileSize; }
+
+	/// \brief Get output directory
+	QString getOutputDirectory() { return mDir.absolutePath(); }
+
+	/// \brief Scan one range, called by the jobs
+	void scanRange(t_parallel_range * range);
+
+	/// \brief Save frames [first, last[, called by the jobs
+	void saveFrames(int first, int last);
+
+signals:
+	/// \brief Progress of the scan then of the saving
+	void progress(qint64 scanned, qint64 total, int frames);
+
+private:
+	/*! \brief Select the frames like the sequential extractor
+	 * Emulate the search from the end of the previous frame, with the
+	 * accelerated search of the known tag then the search of any SOI.
+	 */
+	void stitch();
+
+	/// \brief Run the jobs of the pool until they are done
+	void waitJobs(int progress_ms, bool saving);
+
+	QString mFilename;		///< Input file
+	QDir mDir;				///< Output directory
+	QString mStatus;		///< Status or error
+	qint64 mFileSize;		///< Size of input file
+	int mThreadCount;		///< Number of threads
+	qint64 mRangeLength;	///< Size of ranges
+	te_input_mode mInputMode;	///< How the input file is accessed
+	qint64 mMaxFrameLength;	///< Longest frame
+	bool mInsertDhtEnabled;	///< Write the standard Huffman tables in the frames without them
+	int mNameDigits;		///< Digits of the image names requested, 0 for automatic
+	int mDigits;			///< Digits of the image names
+
+	/// \brief Mapping shared by the jobs in INPUT_MMAP mode, NULL in INPUT_READ mode
+	RecoverMappedInput * mMapped;
+
+	QVector<t_parallel_range> mRanges;		///< Ranges of the file
+	QVector<t_frame_candidate> mFrames;		///< Selected frames, in order
+
+	QAtomicInteger<qint64> mScannedBytes;	///< Bytes scanned by the jobs
+	QAtomicInteger<qint64> mWrittenBytes;	///< Bytes written by the jobs
+	QAtomicInteger<int> mSavedFrames;		///< Frames written by the jobs
+	QAtomicInteger<int> mErrors;			///< Read or write errors in jobs
+
+	RecoverValidator mValidator;			///< Decoding of the saved frames
+};
+
+#endif // RECOVERPARALLEL_H
@@ -0,0 +1,63 @@
+/*! \file recoverpredictor.cpp
+ * \brief Running model of the length of the frames and of the gaps between them
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverpredictor.h"
+
+RecoverFramePredictor::RecoverFramePredictor() {
+	reset();
+}
+
+void RecoverFramePredictor::reset() {
+	mCount = 0;
+	mMaxSpan = 0;
+}
+
+void RecoverFramePredictor::addFrame(qint64 gap, qint64 length) {
+	int slot = mCount % PREDICTOR_HISTORY;
+	mGaps[slot] = qMax(gap, (qint64)0);
+	mLengths[slot] = length;
+	mCount++;
+	mMaxSpan = -1;
+}
+
+qint64 RecoverFramePredictor::maxSpan() {
+	if(mMaxSpan < 0) {
+		mMaxSpan = 0;
+		for(int i = 0; i < qMin(mCount, PREDICTOR_HISTORY); i++) {
+			mMaxSpan = qMax(mMaxSpan, mGaps[i] + mLengths[i]);
+		}
+	}
+	return mMaxSpan;
+}
+
+qint64 RecoverFramePredictor::windowLength(qint64 maxWindow) {
+	if(!isReady()) {
+		return maxWindow;
+	}
+	// A quarter more for the variable bitrate, a larger frame is read again
+	qint64 span = maxSpan();
+	return qMin(span + span / 4, maxWindow);
+}
+
+qint64 RecoverFramePredictor::tagSearchLength(qint64 maxLength) {
+	if(!isReady()) {
+		return maxLength;
+	}
+	qint64 length = qMax(PREDICTOR_TAG_SEARCH_SPANS * maxSpan(), (qint64)PREDICTOR_MIN_TAG_SEARCH);
+	return qMin(length, maxLength);
+}
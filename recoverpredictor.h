@@ -0,0 +1,79 @@
+/*! \file recoverpredictor.h
+ * \brief Running model of the length of the frames and of the gaps between them
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The last frames found give the bytes the next one should need: the
+ * inputs read just enough to parse it at once, instead of a fixed window,
+ * and the search of the known tag gives up after a few frames of bytes,
+ * instead of the length of the largest possible frame.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERPREDICTOR_H
+#define RECOVERPREDICTOR_H
+
+#include <QtGlobal>
+
+/// Number of frames in the model, older ones are forgotten
+#define PREDICTOR_HISTORY	32
+
+/// Number of frames before the predictions are used
+#define PREDICTOR_MIN_FRAMES	4
+
+/// The known tag is searched over this number of the largest recent spans
+#define PREDICTOR_TAG_SEARCH_SPANS	16
+
+/// Min length of the search of the known tag
+#define PREDICTOR_MIN_TAG_SEARCH	(1024*1024)
+
+/*! \brief Moving window of the last frames */
+class RecoverFramePredictor {
+public:
+	RecoverFramePredictor();
+
+	/// \brief Forget all the frames
+	void reset();
+
+	/*! \brief Add a frame found
+	 * \param gap bytes between the end of the previous frame and this one
+	 * \param length length of the frame
+	 */
+	void addFrame(qint64 gap, qint64 length);
+
+	/// \brief Return true when there are enough frames to predict
+	bool isReady() { return mCount >= PREDICTOR_MIN_FRAMES; }
+
+	/// \brief Largest gap and frame of the recent frames
+	qint64 maxSpan();
+
+	/*! \brief Bytes to have at the start of the next search, so the next frame is parsed at once
+	 * \param maxWindow max length of the windows, returned until isReady()
+	 */
+	qint64 windowLength(qint64 maxWindow);
+
+	/*! \brief Length of the search of the known tag from the end of the last frame
+	 * \param maxLength longest search, returned until isReady()
+	 */
+	qint64 tagSearchLength(qint64 maxLength);
+
+private:
+	qint64 mGaps[PREDICTOR_HISTORY];	///< Ring of the gaps
+	qint64 mLengths[PREDICTOR_HISTORY];	///< Ring of the lengths
+	int mCount;		///< Number of frames added, the ring holds the last PREDICTOR_HISTORY
+	qint64 mMaxSpan;	///< Cache of maxSpan(), -1 when outdated
+};
+
+#endif // RECOVERPREDICTOR_H
@@ -0,0 +1,127 @@
+/*! \file recoverqueue.h
+ * \brief Bounded queue between two stages of the extraction
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * One thread pushes, another one pops. The items are in a ring, so only
+ * the indexes move, without lock while the ring is neither full nor
+ * empty. The producer waits when the ring is full, which slows the faster
+ * stage down to the slower one, and the consumer when it is empty.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERQUEUE_H
+#define RECOVERQUEUE_H
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QWaitCondition>
+
+/*! \brief Single producer, single consumer ring of fixed capacity
+ * The counters of the items pushed and popped only grow, on 64 bits so
+ * they never wrap. Each thread writes its own counter and reads the other
+ * one, and takes the mutex only to wait.
+ */
+template <class T>
+class RecoverQueue {
+public:
+	RecoverQueue(int capacity) {
+		mItems.resize(capacity);
+		mHead.store(0);
+		mTail.store(0);
+		mWaiters.store(0);
+	}
+
+	/// \brief Append an item, wait while the queue is full
+	void push(const T & item) {
+		quint64 tail = mTail.load();
+		quint64 size = (quint64)mItems.size();
+		if(tail - mHead.loadAcquire() >= size) {
+			waitUntil([&]() { return tail - mHead.fetchAndAddOrdered(0) < size; });
+		}
+		mItems[(int)(tail % size)] = item;
+		mTail.fetchAndStoreOrdered(tail + 1);
+		wakeWaiter();
+	}
+
+	/// \brief Take the oldest item, wait while the queue is empty
+	T pop() {
+		quint64 head = mHead.load();
+		if(mTail.loadAcquire() == head) {
+			waitUntil([&]() { return mTail.fetchAndAddOrdered(0) != head; });
+		}
+		return take(head);
+	}
+
+	/// \brief Take the oldest item if any, without waiting
+	bool tryPop(T * item) {
+		quint64 head = mHead.load();
+		if(mTail.loadAcquire() == head) {
+			return false;
+		}
+		*item = take(head);
+		return true;
+	}
+
+	/// \brief Number of items waiting, for statistics
+	int depth() { return (int)(mTail.loadAcquire() - mHead.loadAcquire()); }
+
+	/// \brief Max number of items
+	int capacity() { return mItems.size(); }
+
+private:
+	/// \brief Take the item at head, which has been pushed
+	T take(quint64 head) {
+		int index = (int)(head % (quint64)mItems.size());
+		T item = mItems[index];
+		mItems[index] = T();
+		mHead.fetchAndStoreOrdered(head + 1);
+		wakeWaiter();
+		return item;
+	}
+
+	/*! \brief Wait until ready() is true, after a change of the other thread
+	 * ready() reads the other counter with an ordered operation, so either
+	 * it sees the change, or the other thread sees the waiter and wakes it up.
+	 */
+	template <class F>
+	void waitUntil(F ready) {
+		QMutexLocker locker(&mMutex);
+		mWaiters.fetchAndAddOrdered(1);
+		while(!ready()) {
+			mChanged.wait(&mMutex);
+		}
+		mWaiters.fetchAndAddOrdered(-1);
+	}
+
+	/// \brief Wake the other thread up if it waits
+	void wakeWaiter() {
+		if(mWaiters.fetchAndAddOrdered(0) > 0) {
+			QMutexLocker locker(&mMutex);
+			mChanged.wakeAll();
+		}
+	}
+
+	QVector<T> mItems;				///< Ring of items
+	QAtomicInteger<quint64> mHead;	///< Count of items popped
+	QAtomicInteger<quint64> mTail;	///< Count of items pushed
+	QAtomicInteger<int> mWaiters;	///< Threads waiting for a change
+	QMutex mMutex;					///< Taken only to wait
+	QWaitCondition mChanged;		///< Signaled after a change when a thread waits
+};
+
+#endif // RECOVERQUEUE_H
@@ -0,0 +1,93 @@
+/*! \file recoversequence.cpp
+ * \brief Grouping of the frames carved from a disk in recordings
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoversequence.h"
+#include "recoverextractor.h"
+
+#include <QSaveFile>
+
+RecoverSequences::RecoverSequences() {
+	mClusterSize = SEQUENCE_DEFAULT_CLUSTER;
+}
+
+bool RecoverSequences::addFrame(int number, qint64 pos, const uint8_t * data,
+								const t_jpeg_frame & frame) {
+	bool start = mSequences.isEmpty();
+	if(!start) {
+		const t_frame_sequence & last = mSequences.last();
+		qint64 gap = pos - last.end;
+		if(memcmp(last.tag, data, 4) != 0
+				|| last.width != frame.width || last.height != frame.height) {
+			start = true;
+		} else if(pos / mClusterSize != last.end / mClusterSize
+				  && pos % mClusterSize < SEQUENCE_MAX_HEADER_LEN
+				  && (gap >= mClusterSize
+					  || (last.last > last.first && gap > SEQUENCE_GAP_RATIO * last.maxGap))) {
+			// The end of a file, its index and the header of the next one
+			start = true;
+		}
+	}
+
+	if(start) {
+		t_frame_sequence sequence;
+		sequence.first = number;
+		sequence.start = pos;
+		sequence.width = frame.width;
+		sequence.height = frame.height;
+		sequence.maxGap = 0;
+		memcpy(sequence.tag, data, 4);
+		mSequences.append(sequence);
+		MSG_PRINT(LOG_INFO, "Sequence #%d starts at frame #%d, offset %lld, %dx%d",
+				  mSequences.size(), number, pos, frame.width, frame.height);
+	}
+	t_frame_sequence & sequence = mSequences.last();
+	if(!start) {
+		sequence.maxGap = qMax(sequence.maxGap, pos - sequence.end);
+	}
+	sequence.last = number;
+	sequence.end = pos + frame.length;
+	return start;
+}
+
+bool RecoverSequences::write(const QString & path) {
+	QString csv("sequence,first_frame,last_frame,frames,offset,end,width,height,header\n");
+	for(int i = 0; i < mSequences.size(); i++) {
+		const t_frame_sequence & item = mSequences[i];
+		QString tag;
+		tag.sprintf("%02x%02x%02x%02x", item.tag[0], item.tag[1], item.tag[2], item.tag[3]);
+		csv += QString::number(i + 1) + ","
+				+ QString::number(item.first) + ","
+				+ QString::number(item.last) + ","
+				+ QString::number(item.last - item.first + 1) + ","
+				+ QString::number(item.start) + ","
+				+ QString::number(item.end) + ","
+				+ QString::number(item.width) + ","
+				+ QString::number(item.height) + ","
+				+ tag + "\n";
+	}
+	QByteArray data = csv.toUtf8();
+	QSaveFile file(path);
+	if(!file.open(QIODevice::WriteOnly)
+			|| file.write(data) != data.size()
+			|| !file.commit()) {
+		mStatus = QObject::tr("Cannot write sequences ") + path;
+		MSG_PRINT(LOG_ERROR, "Cannot write sequences in '%s'", qPrintable(path));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,94 @@
+/*! \file recoversequence.h
+ * \brief Grouping of the frames carved from a disk in recordings
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * On a whole SD card, the frames of many recordings follow each other, and
+ * the fragments of a file may be interleaved with the others. A frame
+ * starts a new sequence when its header or its size changes, or when it
+ * starts near the beginning of a cluster after a gap which crosses the
+ * cluster boundary and is longer than a cluster or than the gaps seen
+ * between the frames of the sequence, like the first frame after the index
+ * of a file and the header of the next one. A frame after a gap but in the
+ * middle of a cluster continues the sequence: its file was fragmented, and
+ * the frame cut by the fragment was broken.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERSEQUENCE_H
+#define RECOVERSEQUENCE_H
+
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+#include "jpegparser.h"
+
+/// Default cluster size of the file system, the allocation unit of the SD cards
+#define SEQUENCE_DEFAULT_CLUSTER	(32*1024)
+
+/// Max bytes of a container header before the first frame of a file
+#define SEQUENCE_MAX_HEADER_LEN	(64*1024)
+
+/// A gap this many times longer than the others of the sequence ends it
+#define SEQUENCE_GAP_RATIO	4
+
+/*! \brief Frames of one recording */
+typedef struct {
+	int first;			///< Number of the first frame
+	int last;			///< Number of the last frame
+	qint64 start;		///< Position of the first frame
+	qint64 end;			///< End of the last frame
+	int width;			///< Width of the frames
+	int height;			///< Height of the frames
+	qint64 maxGap;		///< Longest gap between two frames of the sequence
+	uint8_t tag[4];		///< First 4 bytes of the frames
+} t_frame_sequence;
+
+/*! \brief Group the frames in sequences while they are found */
+class RecoverSequences {
+public:
+	RecoverSequences();
+
+	/// \brief Set the cluster size of the file system of the disk, in bytes
+	void setClusterSize(qint64 size) { mClusterSize = qMax(size, (qint64)1); }
+
+	/// \brief Clear the sequences
+	void reset() { mSequences.clear(); }
+
+	/*! \brief Add the next frame, in the order of the disk
+	 * \param number number of the frame
+	 * \param pos position of the frame in the disk
+	 * \param data frame, from SOI
+	 * \return true if the frame starts a new sequence
+	 */
+	bool addFrame(int number, qint64 pos, const uint8_t * data, const t_jpeg_frame & frame);
+
+	/// \brief Get the sequences
+	const QVector<t_frame_sequence> & sequences() { return mSequences; }
+
+	/// \brief Write the sequences in CSV, false on error with getStatus()
+	bool write(const QString & path);
+
+	/// \brief Get error string
+	QString getStatus() { return mStatus; }
+
+private:
+	QString mStatus;		///< Error
+	qint64 mClusterSize;	///< Cluster size of the file system
+	QVector<t_frame_sequence> mSequences;	///< Sequences found
+};
+
+#endif // RECOVERSEQUENCE_H
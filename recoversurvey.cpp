@@ -0,0 +1,369 @@
+/*! \file recoversurvey.cpp
+ * \brief Quick survey of a broken file, before the full extraction
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoversurvey.h"
+#include "recoverextractor.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+const char * c_survey_container_names[SURVEY_CONTAINER_MAX] = {
+	"raw",
+	"avi",
+	"mov"
+};
+
+const char * survey_container_name(int container) {
+	if(container < 0 || container >= SURVEY_CONTAINER_MAX) {
+		return "invalid";
+	}
+	return c_survey_container_names[container];
+}
+
+const char c_survey_region_chars[SURVEY_REGION_MAX] = {
+	'#',
+	'+',
+	'.',
+	'x'
+};
+
+char survey_region_char(int region) {
+	if(region < 0 || region >= SURVEY_REGION_MAX) {
+		return '?';
+	}
+	return c_survey_region_chars[region];
+}
+
+RecoverSurvey::RecoverSurvey() {
+	mSampleCount = SURVEY_DEFAULT_SAMPLES;
+	mFileSize = 0;
+	mTag = 0;
+	mTagCount = 0;
+	mThumbnails = 0;
+	mContainer = SURVEY_CONTAINER_RAW;
+	mIndexedFrames = -1;
+	mReadTime = mScanTime = 0;
+	mEstimatedFrames = mEstimatedBytes = 0;
+	mEstimatedSeconds = 0.;
+}
+
+void RecoverSurvey::readContainer(QFile & file) {
+	mContainer = SURVEY_CONTAINER_RAW;
+	mIndexedFrames = -1;
+	char header[12];
+	if(!file.seek(0) || file.read(header, sizeof(header)) != sizeof(header)) {
+		return;
+	}
+	if(memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "AVI ", 4) == 0) {
+		mContainer = SURVEY_CONTAINER_AVI;
+		return;
+	}
+	const char * atoms[] = { "ftyp", "moov", "mdat", "wide", "free", "skip" };
+	for(unsigned int i = 0; i < sizeof(atoms) / sizeof(atoms[0]); i++) {
+		if(memcmp(header + 4, atoms[i], 4) == 0) {
+			mContainer = SURVEY_CONTAINER_MOV;
+			break;
+		}
+	}
+	// Only the moov atom is read, the AVI index may need a walk of the whole file
+	if(mContainer == SURVEY_CONTAINER_MOV) {
+		QVector<t_jpeg_extent> samples;
+		if(mov_parse_samples(file, &samples) > 0) {
+			mIndexedFrames = samples.size();
+		}
+	}
+}
+
+void RecoverSurvey::scanRegion(const uint8_t * buffer, t_survey_region * region) {
+	qint64 len = region->length;
+	region->frames = region->broken = 0;
+	region->frameBytes = region->zeroBytes = 0;
+
+	for(qint64 block = 0; block < len; block += SURVEY_ZERO_BLOCK) {
+		qint64 blockLen = qMin((qint64)SURVEY_ZERO_BLOCK, len - block);
+		const uint8_t * data = buffer + block;
+		if(data[0] == 0 && memcmp(data, data + 1, blockLen - 1) == 0) {
+			region->zeroBytes += blockLen;
+		}
+	}
+
+	qint64 offset = 0;
+	qint64 first = -1;
+	qint64 end = len;
+	while(offset < len) {
+		offset = jpeg_scan_soi(buffer, len, offset);
+		if(offset < 0) {
+			break;
+		}
+		t_jpeg_frame frame;
+		te_jpeg_frame_status status = jpeg_parse_frame(buffer + offset, len - offset, &frame);
+		t_survey_frame found;
+		found.complete = (status == JPEG_FRAME_OK);
+		found.embedded = false;
+		found.length = frame.length;
+		// The SOI pattern is 3 bytes, so it may end the region
+		found.tag = 0;
+		if(offset + 4 <= len) {
+			found.tag = ((uint32_t)buffer[offset] << 24) | ((uint32_t)buffer[offset + 1] << 16)
+					| ((uint32_t)buffer[offset + 2] << 8) | (uint32_t)buffer[offset + 3];
+		}
+		found.width = frame.width;
+		found.height = frame.height;
+		if(status == JPEG_FRAME_NEED_MORE) {
+			// Continues after the region, only counted in the number of frames
+			mFrames.append(found);
+			end = offset;
+			break;
+		}
+		if(status == JPEG_FRAME_BROKEN) {
+			region->broken++;
+			offset += 2;
+			continue;
+		}
+		if(first < 0) {
+			first = offset;
+		}
+		region->frames++;
+		region->frameBytes += frame.length;
+
+		// Like the extraction, the thumbnails inside the frame are skipped
+		offset += frame.length;
+		// The frames of a movie follow each other, a thumbnail is followed by the rest of its frame
+		qint64 next = jpeg_scan_soi(buffer, len, offset);
+		found.embedded = (next >= 0 && next - offset > qMax(frame.length / 4, (qint64)SURVEY_ZERO_BLOCK));
+		mFrames.append(found);
+		if(next < 0) {
+			break;
+		}
+		offset = next;
+	}
+
+	// The frames cut by both ends of the region are not counted, nor their bytes
+	region->scanned = (first < 0 ? len : end - first);
+
+	if(region->frames > 0) {
+		region->type = (2 * region->frameBytes >= len ? SURVEY_REGION_FRAMES : SURVEY_REGION_PARTIAL);
+	} else if(region->zeroBytes == len) {
+		region->type = SURVEY_REGION_ZERO;
+	} else {
+		region->type = SURVEY_REGION_NO_FRAME;
+	}
+}
+
+bool RecoverSurvey::run(const QString & filename) {
+	mFilename = filename;
+	mRegions.clear();
+	mFrames.clear();
+	mReadTime = mScanTime = 0;
+
+	QFile file(filename);
+	if(file.isSequential() || !file.open(QIODevice::ReadOnly)) {
+		mStatus = QObject::tr("Cannot open file ") + filename;
+		MSG_PRINT(LOG_ERROR, "Cannot open '%s' for the survey", qPrintable(filename));
+		return false;
+	}
+	mFileSize = input_file_size(file);
+	readContainer(file);
+
+	// Small files are read entirely, in consecutive regions
+	qint64 count = mSampleCount;
+	bool spread = (mFileSize > count * SURVEY_SAMPLE_LEN);
+	if(!spread) {
+		count = (mFileSize + SURVEY_SAMPLE_LEN - 1) / SURVEY_SAMPLE_LEN;
+	}
+
+	uint8_t * buffer = NULL;
+	CPP_ALLOC_ARRAY(buffer, uint8_t, SURVEY_SAMPLE_LEN);
+	QElapsedTimer timer;
+	for(qint64 i = 0; i < count; i++) {
+		t_survey_region region;
+		region.pos = i * SURVEY_SAMPLE_LEN;
+		if(spread && count > 1) {
+			// From the start to the end of file, on block boundaries
+			region.pos = i * (mFileSize - SURVEY_SAMPLE_LEN) / (count - 1);
+			region.pos -= region.pos % SURVEY_ZERO_BLOCK;
+		}
+		region.length = qMin((qint64)SURVEY_SAMPLE_LEN, mFileSize - region.pos);
+
+		timer.start();
+		if(!file.seek(region.pos)
+				|| file.read((char *)buffer, region.length) != region.length) {
+			mStatus = QObject::tr("Cannot read file ") + filename;
+			MSG_PRINT(LOG_ERROR, "Cannot read %lld bytes at %lld in '%s'",
+					  region.length, region.pos, qPrintable(filename));
+			CPP_DELETE_ARRAY(buffer);
+			return false;
+		}
+		mReadTime += timer.nsecsElapsed();
+
+		timer.start();
+		scanRegion(buffer, &region);
+		mScanTime += timer.nsecsElapsed();
+		mRegions.append(region);
+	}
+	CPP_DELETE_ARRAY(buffer);
+
+	estimate();
+	MSG_PRINT(LOG_INFO, "Survey of '%s': %d regions, %d frames found, %lld expected",
+			  qPrintable(filename), mRegions.size(), mLengths.size(), mEstimatedFrames);
+	return true;
+}
+
+void RecoverSurvey::estimate() {
+	QMap<uint32_t, int> tags;
+	for(int i = 0; i < mFrames.size(); i++) {
+		tags[mFrames[i].tag]++;
+	}
+	mTag = 0;
+	mTagCount = 0;
+	for(QMap<uint32_t, int>::const_iterator it = tags.constBegin(); it != tags.constEnd(); ++it) {
+		if(it.value() > mTagCount) {
+			mTag = it.key();
+			mTagCount = it.value();
+		}
+	}
+
+	mLengths.clear();
+	mSizes.clear();
+	mThumbnails = 0;
+	qint64 starts = 0;
+	qint64 frames = 0;
+	qint64 frameBytes = 0;
+	for(int i = 0; i < mFrames.size(); i++) {
+		// Thumbnails of the frames cut by the start of a region, or of broken frames
+		if(mFrames[i].embedded && mFrames[i].tag != mTag) {
+			mThumbnails++;
+			continue;
+		}
+		// Each frame starting in a region is counted once, even the large ones cut by its end
+		starts++;
+		if(!mFrames[i].complete) {
+			continue;
+		}
+		mLengths.append(mFrames[i].length);
+		mSizes[QString("%1x%2").arg(mFrames[i].width).arg(mFrames[i].height)]++;
+		frames++;
+		frameBytes += mFrames[i].length;
+	}
+	std::sort(mLengths.begin(), mLengths.end());
+
+	qint64 read = 0;
+	qint64 sampled = 0;
+	for(int i = 0; i < mRegions.size(); i++) {
+		read += mRegions[i].length;
+		sampled += mRegions[i].scanned;
+	}
+	mEstimatedFrames = mEstimatedBytes = 0;
+	mEstimatedSeconds = 0.;
+	if(sampled <= 0) {
+		return;
+	}
+
+	// The complete frames are fewer at the ends of the regions, so the bytes
+	// are counted between the frames cut by them, but the starts in the whole region
+	if(frames > 0) {
+		mEstimatedBytes = (qint64)((double)frameBytes * (double)mFileSize / (double)sampled);
+		mEstimatedFrames = (qint64)((double)starts * (double)mFileSize / (double)read + 0.5);
+	}
+
+	// Sequential reads are faster than the reads of the regions, but the extraction
+	// does more for each frame than the survey, so both are added
+	double rate = (mReadTime + mScanTime > 0 ? (double)read * 1e9 / (double)(mReadTime + mScanTime) : 0.);
+	if(rate > 0.) {
+		mEstimatedSeconds = (double)mFileSize / rate;
+	}
+}
+
+qint64 RecoverSurvey::lengthPercentile(int percent) {
+	if(mLengths.isEmpty()) {
+		return 0;
+	}
+	int rank = (int)((qint64)percent * (mLengths.size() - 1) / 100);
+	return mLengths[rank];
+}
+
+QString RecoverSurvey::report() {
+	const double MB = 1024. * 1024.;
+	QString text;
+	text += QString("Survey of '%1': %2 MB, %3 regions of %4 MB read\n")
+			.arg(mFilename)
+			.arg((double)mFileSize / MB, 0, 'f', 1)
+			.arg(mRegions.size())
+			.arg(SURVEY_SAMPLE_LEN / (1024 * 1024));
+
+	text += QString("Container: %1").arg(survey_container_name(mContainer));
+	if(mIndexedFrames >= 0) {
+		text += QString(", %1 frames in the sample tables").arg(mIndexedFrames);
+	}
+	text += "\n";
+
+	int found = 0;
+	for(int i = 0; i < mRegions.size(); i++) {
+		found += mRegions[i].frames;
+	}
+	text += QString("Frames found: %1, expected in the whole file: about %2\n")
+			.arg(found).arg(mEstimatedFrames);
+	if(!mLengths.isEmpty()) {
+		text += QString("Frame length: min %1, 10% %2, median %3, 90% %4, max %5 bytes\n")
+				.arg(lengthPercentile(0)).arg(lengthPercentile(10))
+				.arg(lengthPercentile(50)).arg(lengthPercentile(90))
+				.arg(lengthPercentile(100));
+
+		QString size;
+		int sizeCount = 0;
+		for(QMap<QString, int>::const_iterator it = mSizes.constBegin(); it != mSizes.constEnd(); ++it) {
+			if(it.value() > sizeCount) {
+				size = it.key();
+				sizeCount = it.value();
+			}
+		}
+		text += QString("Image size: %1 for %2% of the frames\n")
+				.arg(size).arg(100 * sizeCount / mLengths.size());
+
+		text += QString("Header: 0x%1 for %2 frames, %3 thumbnails not counted\n")
+				.arg(mTag, 8, 16, QChar('0'))
+				.arg(mTagCount)
+				.arg(mThumbnails);
+	}
+
+	int types[SURVEY_REGION_MAX] = { 0 };
+	for(int i = 0; i < mRegions.size(); i++) {
+		types[mRegions[i].type]++;
+	}
+	text += QString("Regions: %1 with frames, %2 partial, %3 zeroed, %4 without frames\n")
+			.arg(types[SURVEY_REGION_FRAMES]).arg(types[SURVEY_REGION_PARTIAL])
+			.arg(types[SURVEY_REGION_ZERO]).arg(types[SURVEY_REGION_NO_FRAME]);
+	text += QString("Map: %1 frames, %2 partial, %3 zeros, %4 no frame\n")
+			.arg(QChar(survey_region_char(SURVEY_REGION_FRAMES)))
+			.arg(QChar(survey_region_char(SURVEY_REGION_PARTIAL)))
+			.arg(QChar(survey_region_char(SURVEY_REGION_ZERO)))
+			.arg(QChar(survey_region_char(SURVEY_REGION_NO_FRAME)));
+	for(int i = 0; i < mRegions.size(); i += SURVEY_MAP_WIDTH) {
+		QString line = QString("  %1 MB  ").arg((double)mRegions[i].pos / MB, 10, 'f', 1);
+		for(int j = i; j < qMin(i + SURVEY_MAP_WIDTH, mRegions.size()); j++) {
+			line += survey_region_char(mRegions[j].type);
+		}
+		text += line + "\n";
+	}
+
+	text += QString("Full extraction: about %1 s to read and scan the file, plus the writes of %2 MB of images\n")
+			.arg(mEstimatedSeconds, 0, 'f', 2)
+			.arg((double)mEstimatedBytes / MB, 0, 'f', 1);
+	return text;
+}
@@ -0,0 +1,161 @@
+/*! \file recoversurvey.h
+ * \brief Quick survey of a broken file, before the full extraction
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * A few regions spread over the file are read and scanned like the
+ * extraction does, so within seconds even for a large file, the survey
+ * tells how many frames may be recovered, their size, their header, the
+ * container, where the file looks zeroed or damaged, and how long and how
+ * much disk the full extraction should take.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERSURVEY_H
+#define RECOVERSURVEY_H
+
+#include <QFile>
+#include <QMap>
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+/// Default number of regions read by the survey
+#define SURVEY_DEFAULT_SAMPLES	64
+
+/// Bytes read in each region
+#define SURVEY_SAMPLE_LEN	(4*1024*1024)
+
+/// Size of the blocks checked for zeros, like a disk sector cluster
+#define SURVEY_ZERO_BLOCK	4096
+
+/// Regions shown on each line of the map
+#define SURVEY_MAP_WIDTH	64
+
+/*! \brief Container guessed from the first bytes of the file */
+typedef enum {
+	SURVEY_CONTAINER_RAW,	///< no known header: raw stream, or header lost
+	SURVEY_CONTAINER_AVI,	///< RIFF AVI
+	SURVEY_CONTAINER_MOV,	///< QuickTime or MP4 atoms
+	SURVEY_CONTAINER_MAX
+} te_survey_container;
+
+/// \brief Name of the container, for the report
+const char * survey_container_name(int container);
+
+/*! \brief Content of a region read by the survey */
+typedef enum {
+	SURVEY_REGION_FRAMES,	///< frames over most of the region
+	SURVEY_REGION_PARTIAL,	///< some frames, among broken or unknown data
+	SURVEY_REGION_ZERO,		///< only zeros: erased or never written
+	SURVEY_REGION_NO_FRAME,	///< data without any complete frame
+	SURVEY_REGION_MAX
+} te_survey_region;
+
+/// \brief Character of the region in the map of the report
+char survey_region_char(int region);
+
+/*! \brief Result of one region */
+typedef struct {
+	qint64 pos;			///< Position of the region in file
+	qint64 length;		///< Bytes read
+	qint64 scanned;		///< Bytes between the frames cut by the ends of the region
+	te_survey_region type;	///< Content
+	int frames;			///< Complete frames found
+	int broken;			///< Candidates which are not a complete frame
+	qint64 frameBytes;	///< Bytes of the complete frames
+	qint64 zeroBytes;	///< Bytes in blocks of zeros
+} t_survey_region;
+
+/*! \brief Frame found in a region */
+typedef struct {
+	bool complete;		///< false if cut by the end of the region
+	bool embedded;		///< not followed by another frame, like a thumbnail
+	qint64 length;		///< Length of the frame, or bytes parsed when cut
+	uint32_t tag;		///< First 4 bytes, big endian
+	int width;			///< Width from SOF
+	int height;			///< Height from SOF
+} t_survey_frame;
+
+/*! \brief Sample a file and predict the result of its extraction */
+class RecoverSurvey {
+public:
+	RecoverSurvey();
+
+	/// \brief Set the number of regions read, spread evenly over the file
+	void setSampleCount(int count) { mSampleCount = qMax(count, 1); }
+
+	/*! \brief Read and scan the regions of the file
+	 * \return false if the file cannot be read, with getStatus()
+	 */
+	bool run(const QString & filename);
+
+	/// \brief Get the report, as text lines
+	QString report();
+
+	/// \brief Get frames expected from the whole file
+	qint64 estimatedFrames() { return mEstimatedFrames; }
+
+	/// \brief Get bytes of the images expected from the whole file
+	qint64 estimatedBytes() { return mEstimatedBytes; }
+
+	/// \brief Get time expected for the extraction of the whole file, in s
+	double estimatedSeconds() { return mEstimatedSeconds; }
+
+	/// \brief Get the regions read
+	const QVector<t_survey_region> & regions() { return mRegions; }
+
+	/// \brief Get error string
+	QString getStatus() { return mStatus; }
+
+private:
+	/// \brief Find the container from the first bytes
+	void readContainer(QFile & file);
+
+	/// \brief Scan one region read in buffer
+	void scanRegion(const uint8_t * buffer, t_survey_region * region);
+
+	/// \brief Compute the estimates from the regions
+	void estimate();
+
+	/// \brief Length of the frames at a rank, from 0 to 100 %
+	qint64 lengthPercentile(int percent);
+
+	QString mStatus;			///< Error
+	QString mFilename;			///< File surveyed
+	int mSampleCount;			///< Number of regions to read
+	qint64 mFileSize;			///< Size of the file
+
+	te_survey_container mContainer;	///< Container from the first bytes
+	int mIndexedFrames;			///< Frames of the MOV sample tables, -1 if none
+
+	QVector<t_survey_region> mRegions;	///< Regions read
+	QVector<t_survey_frame> mFrames;	///< Frames found in the regions, even cut
+
+	uint32_t mTag;				///< Most common first 4 bytes of the frames
+	int mTagCount;				///< Frames with this header
+	int mThumbnails;			///< Frames found inside other frames
+	QVector<qint64> mLengths;	///< Sorted lengths of the frames counted by the estimates
+	QMap<QString, int> mSizes;	///< Count of the frames counted by WxH
+
+	qint64 mReadTime;			///< Time of the reads, in ns
+	qint64 mScanTime;			///< Time of the scans, in ns
+
+	qint64 mEstimatedFrames;	///< Frames expected from the whole file
+	qint64 mEstimatedBytes;		///< Bytes of the images expected
+	double mEstimatedSeconds;	///< Time of the extraction expected, in s
+};
+
+#endif // RECOVERSURVEY_H
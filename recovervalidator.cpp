@@ -0,0 +1,164 @@
+/*! \file recovervalidator.cpp
+ * \brief Verification of the recovered frames by decoding
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recovervalidator.h"
+#include "recoverextractor.h"
+
+#include <QBuffer>
+#include <QImage>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSize>
+#include <QThread>
+
+#include <algorithm>
+
+const char * c_validation_level_names[VALIDATE_MAX] = {
+	"structure",
+	"scaled",
+	"full"
+};
+
+const char * validation_level_name(int level) {
+	if(level < 0 || level >= VALIDATE_MAX) {
+		return "invalid";
+	}
+	return c_validation_level_names[level];
+}
+
+/*! \brief Job decoding one frame */
+class RecoverValidateJob : public QRunnable {
+public:
+	RecoverValidateJob(RecoverValidator * validator, int index,
+					   const QByteArray & data, int width, int height)
+		: mValidator(validator), mIndex(index), mData(data),
+		  mWidth(width), mHeight(height) {}
+	void run() { mValidator->runJob(mIndex, mData, mWidth, mHeight); }
+private:
+	RecoverValidator * mValidator;
+	int mIndex;
+	QByteArray mData;
+	int mWidth;
+	int mHeight;
+};
+
+RecoverValidator::RecoverValidator()
+	: mSlots(QThread::idealThreadCount() * VALIDATE_PENDING_PER_THREAD) {
+	mLevel = VALIDATE_STRUCTURE;
+	mChecked.store(0);
+}
+
+RecoverValidator::~RecoverValidator() {
+	waitForDone();
+}
+
+void RecoverValidator::setThreadCount(int threads) {
+	int count = (threads > 0 ? threads : QThread::idealThreadCount());
+	// Nothing is queued anymore, so all the places are free
+	waitForDone();
+	mSlots.acquire(mSlots.available());
+	mSlots.release(count * VALIDATE_PENDING_PER_THREAD);
+	mPool.setMaxThreadCount(count);
+}
+
+void RecoverValidator::reset() {
+	waitForDone();
+	QMutexLocker locker(&mMutex);
+	mInvalid.clear();
+	mChecked.store(0);
+}
+
+bool RecoverValidator::decode(const QByteArray & data, te_validation_level level,
+							  int width, int height) {
+	QBuffer buffer;
+	t_jpeg_frame frame;
+	if(jpeg_parse_frame((const uint8_t *)data.constData(), data.size(), &frame) == JPEG_FRAME_OK
+			&& jpeg_needs_dht(&frame)) {
+		// Motion JPEG without Huffman tables, decoded with the standard ones
+		QByteArray withTables((int)(frame.length + JPEG_STANDARD_DHT_LEN), Qt::Uninitialized);
+		jpeg_insert_dht((const uint8_t *)data.constData(), &frame, (uint8_t *)withTables.data());
+		buffer.setData(withTables);
+	} else {
+		buffer.setData(data);
+	}
+	buffer.open(QIODevice::ReadOnly);
+	QImageReader reader(&buffer, "JPG");
+	if(level == VALIDATE_SCALED && width > 0 && height > 0) {
+		// The JPEG plugin gives the scale to libjpeg, so the IDCT is skipped
+		reader.setScaledSize(QSize(qMax(1, (width + 7) / 8), qMax(1, (height + 7) / 8)));
+	}
+	QImage image;
+	return reader.read(&image) && !image.isNull();
+}
+
+bool RecoverValidator::verify(int index, const uint8_t * data, qint64 len,
+							  int width, int height) {
+	if(mLevel == VALIDATE_STRUCTURE) {
+		return true;
+	}
+	bool ok = false;
+	{
+		RecoverMetricsTimer timer(TIMER_DECODE);
+		ok = decode(QByteArray::fromRawData((const char *)data, (int)len),
+					mLevel, width, height);
+	}
+	g_metrics.add(METRIC_DECODED);
+	if(!ok) {
+		g_metrics.add(METRIC_DECODE_FAILURES);
+		MSG_PRINT(LOG_WARNING, "%s is not decodable (%s check)",
+				  qPrintable(RecoverExtractor::recoveredImageName(index)),
+				  validation_level_name(mLevel));
+		QMutexLocker locker(&mMutex);
+		mInvalid.append(index);
+	}
+	mChecked.fetchAndAddRelaxed(1);
+	return ok;
+}
+
+void RecoverValidator::runJob(int index, const QByteArray & data, int width, int height) {
+	verify(index, (const uint8_t *)data.constData(), data.size(), width, height);
+	mSlots.release();
+}
+
+void RecoverValidator::check(int index, const uint8_t * data, qint64 len,
+							 int width, int height) {
+	if(mLevel == VALIDATE_STRUCTURE) {
+		return;
+	}
+	// Wait only when the decoders are far behind, to bound the memory
+	mSlots.acquire();
+	QByteArray copy((const char *)data, (int)len);
+	mPool.start(new RecoverValidateJob(this, index, copy, width, height));
+}
+
+void RecoverValidator::waitForDone() {
+	mPool.waitForDone();
+}
+
+int RecoverValidator::getInvalidCount() {
+	QMutexLocker locker(&mMutex);
+	return mInvalid.size();
+}
+
+QVector<int> RecoverValidator::getInvalidFrames() {
+	QMutexLocker locker(&mMutex);
+	QVector<int> invalid = mInvalid;
+	std::sort(invalid.begin(), invalid.end());
+	return invalid;
+}
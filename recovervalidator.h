@@ -0,0 +1,113 @@
+/*! \file recovervalidator.h
+ * \brief Verification of the recovered frames by decoding
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The scanner only keeps frames with a valid structure. The frames may also
+ * be decoded, at 1/8 scale or at full resolution, on a thread pool, so the
+ * scanner does not wait for the decoder.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERVALIDATOR_H
+#define RECOVERVALIDATOR_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVector>
+#include <QAtomicInteger>
+#include <stdint.h>
+
+/*! \brief Verification of the frames */
+typedef enum {
+	VALIDATE_STRUCTURE,	///< markers, SOF dimensions and EOI, by the parser
+	VALIDATE_SCALED,	///< decode at 1/8 scale, which only needs the DC coefficients
+	VALIDATE_FULL,		///< decode at full resolution
+	VALIDATE_MAX
+} te_validation_level;
+
+/// \brief Name of the validation level, for logs and command line
+const char * validation_level_name(int level);
+
+/// Max number of frames waiting for their decoding per thread, then the scanner waits
+#define VALIDATE_PENDING_PER_THREAD	16
+
+/*! \brief Decode the frames on a thread pool */
+class RecoverValidator {
+public:
+	RecoverValidator();
+	~RecoverValidator();
+
+	/// \brief Set validation level, VALIDATE_STRUCTURE by default
+	void setLevel(te_validation_level level) { mLevel = level; }
+
+	/// \brief Get validation level
+	te_validation_level getLevel() { return mLevel; }
+
+	/*! \brief Set the number of decoding threads, 0 for the number of cores
+	 * The queue of frames waiting for their decoding follows it.
+	 */
+	void setThreadCount(int threads);
+
+	/*! \brief Queue the decoding of a frame, nothing is done for VALIDATE_STRUCTURE
+	 * The data are copied, so the buffer may be reused when it returns. It
+	 * waits only if too many frames are already queued.
+	 * \param index number of the frame, for the report
+	 * \param width width from SOF, for the scaled size
+	 * \param height height from SOF
+	 */
+	void check(int index, const uint8_t * data, qint64 len, int width, int height);
+
+	/// \brief Wait until all the queued frames are decoded
+	void waitForDone();
+
+	/// \brief Reset the counters and the list of invalid frames
+	void reset();
+
+	/// \brief Number of frames decoded
+	int getCheckedCount() { return mChecked.load(); }
+
+	/// \brief Number of frames which could not be decoded
+	int getInvalidCount();
+
+	/// \brief Numbers of the frames which could not be decoded, sorted
+	QVector<int> getInvalidFrames();
+
+	/*! \brief Decode a frame with Qt image reader
+	 * \return true if the image was decoded
+	 */
+	static bool decode(const QByteArray & data, te_validation_level level,
+					   int width, int height);
+
+	/*! \brief Decode a frame now, on the calling thread, and record the result
+	 * \return true if the image was decoded, or for VALIDATE_STRUCTURE
+	 */
+	bool verify(int index, const uint8_t * data, qint64 len, int width, int height);
+
+	/// \brief Decode one queued frame, called by the jobs
+	void runJob(int index, const QByteArray & data, int width, int height);
+
+private:
+	te_validation_level mLevel;		///< Validation level
+	QThreadPool mPool;				///< Decoding threads
+	QSemaphore mSlots;				///< Free places in the queue
+	QMutex mMutex;					///< Protect mInvalid
+	QVector<int> mInvalid;			///< Frames which could not be decoded
+	QAtomicInteger<int> mChecked;	///< Frames decoded
+};
+
+#endif // RECOVERVALIDATOR_H
@@ -0,0 +1,77 @@
+/*! \file recoverworker.cpp
+ * \brief Extraction in a thread of its own, for the GUI
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverworker.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+RecoverWorker::RecoverWorker(RecoverExtractor * extractor)
+	: QObject() {
+	mExtractor = extractor;
+	mKeepGoing.store(0);
+	mPaused = false;
+}
+
+void RecoverWorker::setPaused(bool on) {
+	QMutexLocker locker(&mMutex);
+	mPaused = on;
+	mResume.wakeAll();
+}
+
+void RecoverWorker::cancel() {
+	mExtractor->setCancelled(true);
+	setPaused(false);
+}
+
+void RecoverWorker::waitWhilePaused() {
+	QMutexLocker locker(&mMutex);
+	while(mPaused && !mExtractor->isCancelled()) {
+		mResume.wait(&mMutex);
+	}
+}
+
+void RecoverWorker::run() {
+	mExtractor->setCancelled(false);
+	// Every frame is shown when they are extracted one by one
+	mExtractor->setPreviewPeriod(mKeepGoing.load() ? WORKER_PREVIEW_PERIOD : 0);
+	int previewIndex = mExtractor->getPreviewIndex();
+
+	QElapsedTimer timer;
+	timer.start();
+	bool ok = true;
+	do {
+		waitWhilePaused();
+		ok = mExtractor->extract();
+
+		// The image is shared, so the window gets it without copy
+		if(mExtractor->getPreviewIndex() != previewIndex) {
+			previewIndex = mExtractor->getPreviewIndex();
+			emit preview(mExtractor->getImage());
+		}
+		if(timer.elapsed() >= WORKER_PROGRESS_PERIOD) {
+			timer.restart();
+			emit progress(mExtractor->getProgress(), mExtractor->getStatus(),
+						  mExtractor->getImageCount());
+		}
+	} while(ok && !mExtractor->atEnd() && mKeepGoing.load());
+
+	emit progress(mExtractor->getProgress(), mExtractor->getStatus(),
+				  mExtractor->getImageCount());
+	emit finished(ok, mExtractor->getStatus());
+}
@@ -0,0 +1,83 @@
+/*! \file recoverworker.h
+ * \brief Extraction in a thread of its own, for the GUI
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The window stays responsive during the long scans: the worker runs
+ * RecoverExtractor::extract() in its thread, and sends the progress and a
+ * reduced preview to the window with queued signals, a few times per
+ * second only, so the window doesn't slow the extraction down.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERWORKER_H
+#define RECOVERWORKER_H
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+#include "recoverextractor.h"
+
+/// Min time between two progress signals, in ms
+#define WORKER_PROGRESS_PERIOD	100
+
+/// Min time between two previews, in ms
+#define WORKER_PREVIEW_PERIOD	250
+
+/*! \brief Run the extractor, to be moved in a QThread */
+class RecoverWorker : public QObject {
+	Q_OBJECT
+public:
+	/// \brief The extractor must not be used by another thread during run()
+	RecoverWorker(RecoverExtractor * extractor);
+
+	/// \brief Extract until the end of file, or one frame per run(), from any thread
+	void setKeepGoing(bool on) { mKeepGoing.store(on ? 1 : 0); }
+
+	/// \brief Pause the extraction after the current frame, from any thread
+	void setPaused(bool on);
+
+	/// \brief Stop the extraction, from any thread, even inside a long scan
+	void cancel();
+
+public slots:
+	/// \brief Extract one frame, or until the end with setKeepGoing()
+	void run();
+
+signals:
+	/// \brief Progress in %, status of the extractor and number of frames found
+	void progress(int percent, const QString & status, int frames);
+
+	/// \brief Reduced image of the last frame found
+	void preview(const QImage & image);
+
+	/// \brief End of run(), ok is false on error or when cancelled
+	void finished(bool ok, const QString & status);
+
+private:
+	/// \brief Wait until setPaused(false) or cancel()
+	void waitWhilePaused();
+
+	RecoverExtractor * mExtractor;	///< Extractor used by run()
+	QAtomicInt mKeepGoing;			///< Go on until the end of file
+	QMutex mMutex;					///< Protect mPaused
+	QWaitCondition mResume;			///< Wake the paused extraction up
+	bool mPaused;					///< Pause requested
+};
+
+#endif // RECOVERWORKER_H
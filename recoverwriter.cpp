@@ -0,0 +1,96 @@
+/*! \file recoverwriter.cpp
+ * \brief Writing of the recovered images on another thread
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "recoverwriter.h"
+#include "recoverextractor.h"
+
+#include <QMutexLocker>
+
+/*! \brief Job writing the queued files */
+class RecoverWriterJob : public QRunnable {
+public:
+	RecoverWriterJob(RecoverWriter * writer) : mWriter(writer) {}
+	void run() { mWriter->runWriter(); }
+private:
+	RecoverWriter * mWriter;
+};
+
+RecoverWriter::RecoverWriter()
+	: mQueue(WRITER_QUEUE_LEN) {
+	mRunning = false;
+	mQueued = 0;
+	mWritten.store(0);
+	mErrors.store(0);
+	mPool.setMaxThreadCount(1);
+}
+
+RecoverWriter::~RecoverWriter() {
+	waitForDone();
+}
+
+bool RecoverWriter::write(const QString & path, const uint8_t * data, qint64 len) {
+	if(mErrors.load() > 0) {
+		return false;
+	}
+	if(!mRunning) {
+		mPool.start(new RecoverWriterJob(this));
+		mRunning = true;
+	}
+	t_writer_item item;
+	item.path = path;
+	item.data = QByteArray((const char *)data, (int)len);
+	mQueue.push(item);
+	mQueued++;
+	return true;
+}
+
+bool RecoverWriter::waitForDone() {
+	if(mRunning) {
+		t_writer_item end;
+		mQueue.push(end);
+		mPool.waitForDone();
+		mRunning = false;
+	}
+	return mErrors.load() == 0;
+}
+
+QString RecoverWriter::getStatus() {
+	QMutexLocker lock(&mMutex);
+	return mStatus;
+}
+
+void RecoverWriter::runWriter() {
+	while(true) {
+		t_writer_item item = mQueue.pop();
+		if(item.path.isEmpty()) {
+			return;
+		}
+		// After an error, the files are dropped until the extractor stops
+		if(mErrors.load() > 0) {
+			continue;
+		}
+		if(RecoverExtractor::writeFile(item.path, (const uint8_t *)item.data.constData(),
+									   item.data.size()) < 0) {
+			QMutexLocker lock(&mMutex);
+			mStatus = QObject::tr("Cannot write ") + item.path;
+			mErrors.ref();
+			continue;
+		}
+		mWritten.fetchAndAddOrdered(1);
+	}
+}
@@ -0,0 +1,91 @@
+/*! \file recoverwriter.h
+ * \brief Writing of the recovered images on another thread
+ * \copyright Christophe Seyve \em cseyve@free.fr
+ *
+ * The frames are copied in a bounded queue and written by a writer job, so
+ * the scan goes on while the images are written, and waits only when the
+ * disk is slower than the scan.
+ */
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOVERWRITER_H
+#define RECOVERWRITER_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include <stdint.h>
+
+#include "recoverqueue.h"
+
+/// Max number of images waiting to be written, then the scan waits
+#define WRITER_QUEUE_LEN	32
+
+/*! \brief Image to write, an empty path stops the writer */
+typedef struct {
+	QString path;		///< File of the image
+	QByteArray data;	///< Copy of the frame
+} t_writer_item;
+
+/*! \brief Writer of the images in their files */
+class RecoverWriter {
+public:
+	RecoverWriter();
+	~RecoverWriter();
+
+	/*! \brief Queue a file to write, the data are copied
+	 * Wait while the queue is full.
+	 * \return false if a previous file could not be written
+	 */
+	bool write(const QString & path, const uint8_t * data, qint64 len);
+
+	/*! \brief Wait until the queued files are written
+	 * \return false if a file could not be written, see getStatus()
+	 */
+	bool waitForDone();
+
+	/// \brief Number of files waiting, for statistics
+	int queueDepth() { return mQueue.depth(); }
+
+	/// \brief Max number of files waiting
+	int queueCapacity() { return mQueue.capacity(); }
+
+	/// \brief Number of files queued since the creation
+	qint64 queuedCount() { return mQueued; }
+
+	/// \brief Number of files written since the creation, in the order they were queued
+	qint64 writtenCount() { return mWritten.loadAcquire(); }
+
+	/// \brief Get error string
+	QString getStatus();
+
+	/// \brief Write the queued files until the end item, called by the writer job
+	void runWriter();
+
+private:
+	RecoverQueue<t_writer_item> mQueue;	///< Files to write
+	QThreadPool mPool;		///< Thread of the writer
+	bool mRunning;			///< The writer job has been started
+	qint64 mQueued;			///< Files queued, by the thread of the extractor
+	QAtomicInteger<qint64> mWritten;	///< Files written, by the writer job
+	QAtomicInteger<int> mErrors;	///< Number of files not written
+	QMutex mMutex;			///< Protect the status
+	QString mStatus;		///< First error
+};
+
+#endif // RECOVERWRITER_H